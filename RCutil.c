@@ -15,6 +15,7 @@
 #include "temperature.h"
 #include "flp.h"
 #include "util.h"
+#include "profile.h"
 
 /* thermal resistance calculation	*/
 double getr(double conductivity, double thickness, double area)
@@ -528,6 +529,7 @@ void rk4_core(void *model, double *y, double *k1, void *p, int n, double h, doub
 	free_dvector(k3);
 	free_dvector(k4);
 	free_dvector(t);
+	PROF_COUNT(slope_evals, 3);
 }
 
 /*
@@ -535,16 +537,18 @@ void rk4_core(void *model, double *y, double *k1, void *p, int n, double h, doub
  * It integrates and solves the ODE dy + cy = p between
  * t and t+h. It returns the correct step size to be used
  * next time. slope function f is the call back used to
- * evaluate the derivative at each point
+ * evaluate the derivative at each point. 'precision' is the
+ * max. error (in K) allowed per step
  */
 #define RK4_SAFETY		0.95
 #define RK4_MAXUP		5.0
 #define RK4_MAXDOWN		10.0
-#define RK4_PRECISION	0.01
-double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slope_fn_ptr f)
+double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slope_fn_ptr f,
+		   double precision)
 {
 	int i;
 	double *k1, *t1, *t2, *ytemp, max, new_h = (*h);
+	mem_tag_t tag = mem_set_tag(MEM_SOLVER);
 
 	k1 = dvector(n);
 	t1 = dvector(n);
@@ -553,6 +557,7 @@ double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slop
 
 	/* evaluate the slope k1 at the beginning */
 	(*f)(model, y, p, k1);
+	PROF_COUNT(slope_evals, 1);
 
 	/* try until accuracy is achieved	*/
   do {
@@ -566,6 +571,7 @@ double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slop
 
 		/* y after 1st half-step is in t1. re-evaluate k1 for this	*/
 		(*f)(model, t1, p, k1);
+		PROF_COUNT(slope_evals, 1);
 
 		/* get output of the second half-step in t2	*/
 		rk4_core(model, t1, k1, p, n, (*h)/2.0, t2, f);
@@ -607,18 +613,22 @@ double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slop
 		 * in C"
 		 */
 		/* accuracy OK. increase step size	*/
-		if (max <= RK4_PRECISION) {
-			new_h = RK4_SAFETY * (*h) * pow(fabs(RK4_PRECISION/max), 0.2);
+		if (max <= precision) {
+			new_h = RK4_SAFETY * (*h) * pow(fabs(precision/max), 0.2);
 			if (new_h > RK4_MAXUP * (*h))
 				new_h = RK4_MAXUP * (*h);
 		/* inaccuracy error. decrease step size	and compute again */
 		} else {
-			new_h = RK4_SAFETY * (*h) * pow(fabs(RK4_PRECISION/max), 0.25);
+			new_h = RK4_SAFETY * (*h) * pow(fabs(precision/max), 0.25);
 			if (new_h < (*h) / RK4_MAXDOWN)
 				new_h = (*h) / RK4_MAXDOWN;
 		}
 
+		/* the step is retried with the smaller size	*/
+		if (new_h < (*h))
+			PROF_COUNT(steps_rejected, 1);
 	} while (new_h < (*h));
+	prof_step(*h);
 
 	/* commit ytemp to yout	*/
 	#if (MATHACCEL == MA_INTEL || MATHACCEL == MA_APPLE)
@@ -634,6 +644,7 @@ double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slop
 	free_dvector(t1);
 	free_dvector(t2);
 	free_dvector(ytemp);
+	mem_set_tag(tag);
 
 	/* return the step-size	*/
 	return new_h;
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ensemble.h"
+#include "temperature.h"
+#include "temperature_grid.h"
+#include "util.h"
+#include "profile.h"
+
+/*
+ * colour of a grid cell for probing the stencil. two cells of
+ * the same colour are never neighbours and never share one in
+ * the 7-point stencil (offsets along i, j and n map to 1, 2 and
+ * 3 modulo 7, and all the sums/differences of two of them are
+ * non-zero modulo 7)
+ */
+#define N_COLOURS			7
+#define COLOUR(n,i,j)		(((i) + 2*(j) + 3*(n)) % N_COLOURS)
+
+/* growable list of stencil entries	*/
+typedef struct entry_list_t_st
+{
+	int n, size;
+	int *row, *col;
+	double *val;
+}entry_list_t;
+
+static void add_entry(entry_list_t *l, int row, int col, double val)
+{
+	if (l->n == l->size) {
+		l->size = l->size ? 2 * l->size : 1024;
+		l->row = (int *) realloc(l->row, l->size * sizeof(int));
+		l->col = (int *) realloc(l->col, l->size * sizeof(int));
+		l->val = (double *) realloc(l->val, l->size * sizeof(double));
+		if (!l->row || !l->col || !l->val)
+			fatal("memory allocation error\n");
+	}
+	l->row[l->n] = row;
+	l->col[l->n] = col;
+	l->val[l->n] = val;
+	l->n++;
+}
+
+/* dv = offset + cinv * p + J * v for 'k' node-major scenarios	*/
+static void apply_stencil(grid_ensemble_t *e, int k, double *v, double *p, double *dv)
+{
+	int r, s, idx;
+	double a, c, *in, *out;
+
+	for(r=0; r < e->n_nodes; r++) {
+		out = &dv[r*k];
+		c = e->offset[r];
+		if (r < e->n_cells) {
+			a = e->cinv[r];
+			in = &p[r*k];
+			for(s=0; s < k; s++)
+				out[s] = c + a * in[s];
+		} else
+			for(s=0; s < k; s++)
+				out[s] = c;
+		for(idx=e->row_ptr[r]; idx < e->row_ptr[r+1]; idx++) {
+			a = e->val[idx];
+			in = &v[e->col[idx]*k];
+			for(s=0; s < k; s++)
+				out[s] += a * in[s];
+		}
+	}
+}
+
+/* slope function callback for rk4	*/
+static void slope_fn_ensemble(grid_ensemble_t *e, double *v, double *p, double *dv)
+{
+	apply_stencil(e, e->k, v, p, dv);
+}
+
+/*
+ * extract the stencil by probing slope_fn_grid around the
+ * ambient temperature. cell-to-cell entries need one probe
+ * per colour. cell-to-package entries need one probe per
+ * package node. package-to-cell entries are probed with
+ * groups of cells no two of which are coupled to the same
+ * package node (known from the previous step, since the
+ * couplings are conductances and hence go both ways)
+ */
+static void build_stencil(grid_ensemble_t *e)
+{
+	grid_model_t *model = e->model;
+	int nl = model->n_layers, nr = model->rows, nc = model->cols;
+	int n_cells = e->n_cells, n_nodes = e->n_nodes;
+	int n_extra = n_nodes - n_cells;
+	int n, i, j, q, x, c, r, g, n_groups;
+	int *group, *count;
+	unsigned int *xmask, *used;
+	double d, err, max, ambient = model->config.ambient;
+	double *v, *f0, *f, *pc;
+	grid_model_vector_t *p;
+	entry_list_t list;
+
+	if (n_extra > 8 * sizeof(unsigned int))
+		fatal("too many package nodes for the ensemble stencil\n");
+
+	memset(&list, 0, sizeof(entry_list_t));
+	p = new_grid_model_vector(model);
+	pc = p->cuboid[0][0];
+	zero_dvector(pc, n_nodes);
+	v = dvector(n_nodes);
+	f0 = dvector(n_nodes);
+	f = dvector(n_nodes);
+
+	/* reference slope at ambient with no power	*/
+	for(r=0; r < n_nodes; r++)
+		v[r] = ambient;
+	slope_fn_grid(model, v, p, f0);
+
+	/* power: a single probe covers all the cells	*/
+	for(c=0; c < n_cells; c++)
+		pc[c] = 1.0;
+	slope_fn_grid(model, v, p, f);
+	for(c=0; c < n_cells; c++) {
+		e->cinv[c] = f[c] - f0[c];
+		pc[c] = 0.0;
+	}
+
+	/* cell to cell: one probe per colour	*/
+	for(q=0; q < N_COLOURS; q++) {
+		for(n=0; n < nl; n++)
+			for(i=0; i < nr; i++)
+				for(j=0; j < nc; j++)
+					if (COLOUR(n, i, j) == q)
+						v[(n*nr + i)*nc + j] += 1.0;
+		slope_fn_grid(model, v, p, f);
+		for(n=0; n < nl; n++)
+			for(i=0; i < nr; i++)
+				for(j=0; j < nc; j++) {
+					c = (n*nr + i)*nc + j;
+					v[c] = ambient;
+					d = f[c] - f0[c];
+					if (d == 0.0)
+						continue;
+					/* the only cell of colour q in c's neighbourhood	*/
+					switch ((q - COLOUR(n, i, j) + N_COLOURS) % N_COLOURS) {
+						case 0: r = c; break;
+						case 1: r = (i < nr-1) ? c + nc : -1; break;
+						case 6: r = (i > 0) ? c - nc : -1; break;
+						case 2: r = (j < nc-1) ? c + 1 : -1; break;
+						case 5: r = (j > 0) ? c - 1 : -1; break;
+						case 3: r = (n < nl-1) ? c + nr*nc : -1; break;
+						default: r = (n > 0) ? c - nr*nc : -1; break;
+					}
+					if (r < 0)
+						fatal("grid cells coupled beyond their neighbours\n");
+					add_entry(&list, c, r, d);
+				}
+	}
+
+	/* package nodes: one probe each	*/
+	xmask = (unsigned int *) calloc(n_cells, sizeof(unsigned int));
+	used = (unsigned int *) calloc(n_cells, sizeof(unsigned int));
+	if (!xmask || !used)
+		fatal("memory allocation error\n");
+	for(x=0; x < n_extra; x++) {
+		v[n_cells+x] += 1.0;
+		slope_fn_grid(model, v, p, f);
+		v[n_cells+x] = ambient;
+		for(r=0; r < n_nodes; r++) {
+			d = f[r] - f0[r];
+			if (d == 0.0)
+				continue;
+			add_entry(&list, r, n_cells+x, d);
+			if (r < n_cells)
+				xmask[r] |= 1u << x;
+		}
+	}
+
+	/* cells coupled to the package: greedy grouping	*/
+	group = ivector(n_cells);
+	n_groups = 0;
+	for(c=0; c < n_cells; c++) {
+		group[c] = -1;
+		if (!xmask[c])
+			continue;
+		for(g=0; g < n_groups && (used[g] & xmask[c]); g++);
+		if (g == n_groups)
+			n_groups++;
+		used[g] |= xmask[c];
+		group[c] = g;
+	}
+	for(g=0; g < n_groups; g++) {
+		for(c=0; c < n_cells; c++)
+			if (group[c] == g)
+				v[c] += 1.0;
+		slope_fn_grid(model, v, p, f);
+		for(c=0; c < n_cells; c++)
+			if (group[c] == g)
+				v[c] = ambient;
+		for(x=0; x < n_extra; x++) {
+			d = f[n_cells+x] - f0[n_cells+x];
+			if (d == 0.0)
+				continue;
+			for(c=0; c < n_cells && !(group[c] == g && (xmask[c] & (1u << x))); c++);
+			if (c == n_cells)
+				fatal("asymmetric coupling between the grid and the package\n");
+			add_entry(&list, n_cells+x, c, d);
+		}
+	}
+
+	/* compressed sparse row format	*/
+	count = ivector(n_nodes);
+	e->row_ptr = ivector(n_nodes + 1);
+	e->col = ivector(MAX(list.n, 1));
+	e->val = dvector(MAX(list.n, 1));
+	for(i=0; i < list.n; i++)
+		e->row_ptr[list.row[i]+1]++;
+	for(r=0; r < n_nodes; r++)
+		e->row_ptr[r+1] += e->row_ptr[r];
+	for(i=0; i < list.n; i++) {
+		r = list.row[i];
+		e->col[e->row_ptr[r] + count[r]] = list.col[i];
+		e->val[e->row_ptr[r] + count[r]] = list.val[i];
+		count[r]++;
+	}
+
+	/* constant part: the probes were taken around ambient	*/
+	for(r=0; r < n_nodes; r++) {
+		e->offset[r] = f0[r];
+		for(i=e->row_ptr[r]; i < e->row_ptr[r+1]; i++)
+			e->offset[r] -= e->val[i] * ambient;
+	}
+
+	/* the stencil should reproduce the slope function	*/
+	for(r=0; r < n_nodes; r++)
+		v[r] = ambient + (r % 17);
+	for(c=0; c < n_cells; c++)
+		pc[c] = (c % 13) * 1.0e-3;
+	slope_fn_grid(model, v, p, f0);
+	apply_stencil(e, 1, v, pc, f);
+	err = max = 0.0;
+	for(r=0; r < n_nodes; r++) {
+		max = MAX(max, fabs(f0[r]));
+		err = MAX(err, fabs(f[r] - f0[r]));
+	}
+	if (err > 1.0e-6 * max)
+		fatal("grid model slopes are not reproduced by the ensemble stencil\n");
+
+	free(list.row);
+	free(list.col);
+	free(list.val);
+	free(xmask);
+	free(used);
+	free_ivector(group);
+	free_ivector(count);
+	free_dvector(v);
+	free_dvector(f0);
+	free_dvector(f);
+	free_grid_model_vector(p);
+}
+
+grid_ensemble_t *alloc_grid_ensemble(grid_model_t *model, int k)
+{
+	int r, extra_nodes;
+	grid_ensemble_t *e;
+
+	if (!model->r_ready || !model->c_ready)
+		fatal("grid model not ready\n");
+	if (k < 1)
+		fatal("ensemble should have at least one scenario\n");
+
+	if (model->config.model_secondary)
+		extra_nodes = EXTRA + EXTRA_SEC;
+	else
+		extra_nodes = EXTRA;
+
+	e = (grid_ensemble_t *) calloc (1, sizeof(grid_ensemble_t));
+	if (!e)
+		fatal("memory allocation error\n");
+	e->model = model;
+	e->k = k;
+	e->n_cells = model->n_layers * model->rows * model->cols;
+	e->n_nodes = e->n_cells + extra_nodes;
+	e->cinv = dvector(e->n_cells);
+	e->offset = dvector(e->n_nodes);
+	e->temp = dvector(e->n_nodes * k);
+	e->power = dvector(e->n_cells * k);
+	e->g = new_grid_model_vector(model);
+
+	build_stencil(e);
+
+	for(r=0; r < e->n_nodes * k; r++)
+		e->temp[r] = model->config.ambient;
+
+	#if VERBOSE > 0
+	fprintf(stdout, "ensemble of %d: %d nodes, %d stencil entries\n", k,
+			e->n_nodes, e->row_ptr[e->n_nodes]);
+	#endif
+
+	return e;
+}
+
+void delete_grid_ensemble(grid_ensemble_t *e)
+{
+	free_ivector(e->row_ptr);
+	free_ivector(e->col);
+	free_dvector(e->val);
+	free_dvector(e->cinv);
+	free_dvector(e->offset);
+	free_dvector(e->temp);
+	free_dvector(e->power);
+	free_grid_model_vector(e->g);
+	free(e);
+}
+
+void set_ensemble_temp(grid_ensemble_t *e, int s, double *temp)
+{
+	int r;
+	double *g = e->g->cuboid[0][0];
+
+	xlate_vector_b2g(e->model, temp, e->g, V_TEMP);
+	for(r=0; r < e->n_nodes; r++)
+		e->temp[r*e->k + s] = g[r];
+}
+
+void get_ensemble_temp(grid_ensemble_t *e, int s, double *temp)
+{
+	int r;
+	double *g = e->g->cuboid[0][0];
+
+	for(r=0; r < e->n_nodes; r++)
+		g[r] = e->temp[r*e->k + s];
+	xlate_temp_g2b(e->model, temp, e->g);
+}
+
+void compute_temp_ensemble(grid_ensemble_t *e, double **power, double time_elapsed)
+{
+	int r, s, k = e->k;
+	double t, h, new_h, start;
+	double *g = e->g->cuboid[0][0];
+
+	/* map the block power numbers of each scenario to the grid	*/
+	for(s=0; s < k; s++) {
+		set_internal_power_grid(e->model, power[s]);
+		xlate_vector_b2g(e->model, power[s], e->g, V_POWER);
+		for(r=0; r < e->n_cells; r++)
+			e->power[r*k + s] = g[r];
+	}
+
+	/* same stepping as compute_temp_grid, over all the scenarios	*/
+	start = prof_begin();
+	for (t = 0, new_h = MIN_STEP; t < time_elapsed && new_h >= MIN_STEP*DELTA; t+=h) {
+		h = new_h;
+		new_h = rk4(e, e->temp, e->power, e->n_nodes * k, &h, e->temp,
+					/* the slope function callback is typecast accordingly */
+					(slope_fn_ptr) slope_fn_ensemble, e->model->config.rk4_tolerance);
+		new_h = MIN(new_h, time_elapsed-t-h);
+	}
+	prof_end(PROF_INTEGRATE, start);
+}
@@ -0,0 +1,56 @@
+#ifndef __ENSEMBLE_H_
+#define __ENSEMBLE_H_
+
+#include "temperature_grid.h"
+
+/*
+ * ensemble of transient simulations of one grid model, e.g. the
+ * same chip running many different power traces. the slope
+ * function of the grid model is linear in the temperatures and
+ * the power numbers. so, it is extracted once as a sparse
+ * stencil by probing slope_fn_grid itself. the state of the
+ * ensemble is stored node-major with the 'k' scenarios of a
+ * node contiguous. hence, a single pass over the stencil
+ * updates all the scenarios and the innermost loops (over the
+ * scenarios) vectorize. the scenarios share the adaptive step
+ * size of the RK4 solver, which is set by the worst of them.
+ */
+typedef struct grid_ensemble_t_st
+{
+	grid_model_t *model;
+	/* no. of scenarios	*/
+	int k;
+	/* no. of grid cells and of all nodes (cells + package)	*/
+	int n_cells, n_nodes;
+	/* d(slope)/d(temperature) in compressed sparse row format	*/
+	int *row_ptr, *col;
+	double *val;
+	/* d(slope)/d(power) of the grid cells i.e., 1/C	*/
+	double *cinv;
+	/* slope at zero temperature and power (ambient, coolant inlets)	*/
+	double *offset;
+	/* node-major temperatures and grid power of the scenarios	*/
+	double *temp, *power;
+	/* scratch pad for the translations to and from the blocks	*/
+	grid_model_vector_t *g;
+}grid_ensemble_t;
+
+/*
+ * constructor/destructor. the R and C models of 'model'
+ * should be ready. all the scenarios start at ambient
+ */
+grid_ensemble_t *alloc_grid_ensemble(grid_model_t *model, int k);
+void delete_grid_ensemble(grid_ensemble_t *e);
+
+/* set/get the block temperatures of scenario 's'	*/
+void set_ensemble_temp(grid_ensemble_t *e, int s, double *temp);
+void get_ensemble_temp(grid_ensemble_t *e, int s, double *temp);
+
+/*
+ * advance all the scenarios by 'time_elapsed'. 'power' holds
+ * the block power vectors (allocated with hotspot_vector)
+ * of the 'k' scenarios
+ */
+void compute_temp_ensemble(grid_ensemble_t *e, double **power, double time_elapsed);
+
+#endif
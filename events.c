@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "events.h"
+#include "util.h"
+
+int parse_trips(char *str, double *trips)
+{
+	char copy[STR_SIZE], *ptr;
+	int n = 0;
+
+	strncpy(copy, str, STR_SIZE - 1);
+	copy[STR_SIZE - 1] = '\0';
+	for(ptr = strtok(copy, ","); ptr; ptr = strtok(NULL, ",")) {
+		if (n == MAX_TRIPS)
+			fatal("too many trip points\n");
+		if (sscanf(ptr, "%lf", &trips[n++]) != 1)
+			fatal("invalid format of trip points\n");
+	}
+	if (!n)
+		fatal("no trip points\n");
+	return n;
+}
+
+events_t *alloc_events(char *file, int append, char **names, int n, double *trips,
+					   int n_trips, double hysteresis, double *temp)
+{
+	int i, k;
+	events_t *e;
+
+	e = (events_t *) tcalloc(1, sizeof(events_t));
+	if (!(e->fp = fopen(file, append ? "a" : "w")))
+		fatal("unable to open event file for output\n");
+	e->names = names;
+	e->n = n;
+	e->n_trips = n_trips;
+	memcpy(e->trips, trips, n_trips * sizeof(double));
+	e->hysteresis = hysteresis;
+	e->up = (char *) tcalloc(n * n_trips, sizeof(char));
+	e->last = dvector(n);
+	copy_dvector(e->last, temp, n);
+	for(i=0; i < n; i++)
+		for(k=0; k < n_trips; k++)
+			e->up[i*n_trips+k] = (temp[i] >= trips[k]);
+	if (!append)
+		fprintf(e->fp, "# time\tunit\tdirection\ttrip\ttemperature\n");
+	return e;
+}
+
+void free_events(events_t *e)
+{
+	fclose(e->fp);
+	tfree(e->up);
+	free_dvector(e->last);
+	tfree(e);
+}
+
+void events_add(events_t *e, double time, double dt, double *temp)
+{
+	int i, k;
+	double p, x, level;
+	char *up;
+
+	for(i=0; i < e->n; i++) {
+		p = e->last[i];
+		x = temp[i];
+		up = &e->up[i*e->n_trips];
+		for(k=0; k < e->n_trips; k++) {
+			if (!up[k] && x >= e->trips[k])
+				level = e->trips[k];
+			else if (up[k] && x < e->trips[k] - e->hysteresis)
+				level = e->trips[k] - e->hysteresis;
+			else
+				continue;
+			up[k] = !up[k];
+			/* linear in between. a state from before the
+			 * start may have crossed already at its beginning
+			 */
+			fprintf(e->fp, "%.9g\t%s\t%s\t%.2f\t%.2f\n",
+					time - dt * ((x != p) ? MID3(0, (x - level) / (x - p), 1) : 0),
+					e->names[i], up[k] ? "up" : "down", e->trips[k], x);
+			e->count++;
+		}
+		e->last[i] = x;
+	}
+}
+
+size_t events_state_size(int n, int n_trips)
+{
+	return 2 * sizeof(int) + n * sizeof(double) + (size_t) n * n_trips;
+}
+
+int load_events_state(events_t *e, void *buf, size_t size)
+{
+	int dims[2];
+	char *ptr = (char *) buf;
+
+	if (size < 2 * sizeof(int))
+		return FALSE;
+	memcpy(dims, ptr, 2 * sizeof(int));
+	if (dims[0] != e->n || dims[1] != e->n_trips || events_state_size(e->n, e->n_trips) > size)
+		return FALSE;
+	ptr += 2 * sizeof(int);
+	memcpy(e->last, ptr, e->n * sizeof(double));
+	memcpy(e->up, ptr + e->n * sizeof(double), e->n * e->n_trips);
+	return TRUE;
+}
+
+void save_events_state(events_t *e, void *buf, size_t size)
+{
+	int dims[2] = {e->n, e->n_trips};
+	char *ptr = (char *) buf;
+
+	if (events_state_size(e->n, e->n_trips) > size)
+		fatal("no room for the event state\n");
+	memcpy(ptr, dims, 2 * sizeof(int));
+	ptr += 2 * sizeof(int);
+	memcpy(ptr, e->last, e->n * sizeof(double));
+	memcpy(ptr + e->n * sizeof(double), e->up, e->n * e->n_trips);
+}
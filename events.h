@@ -0,0 +1,62 @@
+#ifndef __EVENTS_H_
+#define __EVENTS_H_
+
+#include <stdio.h>
+
+#include "util.h"
+
+/*
+ * threshold events of the block temperatures, for consumers (e.g.
+ * the DTM policies of ThermSniper) that only need to know when a
+ * block crosses a trip point. each (block, trip point) pair has a
+ * hysteresis state: it goes up when the temperature reaches the
+ * trip point and down only when it falls below the trip point less
+ * the hysteresis. only these transitions are written, one per line:
+ * <time> <block> <up/down> <trip point> <temperature>
+ * with the time of the crossing interpolated within the interval
+ * and the temperature at the end of it
+ */
+#define MAX_TRIPS	16
+
+typedef struct events_t_st
+{
+	FILE *fp;
+	/* block names (not owned)	*/
+	char **names;
+	int n;
+	double trips[MAX_TRIPS];
+	int n_trips;
+	double hysteresis;
+	/* state of the pairs, block-major, and the last temperatures	*/
+	char *up;
+	double *last;
+	/* events written	*/
+	long count;
+}events_t;
+
+/*
+ * parse a comma separated list of trip points into 'trips'.
+ * returns their no.
+ */
+int parse_trips(char *str, double *trips);
+/*
+ * events of 'n' blocks written to 'file' (appended to if 'append',
+ * else started with a header line). 'temp' has the temperatures at
+ * the start, from which the state is initialized
+ */
+events_t *alloc_events(char *file, int append, char **names, int n, double *trips,
+					   int n_trips, double hysteresis, double *temp);
+void free_events(events_t *e);
+/* the block temperatures at 'time', 'dt' after the previous ones	*/
+void events_add(events_t *e, double time, double dt, double *temp);
+/*
+ * the hysteresis state across runs (e.g. ThermSniper invocations),
+ * kept in a buffer of 'size' bytes (see state_aux) of which it takes
+ * events_state_size. load returns FALSE if the buffer has no state
+ * that matches the events
+ */
+size_t events_state_size(int n, int n_trips);
+int load_events_state(events_t *e, void *buf, size_t size);
+void save_events_state(events_t *e, void *buf, size_t size);
+
+#endif
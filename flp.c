@@ -9,6 +9,7 @@
 #endif
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "flp.h"
 #include "npe.h"
@@ -16,6 +17,8 @@
 #include "util.h"
 #include "temperature.h"
 #include "temperature_block.h"
+#include "temperature_grid.h"
+#include "surrogate.h"
 
 /*
  * this is the metric function used for the floorplanning.
@@ -25,26 +28,75 @@
  * area (A), temperature (T) and wire length (W):
  * lambdaA * A + lambdaT * T  + lambdaW * W
  * thermal model and power density are passed as parameters
- * since temperature is used in the metric.
+ * since temperature is used in the metric. the steady state
+ * temperatures are returned in 'temp'. if 'warm' is set, its
+ * incoming contents are used as the initial guess for the
+ * solver (see warm_start_guess). if 'surrogate' is non-NULL,
+ * the peak temperature is only estimated using it and 'temp'
+ * is left untouched. 'wire_length' is the wire metric of flp
+ * if already known (see flp_wires_t) and negative otherwise.
  */
-double flp_evaluate_metric(flp_t *flp, RC_model_t *model, double *power,
+double flp_evaluate_metric(flp_t *flp, RC_model_t *model,
+						   surrogate_t *surrogate, double *power,
+						   double *temp, int warm, double wire_length,
 						   double lambdaA, double lambdaT, double lambdaW)
 {
-	double tmax, area, wire_length;
-	double *temp;
-
-	temp = hotspot_vector(model);
-	populate_R_model(model, flp);
-	// steady_state_temp(model, power, temp);
-	tmax = find_max_temp(model, temp);
+	double tmax = -1.0, area;
+
+	if (surrogate)
+		tmax = surrogate_max_temp(surrogate, flp, power);
+	/* no surrogate or floorplan too large for it	*/
+	if (tmax < 0) {
+		populate_R_model(model, flp);
+		if (warm)
+			steady_state_temp_warm(model, power, temp);
+		else
+			steady_state_temp(model, power, temp);
+		tmax = find_max_temp(model, temp);
+	}
 	area = get_total_area(flp);
-	wire_length = get_wire_metric(flp);
-	free_dvector(temp);
+	if (wire_length < 0)
+		wire_length = get_wire_metric(flp);
 
 	/* can return any arbitrary function of area, tmax and wire_length	*/
 	return (lambdaA * area + lambdaT * tmax + lambdaW * wire_length);
 }
 
+/*
+ * map the block model temperatures 'src' of a floorplan with
+ * 'src_n' blocks onto 'dst', the initial guess for the next
+ * floorplan with 'dst_n' blocks. consecutive annealing moves
+ * change the floorplan only a little. so, the solution of the
+ * last accepted floorplan is a good starting point. the first
+ * 'n_fixed' (functional) blocks keep their positions in the
+ * vector and are copied layer by layer. the others (dead
+ * space, L2 and rim blocks) get their layer's average.
+ * the grid model keeps its own previous solution instead.
+ */
+static void warm_start_guess(RC_model_t *model, double *dst, int dst_n,
+							 double *src, int src_n, int n_fixed)
+{
+	int i, l;
+	double avg;
+
+	if (model->type != BLOCK_MODEL)
+		return;
+
+	for(l=0; l < NL; l++) {
+		avg = 0.0;
+		for(i=0; i < src_n; i++)
+			avg += src[l*src_n+i];
+		avg /= src_n;
+		for(i=0; i < n_fixed; i++)
+			dst[l*dst_n+i] = src[l*src_n+i];
+		for(; i < dst_n; i++)
+			dst[l*dst_n+i] = avg;
+	}
+	/* package nodes	*/
+	for(i=0; i < EXTRA; i++)
+		dst[NL*dst_n+i] = src[NL*src_n+i];
+}
+
 
 /* default flp_config	*/
 flp_config_t default_flp_config(void)
@@ -94,6 +146,15 @@ flp_config_t default_flp_config(void)
 	config.lambdaT = 1.0;
 	config.lambdaW = 350;
 
+	/* thermal surrogate for the annealing moves	*/
+	config.thermal_surrogate = FALSE;
+	config.surrogate_grid = 64;
+
+	/* a single annealing chain by default	*/
+	config.n_chains = 1;
+	config.n_threads = 1;
+	config.rand_seed = RAND_SEED;
+
 	return config;
 }
 
@@ -149,6 +210,21 @@ void flp_config_add_from_strs(flp_config_t *config, str_pair *table, int size)
 	if ((idx = get_str_index(table, size, "lambdaW")) >= 0)
 		if(sscanf(table[idx].value, "%lf", &config->lambdaW) != 1)
 			fatal("invalid format for configuration  parameter lambdaW\n");
+	if ((idx = get_str_index(table, size, "thermal_surrogate")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->thermal_surrogate) != 1)
+			fatal("invalid format for configuration  parameter thermal_surrogate\n");
+	if ((idx = get_str_index(table, size, "surrogate_grid")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->surrogate_grid) != 1)
+			fatal("invalid format for configuration  parameter surrogate_grid\n");
+	if ((idx = get_str_index(table, size, "n_chains")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->n_chains) != 1)
+			fatal("invalid format for configuration  parameter n_chains\n");
+	if ((idx = get_str_index(table, size, "n_threads")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->n_threads) != 1)
+			fatal("invalid format for configuration  parameter n_threads\n");
+	if ((idx = get_str_index(table, size, "rand_seed")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->rand_seed) != 1)
+			fatal("invalid format for configuration  parameter rand_seed\n");
 
 	if (config->rim_thickness <= 0)
 		fatal("rim thickness should be greater than zero\n");
@@ -166,6 +242,12 @@ void flp_config_add_from_strs(flp_config_t *config, str_pair *table, int size)
 		fatal("Rreject should be between 0 and 1\n");
 	if (config->Nmax < 0)
 		fatal("Nmax should be non-negative\n");
+	if ((config->surrogate_grid < 2) || (config->surrogate_grid & (config->surrogate_grid-1)))
+		fatal("surrogate_grid should be a power of two greater than 1\n");
+	if (config->n_chains < 1)
+		fatal("n_chains should be at least 1\n");
+	if (config->n_threads < 1)
+		fatal("n_threads should be at least 1\n");
 }
 
 /*
@@ -174,7 +256,7 @@ void flp_config_add_from_strs(flp_config_t *config, str_pair *table, int size)
  */
 int flp_config_to_strs(flp_config_t *config, str_pair *table, int max_entries)
 {
-	if (max_entries < 15)
+	if (max_entries < 20)
 		fatal("not enough entries in table\n");
 
 	sprintf(table[0].name, "wrap_l2");
@@ -192,6 +274,11 @@ int flp_config_to_strs(flp_config_t *config, str_pair *table, int max_entries)
 	sprintf(table[12].name, "lambdaA");
 	sprintf(table[13].name, "lambdaT");
 	sprintf(table[14].name, "lambdaW");
+	sprintf(table[15].name, "thermal_surrogate");
+	sprintf(table[16].name, "surrogate_grid");
+	sprintf(table[17].name, "n_chains");
+	sprintf(table[18].name, "n_threads");
+	sprintf(table[19].name, "rand_seed");
 
 	sprintf(table[0].value, "%d", config->wrap_l2);
 	sprintf(table[1].value, "%s", config->l2_label);
@@ -208,8 +295,13 @@ int flp_config_to_strs(flp_config_t *config, str_pair *table, int max_entries)
 	sprintf(table[12].value, "%lg", config->lambdaA);
 	sprintf(table[13].value, "%lg", config->lambdaT);
 	sprintf(table[14].value, "%lg", config->lambdaW);
+	sprintf(table[15].value, "%d", config->thermal_surrogate);
+	sprintf(table[16].value, "%d", config->surrogate_grid);
+	sprintf(table[17].value, "%d", config->n_chains);
+	sprintf(table[18].value, "%d", config->n_threads);
+	sprintf(table[19].value, "%d", config->rand_seed);
 
-	return 15;
+	return 20;
 }
 
 /*
@@ -789,7 +881,539 @@ int flp_wrap_rim(flp_t *flp, double rim_thickness)
 }
 
 /*
- * floorplanning using simulated annealing.
+ * sparse connectivity of the functional blocks for an
+ * incremental wire length metric during annealing. a move
+ * relocates only a few blocks. so, only the terms of the
+ * blocks whose centres moved are recomputed. the L2 blocks
+ * (if wrapped) are placed anew around the core after every
+ * move and hence, their terms are always recomputed
+ */
+typedef struct flp_wires_t_st
+{
+	/*
+	 * adjacency of the core blocks in CSR form. both
+	 * directions are stored with the sum of the densities
+	 */
+	int n;
+	int *row_ptr, *col_idx;
+	double *density;
+	/* core blocks connected to L2 and the densities	*/
+	int n_l2;
+	int *l2_idx;
+	double *l2_density;
+	/* block centres and core metric of the current floorplan	*/
+	double *cx, *cy;
+	double core_sum;
+	int valid;
+	/* the same for the floorplan being tried	*/
+	double *tx, *ty;
+	double trial_sum;
+	/* blocks moved by the move being tried	*/
+	int *moved;
+	char *is_moved;
+	int n_moved;
+}flp_wires_t;
+
+/*
+ * connectivity of the first 'n' blocks of flp_desc and,
+ * if 'wrap_l2' is set, of the L2 hidden beyond them
+ */
+static flp_wires_t *alloc_flp_wires(flp_desc_t *flp_desc, int n, int wrap_l2)
+{
+	int i, j, k, nnz = 0;
+	double **wd = flp_desc->wire_density;
+	flp_wires_t *w = (flp_wires_t *) calloc(1, sizeof(flp_wires_t));
+	if (!w)
+		fatal("memory allocation error\n");
+
+	w->n = n;
+	for(i=0; i < n; i++)
+		for(j=0; j < n; j++)
+			if (i != j && (wd[i][j] || wd[j][i]))
+				nnz++;
+	w->row_ptr = ivector(n+1);
+	w->col_idx = ivector(MAX(nnz, 1));
+	w->density = dvector(MAX(nnz, 1));
+	for(i=0, k=0; i < n; i++) {
+		w->row_ptr[i] = k;
+		for(j=0; j < n; j++)
+			if (i != j && (wd[i][j] || wd[j][i])) {
+				w->col_idx[k] = j;
+				w->density[k] = wd[i][j] + wd[j][i];
+				k++;
+			}
+	}
+	w->row_ptr[n] = k;
+
+	w->l2_idx = ivector(MAX(n, 1));
+	w->l2_density = dvector(MAX(n, 1));
+	if (wrap_l2)
+		for(j=0; j < n; j++)
+			if (wd[n][j] || wd[j][n]) {
+				w->l2_idx[w->n_l2] = j;
+				w->l2_density[w->n_l2] = wd[n][j] + wd[j][n];
+				w->n_l2++;
+			}
+
+	w->cx = dvector(n);
+	w->cy = dvector(n);
+	w->tx = dvector(n);
+	w->ty = dvector(n);
+	w->moved = ivector(n);
+	w->is_moved = (char *) calloc(n, sizeof(char));
+	if (!w->is_moved)
+		fatal("memory allocation error\n");
+	return w;
+}
+
+static void free_flp_wires(flp_wires_t *w)
+{
+	free_ivector(w->row_ptr);
+	free_ivector(w->col_idx);
+	free_dvector(w->density);
+	free_ivector(w->l2_idx);
+	free_dvector(w->l2_density);
+	free_dvector(w->cx);
+	free_dvector(w->cy);
+	free_dvector(w->tx);
+	free_dvector(w->ty);
+	free_ivector(w->moved);
+	free(w->is_moved);
+	free(w);
+}
+
+/* wire metric of the core blocks centred at (x, y) from scratch	*/
+static double flp_wires_full(flp_wires_t *w, double *x, double *y)
+{
+	int i, k;
+	double sum = 0.0;
+	for(i=0; i < w->n; i++)
+		for(k=w->row_ptr[i]; k < w->row_ptr[i+1]; k++)
+			if (w->col_idx[k] > i)
+				sum += w->density[k] * (fabs(x[w->col_idx[k]] - x[i]) +
+										fabs(y[w->col_idx[k]] - y[i]));
+	return sum;
+}
+
+/*
+ * wire metric of the blocks centred at (w->tx, w->ty),
+ * updated from that of the current floorplan
+ */
+static double flp_wires_update(flp_wires_t *w)
+{
+	int i, j, k, m;
+	double delta = 0.0;
+
+	w->n_moved = 0;
+	for(i=0; i < w->n; i++) {
+		if (w->tx[i] != w->cx[i] || w->ty[i] != w->cy[i]) {
+			w->moved[w->n_moved++] = i;
+			w->is_moved[i] = TRUE;
+		}
+	}
+
+	if (!w->valid) {
+		w->trial_sum = flp_wires_full(w, w->tx, w->ty);
+	} else {
+		/* edges between two moved blocks are counted once	*/
+		for(m=0; m < w->n_moved; m++) {
+			i = w->moved[m];
+			for(k=w->row_ptr[i]; k < w->row_ptr[i+1]; k++) {
+				j = w->col_idx[k];
+				if (w->is_moved[j] && j < i)
+					continue;
+				delta += w->density[k] *
+						 (fabs(w->tx[j] - w->tx[i]) + fabs(w->ty[j] - w->ty[i]) -
+						  fabs(w->cx[j] - w->cx[i]) - fabs(w->cy[j] - w->cy[i]));
+			}
+		}
+		w->trial_sum = w->core_sum + delta;
+	}
+
+	for(m=0; m < w->n_moved; m++)
+		w->is_moved[w->moved[m]] = FALSE;
+	return w->trial_sum;
+}
+
+/*
+ * wire metric of the core blocks of 'flp' (before L2 and rim
+ * are added), updated from that of the current floorplan
+ */
+static double flp_wires_try(flp_wires_t *w, flp_t *flp)
+{
+	int i;
+	for(i=0; i < w->n; i++) {
+		w->tx[i] = flp->units[i].leftx + flp->units[i].width / 2.0;
+		w->ty[i] = flp->units[i].bottomy + flp->units[i].height / 2.0;
+	}
+	return flp_wires_update(w);
+}
+
+/*
+ * wire metric of the L2 blocks - the last L2_ARMS+1 blocks
+ * of 'flp' just after flp_wrap_l2
+ */
+static double flp_wires_l2(flp_wires_t *w, flp_t *flp)
+{
+	int b, k;
+	double sum = 0.0;
+	for(b=flp->n_units-L2_ARMS-1; b < flp->n_units; b++)
+		for(k=0; k < w->n_l2; k++)
+			sum += w->l2_density[k] * get_manhattan_dist(flp, b, w->l2_idx[k]);
+	return sum;
+}
+
+/* the floorplan tried last becomes the current one	*/
+static void flp_wires_commit(flp_wires_t *w)
+{
+	double *swap;
+	swap = w->cx; w->cx = w->tx; w->tx = swap;
+	swap = w->cy; w->cy = w->ty; w->ty = swap;
+	w->core_sum = w->trial_sum;
+	w->valid = TRUE;
+}
+
+/* recompute the current metric to discard rounding drift	*/
+static void flp_wires_resync(flp_wires_t *w)
+{
+	if (w->valid)
+		w->core_sum = flp_wires_full(w, w->cx, w->cy);
+}
+
+/* one replica (annealing chain) of the floorplanner	*/
+typedef struct flp_chain_t_st
+{
+	/* private floorplan, thermal model and scratch pads	*/
+	flp_t *flp;
+	RC_model_t *model;
+	surrogate_t *surrogate;
+	rand_state_t rng;
+	/* to maintain the order of power values during
+	 * the compaction/shifting around of blocks
+	 */
+	double *tpower;
+	/*
+	 * steady state temperatures of the current floorplan
+	 * and of the one being tried. the former warm-starts the
+	 * thermal solver for the latter. 'temp_n' is the no. of
+	 * blocks in the floorplan 'temp' refers to
+	 */
+	double *temp, *ttemp;
+	int temp_n;
+	/* current and best NPEs and their costs	*/
+	NPE_t *expr, *best;
+	/* 
+	 * slicing tree of 'expr', or of the move being tried
+	 * until it is committed or rolled back
+	 */
+	slicing_tree_t *tree;
+	/* connectivity and wire metric of 'expr'	*/
+	flp_wires_t *wires;
+	double cost, best_cost;
+	/* annealing temperature and statistics of the last step	*/
+	double T, sum_cost;
+	int tries, rejects;
+}flp_chain_t;
+
+/* state shared by all the chains	*/
+typedef struct flp_anneal_t_st
+{
+	flp_desc_t *flp_desc;
+	double *power;
+	int wrap_l2;
+	flp_chain_t *chains;
+	int n_chains;
+
+	/* thread pool. the calling thread is worker 0	*/
+	pthread_t *threads;
+	int n_threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	int generation, pending, quit;
+}flp_anneal_t;
+
+/* argument of a worker thread	*/
+typedef struct flp_worker_t_st
+{
+	flp_anneal_t *anneal;
+	int id;
+}flp_worker_t;
+
+/*
+ * convert 'expr' to the floorplan of chain 'c' (with L2 and rim
+ * blocks) and update its power vector. returns the no. of dead
+ * blocks compacted, the no. of rim blocks in 'rim_blocks' and,
+ * if 'wire_length' is non-NULL, the wire metric in it
+ */
+static int chain_build_flp(flp_anneal_t *a, flp_chain_t *c, NPE_t *expr,
+						   int *rim_blocks, double *wire_length)
+{
+	flp_config_t *cfg = &a->flp_desc->config;
+	tree_node_t *root;
+	int compacted;
+
+	*rim_blocks = 0;
+	/* only the subtrees changed since the last commit are rebuilt	*/
+	root = slicing_tree_update(c->tree, a->flp_desc, expr);
+	/* compacts too small dead blocks	*/
+	compacted = tree_to_flp(root, c->flp, TRUE, cfg->compact_ratio);
+	/* update the tpower vector according to the compaction	*/
+	trim_hotspot_vector(c->model, c->tpower, a->power, c->flp->n_units, compacted);
+	/* dead space and rim blocks are not connected	*/
+	if (wire_length)
+		*wire_length = flp_wires_try(c->wires, c->flp);
+	if(a->wrap_l2) {
+		flp_wrap_l2(c->flp, a->flp_desc);
+		if (wire_length)
+			*wire_length += flp_wires_l2(c->wires, c->flp);
+	}
+	if(cfg->model_rim)
+		*rim_blocks = flp_wrap_rim(c->flp, cfg->rim_thickness);
+
+	resize_thermal_model(c->model, c->flp->n_units);
+	#if VERBOSE > 2
+	print_flp(c->flp, TRUE);
+	#endif
+	return compacted;
+}
+
+/*
+ * cost of the floorplan of 'expr' in chain 'c'. its
+ * temperatures are returned in 'c->ttemp' and their no.
+ * of blocks in 'ttemp_n'. if 'warm' is set, the solver
+ * is warm-started from 'c->temp'
+ */
+static double chain_evaluate(flp_anneal_t *a, flp_chain_t *c, NPE_t *expr,
+							 int warm, int *ttemp_n)
+{
+	flp_config_t *cfg = &a->flp_desc->config;
+	int compacted, rim_blocks;
+	double cost, wire_length;
+
+	compacted = chain_build_flp(a, c, expr, &rim_blocks, &wire_length);
+	*ttemp_n = c->flp->n_units;
+	if (warm)
+		warm_start_guess(c->model, c->ttemp, *ttemp_n, c->temp,
+						 c->temp_n, a->flp_desc->n_units);
+	cost = flp_evaluate_metric(c->flp, c->model, c->surrogate, c->tpower,
+							   c->ttemp, warm, wire_length, cfg->lambdaA,
+							   cfg->lambdaT, cfg->lambdaW);
+	/* restore the compacted blocks	*/
+	restore_dead_blocks(c->flp, a->flp_desc, compacted, a->wrap_l2,
+						cfg->model_rim, rim_blocks);
+	return cost;
+}
+
+/* accept the floorplan just evaluated into 'c->ttemp'	*/
+static void chain_accept(flp_chain_t *c, int ttemp_n)
+{
+	double *swap = c->temp;
+	c->temp = c->ttemp;
+	c->ttemp = swap;
+	c->temp_n = ttemp_n;
+	flp_wires_commit(c->wires);
+}
+
+/* one annealing step of chain 'c' at temperature 'c->T'	*/
+static void chain_step(flp_anneal_t *a, flp_chain_t *c)
+{
+	flp_config_t *cfg = &a->flp_desc->config;
+	NPE_move_t move;
+	double new_cost;
+	int n, downs = 0, ttemp_n;
+
+	/* shortcut	*/
+	n = cfg->Kmoves * c->flp->n_units;
+	c->tries = c->rejects = 0;
+	c->sum_cost = 0;
+	flp_wires_resync(c->wires);
+	/* try enough total or downhill moves per T */
+	while ((c->tries < 2 * n) && (downs < n)) {
+		/* the move is made in place and undone if rejected	*/
+		NPE_random_move(c->expr, &c->rng, &move);
+		new_cost = chain_evaluate(a, c, c->expr, TRUE, &ttemp_n);
+
+		#if VERBOSE > 1
+		fprintf(stdout, "count: %d\tdowns: %d\tcost: %g\t",
+				c->tries, downs, new_cost);
+		#endif
+
+		/* move accepted?	*/
+		if (new_cost < c->cost || 	/* downhill always accepted	*/
+			/* boltzmann probability function	*/
+		    rand_fraction_r(&c->rng) < exp(-(new_cost-c->cost)/c->T)) {
+
+			slicing_tree_commit(c->tree);
+			/* warm-start from here on	*/
+			chain_accept(c, ttemp_n);
+
+			/* downhill move	*/
+			if (new_cost < c->cost) {
+				downs++;
+				/* found new best	*/
+				if (new_cost < c->best_cost) {
+					NPE_copy(c->best, c->expr);
+					c->best_cost = new_cost;
+				}
+			}
+
+			#if VERBOSE > 1
+			fprintf(stdout, "accepted\n");
+			#endif
+			c->cost = new_cost;
+			c->sum_cost += c->cost;
+		} else {	/* rejected move	*/
+			c->rejects++;
+			NPE_undo_move(c->expr, &move);
+			slicing_tree_rollback(c->tree);
+			#if VERBOSE > 1
+			fprintf(stdout, "rejected\n");
+			#endif
+		}
+		c->tries++;
+	}
+}
+
+/* chains k, k + n_threads, k + 2 * n_threads... run on worker k	*/
+static void anneal_share(flp_anneal_t *a, int id)
+{
+	int k;
+	for(k=id; k < a->n_chains; k += a->n_threads)
+		chain_step(a, &a->chains[k]);
+}
+
+static void *anneal_worker(void *arg)
+{
+	flp_worker_t *w = (flp_worker_t *) arg;
+	flp_anneal_t *a = w->anneal;
+	int generation = 0;
+
+	while (TRUE) {
+		/* wait for the next step	*/
+		pthread_mutex_lock(&a->lock);
+		while (a->generation == generation && !a->quit)
+			pthread_cond_wait(&a->start, &a->lock);
+		if (a->quit) {
+			pthread_mutex_unlock(&a->lock);
+			break;
+		}
+		generation = a->generation;
+		pthread_mutex_unlock(&a->lock);
+
+		anneal_share(a, w->id);
+
+		pthread_mutex_lock(&a->lock);
+		if (--a->pending == 0)
+			pthread_cond_signal(&a->done);
+		pthread_mutex_unlock(&a->lock);
+	}
+	return NULL;
+}
+
+/* one annealing step of all the chains	*/
+static void anneal_step(flp_anneal_t *a)
+{
+	if (a->n_threads > 1) {
+		pthread_mutex_lock(&a->lock);
+		a->generation++;
+		a->pending = a->n_threads - 1;
+		pthread_cond_broadcast(&a->start);
+		pthread_mutex_unlock(&a->lock);
+	}
+
+	anneal_share(a, 0);
+
+	if (a->n_threads > 1) {
+		pthread_mutex_lock(&a->lock);
+		while (a->pending)
+			pthread_cond_wait(&a->done, &a->lock);
+		pthread_mutex_unlock(&a->lock);
+	}
+}
+
+/* start/stop the worker threads	*/
+static flp_worker_t *start_anneal_workers(flp_anneal_t *a)
+{
+	int i;
+	flp_worker_t *workers;
+
+	a->generation = a->pending = a->quit = 0;
+	if (a->n_threads <= 1)
+		return NULL;
+
+	workers = (flp_worker_t *) calloc(a->n_threads, sizeof(flp_worker_t));
+	a->threads = (pthread_t *) calloc(a->n_threads, sizeof(pthread_t));
+	if (!workers || !a->threads)
+		fatal("memory allocation error\n");
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->start, NULL);
+	pthread_cond_init(&a->done, NULL);
+	for(i=1; i < a->n_threads; i++) {
+		workers[i].anneal = a;
+		workers[i].id = i;
+		if (pthread_create(&a->threads[i], NULL, anneal_worker, &workers[i]))
+			fatal("unable to create annealing thread\n");
+	}
+	return workers;
+}
+
+static void stop_anneal_workers(flp_anneal_t *a, flp_worker_t *workers)
+{
+	int i;
+
+	if (!workers)
+		return;
+	pthread_mutex_lock(&a->lock);
+	a->quit = TRUE;
+	pthread_cond_broadcast(&a->start);
+	pthread_mutex_unlock(&a->lock);
+	for(i=1; i < a->n_threads; i++)
+		pthread_join(a->threads[i], NULL);
+	pthread_mutex_destroy(&a->lock);
+	pthread_cond_destroy(&a->start);
+	pthread_cond_destroy(&a->done);
+	free(a->threads);
+	free(workers);
+}
+
+/*
+ * replica exchange between chains at neighbouring temperatures:
+ * pairs (0,1), (2,3)... after even steps and (1,2), (3,4)...
+ * after odd ones. the configurations are swapped with the
+ * metropolis probability min(1, exp((1/Ti - 1/Tj) * (Ci - Cj))).
+ * returns the no. of exchanges
+ */
+static int exchange_replicas(flp_anneal_t *a, int step, rand_state_t *rng)
+{
+	int k, n, exchanges = 0;
+	flp_chain_t *ci, *cj;
+	NPE_t *expr;
+	slicing_tree_t *tree;
+	flp_wires_t *wires;
+	double delta, cost, *temp;
+
+	for(k = step & 1; k+1 < a->n_chains; k += 2) {
+		ci = &a->chains[k];
+		cj = &a->chains[k+1];
+		delta = (1.0 / ci->T - 1.0 / cj->T) * (ci->cost - cj->cost);
+		if (delta >= 0 || rand_fraction_r(rng) < exp(delta)) {
+			expr = ci->expr; ci->expr = cj->expr; cj->expr = expr;
+			tree = ci->tree; ci->tree = cj->tree; cj->tree = tree;
+			wires = ci->wires; ci->wires = cj->wires; cj->wires = wires;
+			cost = ci->cost; ci->cost = cj->cost; cj->cost = cost;
+			temp = ci->temp; ci->temp = cj->temp; cj->temp = temp;
+			n = ci->temp_n; ci->temp_n = cj->temp_n; cj->temp_n = n;
+			exchanges++;
+		}
+	}
+	return exchanges;
+}
+
+/*
+ * floorplanning using simulated annealing. with n_chains > 1,
+ * parallel tempering is used: the chains anneal at geometrically
+ * spaced temperatures (chain 0 being the hottest) on n_threads
+ * threads, exchanging their configurations after every step.
  * precondition: flp is a pre-allocated placeholder.
  * returns the number of compacted blocks in the selected
  * floorplan
@@ -797,22 +1421,51 @@ int flp_wrap_rim(flp_t *flp, double rim_thickness)
 int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 			  RC_model_t *model, double *power)
 {
-	NPE_t *expr, *next, *best;	/* Normalized Polish Expressions */
-	tree_node_stack_t *stack;	/* for NPE evaluation	*/
 	tree_node_t *root;			/* shape curve tree	*/
-	double cost, new_cost, best_cost, sum_cost, T, Tcold;
-	int i, steps, downs, n, rejects, compacted, rim_blocks = 0;
+	tree_node_stack_t *stack;	/* for NPE evaluation	*/
+	double T, Tcold, ladder;
+	int i, k, steps, n, compacted, rim_blocks = 0, exchanges = 0;
 	int original_n = flp->n_units;
-	int wrap_l2;
-
-	/* to maintain the order of power values during
-	 * the compaction/shifting around of blocks
-	 */
-	double *tpower = hotspot_vector(model);
+	flp_anneal_t anneal, *a = &anneal;
+	flp_chain_t *c, *winner;
+	flp_worker_t *workers;
+	/* for the replica exchanges	*/
+	rand_state_t rng;
+	/* thermal surrogate for the annealing moves	*/
+	surrogate_t *surrogate = NULL;
 
 	/* shortcut	*/
 	flp_config_t cfg = flp_desc->config;
 
+	a->flp_desc = flp_desc;
+	a->power = power;
+	a->n_chains = cfg.n_chains;
+	a->n_threads = MIN(cfg.n_threads, cfg.n_chains);
+	a->chains = (flp_chain_t *) calloc(a->n_chains, sizeof(flp_chain_t));
+	if (!a->chains)
+		fatal("memory allocation error\n");
+
+	/*
+	 * chain 0 works on the caller's floorplan and model. the
+	 * others get their own copies (before any blocks are hidden)
+	 */
+	for(k=0; k < a->n_chains; k++) {
+		c = &a->chains[k];
+		if (k) {
+			c->flp = flp_placeholder(flp_desc);
+			c->model = alloc_RC_model(model->config, c->flp, NULL, NULL, 0, 0);
+		} else {
+			c->flp = flp;
+			c->model = model;
+		}
+		c->tpower = hotspot_vector(model);
+		c->temp = hotspot_vector(model);
+		c->ttemp = hotspot_vector(model);
+		/* distinct streams for the chains and the exchanges	*/
+		init_rand_r(&c->rng, (unsigned long long) cfg.rand_seed + k + 1);
+	}
+	init_rand_r(&rng, cfg.rand_seed);
+
 	/*
 	 * make the rim strips disappear for slicing tree
 	 * purposes. can be restored at the end
@@ -821,42 +1474,54 @@ int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 		flp->n_units = (flp->n_units - 2) / 3;
 
 	/* wrap L2 around?	*/
-	wrap_l2 = FALSE;
+	a->wrap_l2 = FALSE;
 	if (cfg.wrap_l2 &&
 		!strcasecmp(flp_desc->units[flp_desc->n_units-1].name, cfg.l2_label)) {
-		wrap_l2 = TRUE;
+		a->wrap_l2 = TRUE;
 		/* make L2 disappear too */
 		flp_desc->n_units--;
 		flp->n_units -= (L2_ARMS+1);
 	}
+	for(k=1; k < a->n_chains; k++)
+		a->chains[k].flp->n_units = flp->n_units;
 
 	/* initialization	*/
-	expr = NPE_get_initial(flp_desc);
-	stack = new_tree_node_stack();
-	init_rand();
+	c = &a->chains[0];
+	c->expr = NPE_get_initial(flp_desc);
+	c->tree = new_slicing_tree(flp_desc, c->expr);
 
-	/* convert NPE to flp	*/
-	root = tree_from_NPE(flp_desc, stack, expr);
-	/* compacts too small dead blocks	*/
-	compacted = tree_to_flp(root, flp, TRUE, cfg.compact_ratio);
-	/* update the tpower vector according to the compaction	*/
-	trim_hotspot_vector(model, tpower, power, flp->n_units, compacted);
-	free_tree(root);
-	if(wrap_l2)
-		flp_wrap_l2(flp, flp_desc);
-	if(cfg.model_rim)
-		rim_blocks = flp_wrap_rim(flp, cfg.rim_thickness);
-
-	resize_thermal_model(model, flp->n_units);
-	#if VERBOSE > 2
-	print_flp(flp, TRUE);
-	#endif
-	cost = flp_evaluate_metric(flp, model, tpower, cfg.lambdaA, cfg.lambdaT, cfg.lambdaW);
-	/* restore the compacted blocks	*/
-	restore_dead_blocks(flp, flp_desc, compacted, wrap_l2, cfg.model_rim, rim_blocks);
+	/*
+	 * the surrogate covers floorplans of up to SURROGATE_SLACK
+	 * times the side of a square with the total block area
+	 * of the initial floorplan. larger ones (early in the
+	 * annealing) are solved exactly
+	 */
+	if (cfg.thermal_surrogate) {
+		double occupied = 0;
+		compacted = chain_build_flp(a, c, c->expr, &rim_blocks, NULL);
+		for(i=0; i < flp->n_units; i++)
+			occupied += flp->units[i].width * flp->units[i].height;
+		restore_dead_blocks(flp, flp_desc, compacted, a->wrap_l2,
+							cfg.model_rim, rim_blocks);
+		surrogate = alloc_surrogate(model->config, SURROGATE_SLACK * sqrt(occupied),
+									cfg.surrogate_grid);
+	}
 
-	best = NPE_duplicate(expr);	/* best till now	*/
-	best_cost = cost;
+	/* all the chains start from the same floorplan	*/
+	for(k=0; k < a->n_chains; k++) {
+		c = &a->chains[k];
+		if (k) {
+			c->expr = NPE_duplicate(a->chains[0].expr);
+			c->tree = new_slicing_tree(flp_desc, c->expr);
+		}
+		if (surrogate)
+			c->surrogate = k ? dup_surrogate(surrogate) : surrogate;
+		c->wires = alloc_flp_wires(flp_desc, flp_desc->n_units, a->wrap_l2);
+		c->cost = chain_evaluate(a, c, c->expr, FALSE, &n);
+		chain_accept(c, n);
+		c->best = NPE_duplicate(c->expr);	/* best till now	*/
+		c->best_cost = c->cost;
+	}
 
 	/* simulated annealing	*/
 	steps = 0;
@@ -871,96 +1536,69 @@ int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 	 * (1-cfg.Rreject)/2.
 	 */
 	Tcold = -cfg.Davg / log ((1.0 - cfg.Rreject) / 2.0);
+	/*
+	 * the temperatures of the chains divide the range
+	 * [Tcold, T] into equal ratios. all of them are cooled
+	 * by the same schedule
+	 */
+	ladder = pow(Tcold / T, 1.0 / a->n_chains);
+	for(k=0; k < a->n_chains; k++)
+		a->chains[k].T = T * pow(ladder, k);
 	#if VERBOSE > 0
-	fprintf(stdout, "initial cost: %g\tinitial T: %g\tfinal T: %g\n", cost, T, Tcold);
+	fprintf(stdout, "initial cost: %g\tinitial T: %g\tfinal T: %g\n",
+			a->chains[0].cost, T, Tcold);
+	if (a->n_chains > 1)
+		fprintf(stdout, "parallel tempering with %d chains on %d threads\n",
+				a->n_chains, a->n_threads);
 	#endif
+
+	workers = start_anneal_workers(a);
 	/*
-	 * stop annealing if temperature has cooled down enough or
-	 * max no. of iterations have been tried
+	 * stop annealing if the hottest chain has cooled down
+	 * enough or max no. of iterations have been tried
 	 */
-	while (T >= Tcold && steps < cfg.Nmax) {
-		/* shortcut	*/
-		n = cfg.Kmoves * flp->n_units;
-		i = downs = rejects = 0;
-		sum_cost = 0;
-		/* try enough total or downhill moves per T */
-		while ((i < 2 * n) && (downs < n)) {
-			next = make_random_move(expr);
-
-			/* convert NPE to flp	*/
-			root = tree_from_NPE(flp_desc, stack, next);
-			compacted = tree_to_flp(root, flp, TRUE, cfg.compact_ratio);
-			/* update the tpower vector according to the compaction	*/
-			trim_hotspot_vector(model, tpower, power, flp->n_units, compacted);
-			free_tree(root);
-			if(wrap_l2)
-				flp_wrap_l2(flp, flp_desc);
-			if(cfg.model_rim)
-				rim_blocks = flp_wrap_rim(flp, cfg.rim_thickness);
-
-			resize_thermal_model(model, flp->n_units);
-			#if VERBOSE > 2
-			print_flp(flp, TRUE);
-			#endif
-			new_cost = flp_evaluate_metric(flp, model, tpower, cfg.lambdaA, cfg.lambdaT, cfg.lambdaW);
-			restore_dead_blocks(flp, flp_desc, compacted, wrap_l2, cfg.model_rim, rim_blocks);
-
-			#if VERBOSE > 1
-			fprintf(stdout, "count: %d\tdowns: %d\tcost: %g\t",
-					i, downs, new_cost);
-			#endif
+	c = &a->chains[0];
+	while (c->T >= Tcold && steps < cfg.Nmax) {
+		anneal_step(a);
+		if (a->n_chains > 1)
+			exchanges += exchange_replicas(a, steps, &rng);
 
-			/* move accepted?	*/
-			if (new_cost < cost || 	/* downhill always accepted	*/
-				/* boltzmann probability function	*/
-			    rand_fraction() < exp(-(new_cost-cost)/T)) {
-
-				free_NPE(expr);
-				expr = next;
-
-				/* downhill move	*/
-				if (new_cost < cost) {
-					downs++;
-					/* found new best	*/
-					if (new_cost < best_cost) {
-						free_NPE(best);
-						best = NPE_duplicate(expr);
-						best_cost = new_cost;
-					}
-				}
-
-				#if VERBOSE > 1
-				fprintf(stdout, "accepted\n");
-				#endif
-				cost = new_cost;
-				sum_cost += cost;
-			} else {	/* rejected move	*/
-				rejects++;
-				free_NPE(next);
-				#if VERBOSE > 1
-				fprintf(stdout, "rejected\n");
-				#endif
-			}
-			i++;
-		}
 		#if VERBOSE > 0
-		fprintf(stdout, "step: %d\tT: %g\ttries: %d\taccepts: %d\trejects: %d\t",
-				steps, T, i, (i-rejects), rejects);
-		fprintf(stdout, "avg. cost: %g\tbest cost: %g\n",
-		 		(i-rejects)?(sum_cost / (i-rejects)):sum_cost, best_cost);
+		{
+			double best_cost = c->best_cost;
+			for(k=1; k < a->n_chains; k++)
+				best_cost = MIN(best_cost, a->chains[k].best_cost);
+			fprintf(stdout, "step: %d\tT: %g\ttries: %d\taccepts: %d\trejects: %d\t",
+					steps, c->T, c->tries, (c->tries-c->rejects), c->rejects);
+			fprintf(stdout, "avg. cost: %g\tbest cost: %g\n",
+					(c->tries-c->rejects)?(c->sum_cost / (c->tries-c->rejects)):c->sum_cost,
+					best_cost);
+		}
 		#endif
 
 		/* stop annealing if there are too little accepts */
-		if(((double)rejects/i) > cfg.Rreject)
+		if(((double)c->rejects/c->tries) > cfg.Rreject)
 			break;
 
 		/* annealing schedule	*/
-		T *= cfg.Rcool;
+		for(k=0; k < a->n_chains; k++)
+			a->chains[k].T *= cfg.Rcool;
 		steps++;
 	}
+	stop_anneal_workers(a, workers);
 
-	/* best floorplan found	*/
-	root = tree_from_NPE(flp_desc, stack, best);
+	/* best floorplan found - ties go to the hotter chain	*/
+	winner = &a->chains[0];
+	for(k=1; k < a->n_chains; k++)
+		if (a->chains[k].best_cost < winner->best_cost)
+			winner = &a->chains[k];
+	#if VERBOSE > 0
+	if (a->n_chains > 1)
+		fprintf(stdout, "replica exchanges: %d\tbest chain: %d\n",
+				exchanges, (int) (winner - a->chains));
+	#endif
+	stack = new_tree_node_stack();
+	root = tree_from_NPE(flp_desc, stack, winner->best);
 	#if VERBOSE > 0
 	{
 		int pos = min_area_pos(root->curve);
@@ -971,8 +1609,9 @@ int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 	/* update the power vector according to the compaction	*/
 	trim_hotspot_vector(model, power, power, flp->n_units, compacted);
 	free_tree(root);
+	free_tree_node_stack(stack);
 	/*  restore L2 and rim */
-	if(wrap_l2) {
+	if(a->wrap_l2) {
 		flp_wrap_l2(flp, flp_desc);
 		flp_desc->n_units++;
 	}
@@ -983,10 +1622,39 @@ int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 	print_flp(flp, TRUE);
 	#endif
 
-	free_NPE(expr);
-	free_NPE(best);
-	free_tree_node_stack(stack);
-	free_dvector(tpower);
+	/* validate the surrogate's choice with an exact solve	*/
+	if (surrogate) {
+		double est = surrogate_max_temp(surrogate, flp, power), exact;
+		c = &a->chains[0];
+		populate_R_model(model, flp);
+		steady_state_temp(model, power, c->temp);
+		exact = find_max_temp(model, c->temp);
+		#if VERBOSE > 0
+		fprintf(stdout, "surrogate peak temperature: %g\texact: %g\n", est, exact);
+		#endif
+		if (est < 0)
+			warning("best floorplan too large for the thermal surrogate\n");
+	}
+
+	for(k=a->n_chains-1; k >= 0; k--) {
+		c = &a->chains[k];
+		if (k) {
+			if (c->surrogate)
+				delete_surrogate(c->surrogate);
+			delete_RC_model(c->model);
+			free_flp(c->flp, original_n - c->flp->n_units, TRUE);
+		}
+		free_NPE(c->expr);
+		free_NPE(c->best);
+		free_slicing_tree(c->tree);
+		free_flp_wires(c->wires);
+		free_dvector(c->tpower);
+		free_dvector(c->temp);
+		free_dvector(c->ttemp);
+	}
+	if (surrogate)
+		delete_surrogate(surrogate);
+	free(a->chains);
 
 	/*
 	 * return the number of blocks compacted finally
@@ -996,6 +1664,346 @@ int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 	return (original_n - flp->n_units);
 }
 
+/* one power dissipating layer of a 3-d stack being floorplanned	*/
+typedef struct flp_tier_t_st
+{
+	/* index of the layer in the grid model	*/
+	int layer;
+	/* description of its units and their indices in flp_desc	*/
+	flp_desc_t *desc;
+	int *map;
+	flp_t *flp;
+	/* current and best NPEs	*/
+	NPE_t *expr, *best;
+	/* 
+	 * slicing tree of 'expr', or of the move being tried
+	 * until it is committed or rolled back
+	 */
+	slicing_tree_t *tree;
+	/* no. of dead blocks compacted in 'flp'	*/
+	int compacted;
+}flp_tier_t;
+
+/* a 3-d stack being floorplanned	*/
+typedef struct flp_stack_t_st
+{
+	flp_desc_t *flp_desc;
+	RC_model_t *model;
+	flp_tier_t *tiers;
+	int n_tiers;
+	/* tier on each layer of the model (-1 if none)	*/
+	int *tier_of;
+	/* tiers with more than one unit	*/
+	int *movable;
+	int n_movable;
+	/* power numbers of the units of flp_desc	*/
+	double *power;
+	/* block power and temperature vectors of the model	*/
+	double *bpower, *temp;
+	/* connectivity and wire metric of all the units	*/
+	flp_wires_t *wires;
+	rand_state_t rng;
+	/* current and best costs	*/
+	double cost, best_cost;
+	/* annealing temperature and statistics of the last step	*/
+	double T, sum_cost;
+	int tries, rejects;
+}flp_stack_t;
+
+/*
+ * floorplan of tier 't' from the slicing tree 'root'. only
+ * its layer's block-grid map is rebuilt in the next solve
+ */
+static void stack_build_tier(flp_stack_t *s, flp_tier_t *t, tree_node_t *root)
+{
+	flp_config_t *cfg = &s->flp_desc->config;
+	/* restore the blocks compacted last time	*/
+	restore_dead_blocks(t->flp, t->desc, t->compacted, FALSE, FALSE, 0);
+	t->compacted = tree_to_flp(root, t->flp, TRUE, cfg->compact_ratio);
+	set_layer_flp_grid(s->model->grid, t->layer, t->flp);
+	#if VERBOSE > 2
+	print_flp(t->flp, TRUE);
+	#endif
+}
+
+/*
+ * cost of the current floorplans of the tiers. area is that
+ * of the outline of the stack and the wires between tiers are
+ * measured in the plane. if 'warm' is set and the outline is
+ * the same as in the previous solve, the solver is warm-started
+ * from its solution. otherwise, the grid cells differ and the
+ * multigrid solver does better from scratch
+ */
+static double stack_evaluate(flp_stack_t *s, int warm)
+{
+	flp_config_t *cfg = &s->flp_desc->config;
+	grid_model_t *grid = s->model->grid;
+	flp_tier_t *t;
+	int l, u, base;
+	double width = 0.0, height = 0.0, tmax = 0.0, wire_length;
+
+	for(l=0; l < s->n_tiers; l++) {
+		width = MAX(width, get_total_width(s->tiers[l].flp));
+		height = MAX(height, get_total_height(s->tiers[l].flp));
+	}
+	/* the other layers are remapped only if the outline changes	*/
+	warm = warm && width == grid->width && height == grid->height;
+	set_outline_grid(grid, width, height);
+	populate_R_model(s->model, NULL);
+
+	/* the functional blocks come first in each tier	*/
+	zero_dvector(s->bpower, grid->total_n_blocks);
+	for(l=0, base=0; l < grid->n_layers; l++) {
+		if (s->tier_of[l] >= 0) {
+			t = &s->tiers[s->tier_of[l]];
+			for(u=0; u < t->desc->n_units; u++)
+				s->bpower[base+u] = s->power[t->map[u]];
+		}
+		base += grid->layers[l].flp->n_units;
+	}
+	if (warm)
+		steady_state_temp_warm(s->model, s->bpower, s->temp);
+	else
+		steady_state_temp(s->model, s->bpower, s->temp);
+	for(l=0, base=0; l < grid->n_layers; l++) {
+		if (s->tier_of[l] >= 0) {
+			t = &s->tiers[s->tier_of[l]];
+			for(u=0; u < t->desc->n_units; u++)
+				tmax = MAX(tmax, s->temp[base+u]);
+		}
+		base += grid->layers[l].flp->n_units;
+	}
+
+	for(l=0; l < s->n_tiers; l++) {
+		t = &s->tiers[l];
+		for(u=0; u < t->desc->n_units; u++) {
+			s->wires->tx[t->map[u]] = t->flp->units[u].leftx +
+									  t->flp->units[u].width / 2.0;
+			s->wires->ty[t->map[u]] = t->flp->units[u].bottomy +
+									  t->flp->units[u].height / 2.0;
+		}
+	}
+	wire_length = flp_wires_update(s->wires);
+
+	return (cfg->lambdaA * width * height + cfg->lambdaT * tmax +
+			cfg->lambdaW * wire_length);
+}
+
+/* one annealing step of the stack at temperature 's->T'	*/
+static void stack_step(flp_stack_t *s)
+{
+	flp_config_t *cfg = &s->flp_desc->config;
+	NPE_move_t move;
+	flp_tier_t *t;
+	double new_cost;
+	int l, n = 0, downs = 0;
+
+	/* shortcut	*/
+	for(l=0; l < s->n_tiers; l++)
+		n += s->tiers[l].flp->n_units + s->tiers[l].compacted;
+	n *= cfg->Kmoves;
+	s->tries = s->rejects = 0;
+	s->sum_cost = 0;
+	flp_wires_resync(s->wires);
+	/* try enough total or downhill moves per T */
+	while ((s->tries < 2 * n) && (downs < n)) {
+		/* each move changes the floorplan of one tier	*/
+		t = &s->tiers[s->movable[rand_upto_r(&s->rng, s->n_movable)]];
+		NPE_random_move(t->expr, &s->rng, &move);
+		stack_build_tier(s, t, slicing_tree_update(t->tree, t->desc, t->expr));
+		new_cost = stack_evaluate(s, TRUE);
+
+		#if VERBOSE > 1
+		fprintf(stdout, "count: %d\tdowns: %d\tlayer: %d\tcost: %g\t",
+				s->tries, downs, (int) (t - s->tiers), new_cost);
+		#endif
+
+		/* move accepted?	*/
+		if (new_cost < s->cost || 	/* downhill always accepted	*/
+			/* boltzmann probability function	*/
+		    rand_fraction_r(&s->rng) < exp(-(new_cost-s->cost)/s->T)) {
+
+			slicing_tree_commit(t->tree);
+			flp_wires_commit(s->wires);
+
+			/* downhill move	*/
+			if (new_cost < s->cost) {
+				downs++;
+				/* found new best	*/
+				if (new_cost < s->best_cost) {
+					for(l=0; l < s->n_tiers; l++)
+						NPE_copy(s->tiers[l].best, s->tiers[l].expr);
+					s->best_cost = new_cost;
+				}
+			}
+
+			#if VERBOSE > 1
+			fprintf(stdout, "accepted\n");
+			#endif
+			s->cost = new_cost;
+			s->sum_cost += s->cost;
+		} else {	/* rejected move	*/
+			s->rejects++;
+			NPE_undo_move(t->expr, &move);
+			slicing_tree_rollback(t->tree);
+			stack_build_tier(s, t, slicing_tree_root(t->tree));
+			#if VERBOSE > 1
+			fprintf(stdout, "rejected\n");
+			#endif
+		}
+		s->tries++;
+	}
+}
+
+/*
+ * the tiers are annealed together with the same schedule as
+ * floorplan(). each move changes one tier. the units do not
+ * move across tiers. every move is evaluated with the grid
+ * model, which keeps the block-grid maps of the unchanged
+ * layers and starts from its previous solution
+ */
+flp_t **floorplan_3d(flp_desc_t *flp_desc, RC_model_t *model,
+					 double *power, int *compacted)
+{
+	flp_stack_t stack, *s = &stack;
+	flp_tier_t *t;
+	grid_model_t *grid;
+	tree_node_stack_t *nodes;
+	tree_node_t *root;
+	flp_t **flps;
+	double Tcold;
+	int i, l, steps = 0, inner_layers;
+
+	/* shortcut	*/
+	flp_config_t cfg = flp_desc->config;
+
+	if (model->type != GRID_MODEL || !model->grid->has_lcf)
+		fatal("3-d floorplanning needs the grid model with an lcf file\n");
+	grid = model->grid;
+	if (grid->config.model_secondary)
+		fatal("secondary heat path not supported in 3-d floorplanning\n");
+	if (cfg.model_rim)
+		fatal("rim blocks not supported in 3-d floorplanning\n");
+	if (cfg.wrap_l2 &&
+		!strcasecmp(flp_desc->units[flp_desc->n_units-1].name, cfg.l2_label))
+		fatal("L2 wrap around not supported in 3-d floorplanning\n");
+
+	memset(s, 0, sizeof(flp_stack_t));
+	s->flp_desc = flp_desc;
+	s->model = model;
+	s->power = power;
+	s->n_tiers = flp_desc->n_layers;
+	s->tiers = (flp_tier_t *) calloc(s->n_tiers, sizeof(flp_tier_t));
+	if (!s->tiers)
+		fatal("memory allocation error\n");
+	s->tier_of = ivector(grid->n_layers);
+	s->movable = ivector(s->n_tiers);
+
+	/* the l-th power dissipating layer holds the units on layer l	*/
+	inner_layers = grid->n_layers - DEFAULT_PACK_LAYERS;
+	for(i=0, l=0; i < grid->n_layers; i++) {
+		s->tier_of[i] = -1;
+		if (i >= inner_layers)
+			continue;
+		if (grid->layers[i].flp->n_units)
+			fatal("floorplans in the lcf file should be (null) for 3-d floorplanning\n");
+		if (grid->layers[i].has_power) {
+			if (l < s->n_tiers) {
+				s->tier_of[i] = l;
+				s->tiers[l].layer = i;
+			}
+			l++;
+		}
+	}
+	if (l != s->n_tiers)
+		fatal("mismatch of no. of layers in the lcf file and the floorplan description\n");
+
+	for(l=0; l < s->n_tiers; l++) {
+		t = &s->tiers[l];
+		t->map = ivector(flp_desc->n_units);
+		t->desc = flp_desc_layer(flp_desc, l, t->map);
+		t->flp = flp_placeholder(t->desc);
+		t->expr = NPE_get_initial(t->desc);
+		t->best = NPE_duplicate(t->expr);
+		t->tree = new_slicing_tree(t->desc, t->expr);
+		/* uncompacted placeholders size the model's vectors	*/
+		set_layer_flp_grid(grid, t->layer, t->flp);
+		if (t->desc->n_units > 1)
+			s->movable[s->n_movable++] = l;
+	}
+	s->bpower = hotspot_vector(model);
+	s->temp = hotspot_vector(model);
+	s->wires = alloc_flp_wires(flp_desc, flp_desc->n_units, FALSE);
+	init_rand_r(&s->rng, cfg.rand_seed);
+
+	/* initialization	*/
+	for(l=0; l < s->n_tiers; l++)
+		stack_build_tier(s, &s->tiers[l], slicing_tree_root(s->tiers[l].tree));
+	s->cost = stack_evaluate(s, FALSE);
+	flp_wires_commit(s->wires);
+	s->best_cost = s->cost;
+
+	/* same schedule as floorplan()	*/
+	s->T = -cfg.Davg / log(cfg.P0);
+	Tcold = -cfg.Davg / log ((1.0 - cfg.Rreject) / 2.0);
+	#if VERBOSE > 0
+	fprintf(stdout, "initial cost: %g\tinitial T: %g\tfinal T: %g\tlayers: %d\n",
+			s->cost, s->T, Tcold, s->n_tiers);
+	#endif
+
+	while (s->n_movable && s->T >= Tcold && steps < cfg.Nmax) {
+		stack_step(s);
+
+		#if VERBOSE > 0
+		fprintf(stdout, "step: %d\tT: %g\ttries: %d\taccepts: %d\trejects: %d\t",
+				steps, s->T, s->tries, (s->tries-s->rejects), s->rejects);
+		fprintf(stdout, "avg. cost: %g\tbest cost: %g\n",
+				(s->tries-s->rejects)?(s->sum_cost / (s->tries-s->rejects)):s->sum_cost,
+				s->best_cost);
+		#endif
+
+		/* stop annealing if there are too little accepts */
+		if(((double)s->rejects/s->tries) > cfg.Rreject)
+			break;
+
+		/* annealing schedule	*/
+		s->T *= cfg.Rcool;
+		steps++;
+	}
+
+	/* best floorplans found	*/
+	flps = (flp_t **) calloc(s->n_tiers, sizeof(flp_t *));
+	if (!flps)
+		fatal("memory allocation error\n");
+	nodes = new_tree_node_stack();
+	for(l=0; l < s->n_tiers; l++) {
+		t = &s->tiers[l];
+		root = tree_from_NPE(t->desc, nodes, t->best);
+		stack_build_tier(s, t, root);
+		free_tree(root);
+		flps[l] = t->flp;
+		compacted[l] = t->compacted;
+	}
+	free_tree_node_stack(nodes);
+
+	for(l=0; l < s->n_tiers; l++) {
+		t = &s->tiers[l];
+		free_NPE(t->expr);
+		free_NPE(t->best);
+		free_slicing_tree(t->tree);
+		free_flp_desc_layer(t->desc);
+		free_ivector(t->map);
+	}
+	free_flp_wires(s->wires);
+	free_dvector(s->bpower);
+	free_dvector(s->temp);
+	free_ivector(s->tier_of);
+	free_ivector(s->movable);
+	free(s->tiers);
+
+	return flps;
+}
+
 /* functions duplicated from flp_desc.c */
 /*
  * find the number of units from the
@@ -1358,7 +2366,7 @@ void print_flp_stats(flp_t *flp, RC_model_t *model,
 	wire_metric = get_wire_metric(flp);
 
 	populate_R_model(model, flp);
-	//steady_state_temp(model, power, temp);
+	steady_state_temp(model, power, temp);
 	peak = find_max_temp(model, temp);
 	avg = find_avg_temp(model, temp);
 
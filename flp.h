@@ -57,6 +57,7 @@ typedef unsigned char orient_t;
 /* forward declarations	*/
 struct RC_model_t_st;	/* see temperature.h	*/
 struct shape_t_st;		/* see shape.h	*/
+struct surrogate_t_st;	/* see surrogate.h	*/
 
 /* configuration parameters for the floorplan	*/
 typedef struct flp_config_t_st
@@ -91,6 +92,25 @@ typedef struct flp_config_t_st
 	double lambdaA;
 	double lambdaT;
 	double lambdaW;
+
+	/*
+	 * estimate the temperatures during annealing with a
+	 * Green's function surrogate (see surrogate.h) instead
+	 * of solving the thermal model for every move?
+	 */
+	int thermal_surrogate;
+	/* grid resolution of the surrogate's response kernel	*/
+	int surrogate_grid;
+
+	/*
+	 * parallel tempering: no. of annealing chains run at
+	 * geometrically spaced temperatures with replica exchange,
+	 * no. of threads that run them and the random seed. the
+	 * result is deterministic for a given seed and no. of chains
+	 */
+	int n_chains;
+	int n_threads;
+	int rand_seed;
 } flp_config_t;
 
 /* unplaced unit	*/
@@ -105,6 +125,8 @@ typedef struct unplaced_t_st
   double max_aspect;
   /* shape curve for this unit	*/
   struct shape_t_st *shape;
+  /* layer of a 3-d stack it is placed on	*/
+  int layer;
 }unplaced_t;
 
 /* input description for floorplanning	*/
@@ -116,6 +138,8 @@ typedef struct flp_desc_t_st
   /* configuration parameters	*/
   flp_config_t config;
   int n_units;
+  /* no. of layers the units are placed on	*/
+  int n_layers;
 }flp_desc_t;
 
 /* placed functional unit */
@@ -163,6 +187,15 @@ int flp_config_to_strs(flp_config_t *config, str_pair *table, int max_entries);
 /* read floorplan description and allocate memory	*/
 flp_desc_t *read_flp_desc(char *file, flp_config_t *config);
 void free_flp_desc(flp_desc_t *flp_desc);
+/*
+ * description of the units on 'layer' alone. their indices in
+ * flp_desc are returned in 'map'. the shape curves are shared
+ * with flp_desc. so, free it with free_flp_desc_layer
+ */
+flp_desc_t *flp_desc_layer(flp_desc_t *flp_desc, int layer, int *map);
+void free_flp_desc_layer(flp_desc_t *flp_desc);
+/* read the power numbers of the units of flp_desc	*/
+void read_desc_power(flp_desc_t *flp_desc, double *power, char *file);
 /* debug print	*/
 void print_unplaced(unplaced_t *unit);
 void print_flp_desc(flp_desc_t *flp_desc);
@@ -180,6 +213,15 @@ flp_t *read_flp(char *file, int read_connects, int initialize_connects);
  */
 int floorplan(flp_t *flp, flp_desc_t *flp_desc,
 			  struct RC_model_t_st *model, double *power);
+/*
+ * floorplanning of a 3-d stack with the grid model. the units
+ * on layer l of flp_desc are placed on the l-th power dissipating
+ * layer of the model's lcf file. 'power' has one entry per unit
+ * of flp_desc. returns the floorplans of the layers and the no.
+ * of blocks compacted in each of them in 'compacted'
+ */
+flp_t **floorplan_3d(flp_desc_t *flp_desc, struct RC_model_t_st *model,
+					 double *power, int *compacted);
 /*
  * print the floorplan in a FIG like format
  * that can be read by tofig.pl to produce
@@ -230,7 +272,9 @@ void free_blkgrid_map(flp_t *flp, int **map);
 void xlate_power_blkgrid(flp_t *flp, flp_t *grid, \
 						 double *bpower, double *gpower, int **map);
 /* the metric used to evaluate the floorplan	*/
-double flp_evaluate_metric(flp_t *flp, struct RC_model_t_st *model, double *power,
+double flp_evaluate_metric(flp_t *flp, struct RC_model_t_st *model,
+						   struct surrogate_t_st *surrogate, double *power,
+						   double *temp, int warm, double wire_length,
 						   double lambdaA, double lambdaT, double lambdaW);
 /* dump the floorplan onto a file	*/
 void dump_flp(flp_t *flp, char *file, int dump_connects);
@@ -77,6 +77,7 @@ flp_desc_t *desc_alloc_init_mem(int count, flp_config_t *config)
 	if (!flp_desc->units || !flp_desc->wire_density)
 		fatal("memory allocation error\n");
 	flp_desc->n_units = count;
+	flp_desc->n_layers = 1;
 	flp_desc->config = *config;
 
 	for (i=0; i < count; i++) {
@@ -94,7 +95,7 @@ void desc_populate_blks(flp_desc_t *flp_desc, FILE *fp)
 	char str1[LINE_SIZE], str2[LINE_SIZE]; 
 	char name1[STR_SIZE], name2[STR_SIZE];
 	double area, min, max, wire_density;
-	int rotable;
+	int rotable, layer;
 	char *ptr;
 	int wrap_l2 = FALSE;
 
@@ -116,6 +117,12 @@ void desc_populate_blks(flp_desc_t *flp_desc, FILE *fp)
 				fatal("minimum aspect ratio greater than maximum\n");
 			if (min <= 0 || max <= 0 || area <= 0)
 				fatal("invalid number in floorplan description\n");
+			/* optional layer number for 3-d stacks	*/
+			if (sscanf(str2, "%s%lf%lf%lf%d%d", name1, &area, &min, &max,
+					   &rotable, &layer) != 6)
+				layer = 0;
+			if (layer < 0)
+				fatal("invalid layer number in floorplan description\n");
 		  	/* L2 wrap around	*/
 		  	if (flp_desc->config.wrap_l2 && !strcasecmp(name1, flp_desc->config.l2_label)) {
 				wrap_l2 = TRUE;
@@ -130,6 +137,8 @@ void desc_populate_blks(flp_desc_t *flp_desc, FILE *fp)
 				flp_desc->units[i].rotable = rotable;
 				flp_desc->units[i].shape = shape_from_aspect(area, min, max, rotable, 
 															 flp_desc->config.n_orients);
+				flp_desc->units[i].layer = layer;
+				flp_desc->n_layers = MAX(flp_desc->n_layers, layer + 1);
 		    	i++;
 			}
 		} else if (sscanf(str2, "%s%s%lf", name1, name2, &wire_density) != 3)
@@ -233,6 +242,76 @@ void free_flp_desc(flp_desc_t *flp_desc)
 	free(flp_desc);
 }
 
+flp_desc_t *flp_desc_layer(flp_desc_t *flp_desc, int layer, int *map)
+{
+	int i, j, count = 0;
+	flp_desc_t *desc;
+
+	for(i=0; i < flp_desc->n_units; i++)
+		if (flp_desc->units[i].shape && flp_desc->units[i].layer == layer)
+			map[count++] = i;
+	if (!count)
+		fatal("no units specified on a layer of the floorplan description\n");
+
+	desc = desc_alloc_init_mem(count, &flp_desc->config);
+	desc->config.wrap_l2 = FALSE;
+	for(i=0; i < count; i++) {
+		desc->units[i] = flp_desc->units[map[i]];
+		desc->units[i].layer = 0;
+		for(j=0; j < count; j++)
+			desc->wire_density[i][j] = flp_desc->wire_density[map[i]][map[j]];
+	}
+	return desc;
+}
+
+void free_flp_desc_layer(flp_desc_t *flp_desc)
+{
+	int i;
+	/* shape curves belong to the original description	*/
+	for (i=0; i < flp_desc->n_units; i++)
+		flp_desc->units[i].shape = NULL;
+	free_flp_desc(flp_desc);
+}
+
+/* units not listed in the power file dissipate no power	*/
+void read_desc_power(flp_desc_t *flp_desc, double *power, char *file)
+{
+	char str1[LINE_SIZE], str2[LINE_SIZE];
+	char name[STR_SIZE];
+	double val;
+	char *ptr;
+	FILE *fp;
+
+	if (!strcasecmp(file, "stdin"))
+		fp = stdin;
+	else
+		fp = fopen (file, "r");
+	if (!fp) {
+		sprintf(str1, "error: %s could not be opened for reading\n", file);
+		fatal(str1);
+	}
+
+	zero_dvector(power, flp_desc->n_units);
+	while(!feof(fp)) {
+		fgets(str1, LINE_SIZE, fp);
+		if (feof(fp))
+			break;
+		strcpy(str2, str1);
+
+		/* ignore comments and empty lines	*/
+		ptr = strtok(str1, " \r\t\n");
+		if (!ptr || ptr[0] == '#')
+			continue;
+
+		if (sscanf(str2, "%s%lf", name, &val) != 2)
+			fatal("invalid power file format\n");
+		power[desc_get_blk_index(flp_desc, name)] = val;
+	}
+
+	if(fp != stdin)
+		fclose(fp);
+}
+
 /* debug print	*/
 void print_unplaced(unplaced_t *unit)
 {
@@ -0,0 +1,476 @@
+/*
+ * microbenchmarks of the hot loops of the grid model: the slope
+ * functions, a single RK4 step, the block-grid translations, the
+ * construction of the block-grid map and the trace I/O. each kernel
+ * is run on a thermal model built as by hotspot and is reported in
+ * items (grid nodes, cells or trace values) per second and in GB/s
+ * of compulsory memory traffic. the latter is an estimate: every
+ * item is assumed to be loaded and stored once per call, with no
+ * reuse across calls. hardware counters are read through
+ * perf_event_open where the kernel allows it. the results can be
+ * saved as a baseline and later runs checked against it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "flp.h"
+#include "temperature.h"
+#include "temperature_grid.h"
+#include "materials.h"
+#include "trace.h"
+#include "profile.h"
+#include "util.h"
+
+/* step size of the RK4 kernel	*/
+#define BENCH_STEP	1.0e-6
+/* power density of the blocks in W/m^2	*/
+#define BENCH_DENSITY	5.0e5
+
+/* state shared by the kernels	*/
+typedef struct bench_t_st
+{
+	RC_model_t *model;
+	grid_model_t *grid;
+	/* block power and temperature vectors	*/
+	double *power, *temp;
+	/* grid power vector	*/
+	grid_model_vector_t *p;
+	/* grid temperatures incl. the package nodes, their slope and a step	*/
+	double *v, *k1, *dv;
+	/* no. of grid nodes incl. the package nodes	*/
+	int n;
+	/* trace of 'lines' lines of 'n_blocks' values	*/
+	FILE *trace;
+	int lines;
+}bench_t;
+
+typedef struct kernel_t_st
+{
+	char *name;
+	/* called once per sample before timing. may be NULL	*/
+	void (*prepare)(bench_t *b);
+	void (*run)(bench_t *b);
+	/* work and compulsory traffic of one call	*/
+	double items;
+	double bytes;
+}kernel_t;
+
+void usage(int argc, char **argv)
+{
+	fprintf(stdout, "Usage: %s [-f <file> | -grid_layer_file <file>] [-c <file>] [options]\n", argv[0]);
+	fprintf(stdout, "Times the hot loops of the HotSpot grid model.\n");
+	fprintf(stdout, "Options:(may be specified in any order, within \"[]\" means optional)\n");
+	fprintf(stdout, "   -f <file>\tfloorplan input file (e.g. ev6.flp)\n");
+	fprintf(stdout, "  [-c <file>]\tinput configuration parameters from file (e.g. hotspot.config)\n");
+	fprintf(stdout, "  [-iters <n>]\tcalls of a kernel per sample (default 100)\n");
+	fprintf(stdout, "  [-samples <n>]\tsamples per kernel. the fastest is reported (default 5)\n");
+	fprintf(stdout, "  [-kernels <k1,k2,..>]\tkernels to run (default all): slope_fn_grid,\n");
+	fprintf(stdout, "                \tslope_fn_pack, rk4_core, xlate_vector_b2g, xlate_temp_g2b,\n");
+	fprintf(stdout, "                \tset_bgmap, read_vals, write_vals\n");
+	fprintf(stdout, "  [-perf <0|1>]\tread cycles and instructions with perf_event_open (default 0)\n");
+	fprintf(stdout, "  [-baseline_out <file>]\tsave the results as a baseline\n");
+	fprintf(stdout, "  [-baseline_in <file>]\tcompare with a baseline. the exit status is 1 if a\n");
+	fprintf(stdout, "                \tkernel is slower than the baseline by more than the tolerance\n");
+	fprintf(stdout, "  [-tolerance <t>]\tallowed slowdown as a fraction (default 0.1)\n");
+	fprintf(stdout, "  [options]\tzero or more options of the form \"-<name> <value>\",\n");
+	fprintf(stdout, "           \toverride the options from config file (e.g. -grid_rows 128)\n");
+}
+
+/* kernels	*/
+void run_slope_grid(bench_t *b)
+{
+	slope_fn_grid(b->grid, b->v, b->p, b->dv);
+}
+
+void run_slope_pack(bench_t *b)
+{
+	slope_fn_pack(b->grid, b->v, b->p, b->dv);
+}
+
+void run_rk4_core(bench_t *b)
+{
+	rk4_core(b->grid, b->v, b->k1, b->p, b->n, BENCH_STEP, b->dv, (slope_fn_ptr) slope_fn_grid);
+}
+
+void run_b2g(bench_t *b)
+{
+	xlate_vector_b2g(b->grid, b->power, b->p, V_POWER);
+}
+
+void run_g2b(bench_t *b)
+{
+	xlate_temp_g2b(b->grid, b->temp, b->grid->last_trans);
+}
+
+/* only the power dissipating layers own their maps	*/
+void run_bgmap(bench_t *b)
+{
+	int i;
+	for(i=0; i < b->grid->n_layers; i++)
+		if (b->grid->layers[i].has_power)
+			set_bgmap(b->grid, &b->grid->layers[i]);
+}
+
+void rewind_trace(bench_t *b)
+{
+	rewind(b->trace);
+}
+
+void run_read_vals(bench_t *b)
+{
+	if (!read_vals(b->trace, b->temp))
+		fatal("premature end of the benchmark trace\n");
+}
+
+void run_write_vals(bench_t *b)
+{
+	write_vals(b->trace, b->temp, b->grid->total_n_blocks);
+}
+
+/* optional hardware counters	*/
+typedef struct perf_t_st
+{
+	/* cycles (group leader) and instructions. -1 if unavailable	*/
+	int fd[2];
+}perf_t;
+
+#ifdef __linux__
+static int perf_open(unsigned long long config, int group)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = (group == -1);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+void perf_init(perf_t *perf, int enable)
+{
+	perf->fd[0] = perf->fd[1] = -1;
+#ifdef __linux__
+	if (!enable)
+		return;
+	perf->fd[0] = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (perf->fd[0] >= 0)
+		perf->fd[1] = perf_open(PERF_COUNT_HW_INSTRUCTIONS, perf->fd[0]);
+	if (perf->fd[1] < 0) {
+		if (perf->fd[0] >= 0)
+			close(perf->fd[0]);
+		perf->fd[0] = -1;
+		warning("hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+	}
+#else
+	if (enable)
+		warning("hardware counters are only supported on linux\n");
+#endif
+}
+
+void perf_start(perf_t *perf)
+{
+#ifdef __linux__
+	if (perf->fd[0] < 0)
+		return;
+	ioctl(perf->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+/* counts since perf_start. returns FALSE if unavailable	*/
+int perf_stop(perf_t *perf, double *cycles, double *instructions)
+{
+#ifdef __linux__
+	unsigned long long c = 0, i = 0;
+	if (perf->fd[0] < 0)
+		return FALSE;
+	ioctl(perf->fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(perf->fd[0], &c, sizeof(c)) != sizeof(c) ||
+		read(perf->fd[1], &i, sizeof(i)) != sizeof(i))
+		return FALSE;
+	*cycles = c;
+	*instructions = i;
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+void perf_close(perf_t *perf)
+{
+#ifdef __linux__
+	if (perf->fd[0] >= 0) {
+		close(perf->fd[1]);
+		close(perf->fd[0]);
+	}
+#endif
+}
+
+/* optional parameters	*/
+static int int_param(str_pair *table, int size, char *name, int def)
+{
+	int idx, val = def;
+	char str[STR_SIZE];
+	if ((idx = get_str_index(table, size, name)) >= 0)
+		if (sscanf(table[idx].value, "%d", &val) != 1) {
+			sprintf(str, "invalid format for parameter %s\n", name);
+			fatal(str);
+		}
+	return val;
+}
+
+static double double_param(str_pair *table, int size, char *name, double def)
+{
+	int idx;
+	double val = def;
+	char str[STR_SIZE];
+	if ((idx = get_str_index(table, size, name)) >= 0)
+		if (sscanf(table[idx].value, "%lf", &val) != 1) {
+			sprintf(str, "invalid format for parameter %s\n", name);
+			fatal(str);
+		}
+	return val;
+}
+
+static char *str_param(str_pair *table, int size, char *name)
+{
+	int idx;
+	if ((idx = get_str_index(table, size, name)) >= 0)
+		return table[idx].value;
+	return NULL;
+}
+
+/* is 'name' in the comma-separated 'list'? all names are in a NULL list	*/
+static int in_list(char *list, char *name)
+{
+	char *ptr;
+	int len = strlen(name);
+
+	if (!list)
+		return TRUE;
+	for(ptr = strstr(list, name); ptr; ptr = strstr(ptr + 1, name))
+		if ((ptr == list || ptr[-1] == ',') && (ptr[len] == ',' || ptr[len] == '\0'))
+			return TRUE;
+	return FALSE;
+}
+
+/* build the model and the inputs of the kernels	*/
+void bench_init(bench_t *b, thermal_config_t *config, flp_t *flp,
+				materials_list_t *materials_list, int iters)
+{
+	int i, j, k, base = 0;
+	grid_model_t *g;
+
+	b->model = alloc_RC_model(config, flp, NULL, materials_list, FALSE, FALSE);
+	populate_R_model(b->model, flp);
+	populate_C_model(b->model, flp);
+	b->grid = g = b->model->grid;
+
+	b->power = hotspot_vector(b->model);
+	b->temp = hotspot_vector(b->model);
+	for(i=0; i < g->n_layers; i++) {
+		for(j=0; j < g->layers[i].flp->n_units; j++)
+			b->power[base+j] = g->layers[i].has_power ? BENCH_DENSITY *
+							   g->layers[i].flp->units[j].width *
+							   g->layers[i].flp->units[j].height : 0.0;
+		base += g->layers[i].flp->n_units;
+	}
+	set_internal_power_grid(g, b->power);
+	set_temp(b->model, b->temp, config->init_temp);
+
+	/* grid inputs as in compute_temp_grid	*/
+	b->p = new_grid_model_vector(g);
+	xlate_vector_b2g(g, b->power, b->p, V_POWER);
+	xlate_vector_b2g(g, b->temp, g->last_trans, V_TEMP);
+	b->n = g->rows * g->cols * g->n_layers + EXTRA +
+		   (config->model_secondary ? EXTRA_SEC : 0);
+	b->v = g->last_trans->cuboid[0][0];
+	b->k1 = dvector(b->n);
+	b->dv = dvector(b->n);
+	slope_fn_grid(g, b->v, b->p, b->k1);
+
+	/* trace to be read back by read_vals	*/
+	b->lines = iters;
+	if (!(b->trace = tmpfile()))
+		fatal("unable to create the benchmark trace\n");
+	for(k=0; k < iters; k++)
+		write_vals(b->trace, b->temp, g->total_n_blocks);
+}
+
+void bench_cleanup(bench_t *b)
+{
+	fclose(b->trace);
+	free_dvector(b->dv);
+	free_dvector(b->k1);
+	free_grid_model_vector(b->p);
+	free_dvector(b->temp);
+	free_dvector(b->power);
+	delete_RC_model(b->model);
+}
+
+/* work and traffic of the kernels	*/
+int bench_kernels(bench_t *b, kernel_t *kernels)
+{
+	grid_model_t *g = b->grid;
+	double cells = (double) g->rows * g->cols;
+	double nodes = b->n, power_cells = 0, trace_bytes;
+	double perimeter = DEFAULT_PACK_LAYERS * 2.0 * (g->rows + g->cols);
+	int i, n = 0;
+
+	for(i=0; i < g->n_layers; i++)
+		if (g->layers[i].has_power)
+			power_cells += cells;
+	trace_bytes = ftell(b->trace) / (double) b->lines;
+
+	/* read v and p, write dv	*/
+	kernels[n++] = (kernel_t) {"slope_fn_grid", NULL, run_slope_grid, nodes, 3 * sizeof(double) * nodes};
+	/* reads the boundary cells of the sink and spreader layers	*/
+	kernels[n++] = (kernel_t) {"slope_fn_pack", NULL, run_slope_pack, perimeter,
+							   perimeter * sizeof(double)};
+	/* three slope evaluations and four vector updates	*/
+	kernels[n++] = (kernel_t) {"rk4_core", NULL, run_rk4_core, nodes, 24 * sizeof(double) * nodes};
+	/* walk a block list and write a cell	*/
+	kernels[n++] = (kernel_t) {"xlate_vector_b2g", NULL, run_b2g, g->n_layers * cells,
+							   g->n_layers * cells * (sizeof(blist_t) + sizeof(double))};
+	/* read the cells of every block	*/
+	kernels[n++] = (kernel_t) {"xlate_temp_g2b", NULL, run_g2b, g->n_layers * cells,
+							   g->n_layers * cells * sizeof(double)};
+	/* a block list node and a map entry per cell	*/
+	kernels[n++] = (kernel_t) {"set_bgmap", NULL, run_bgmap, power_cells,
+							   power_cells * (sizeof(blist_t) + sizeof(blist_t *))};
+	kernels[n++] = (kernel_t) {"read_vals", rewind_trace, run_read_vals, g->total_n_blocks, trace_bytes};
+	kernels[n++] = (kernel_t) {"write_vals", rewind_trace, run_write_vals, g->total_n_blocks, trace_bytes};
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	int i, k, s, size, n_kernels, n_base = 0, iters, samples, failed = FALSE;
+	str_pair table[MAX_ENTRIES], base[MAX_ENTRIES], out[MAX_ENTRIES];
+	char *kernel_list, *baseline_in, *baseline_out, *file, str[STR_SIZE];
+	double tolerance, start, best, t, ns, cycles, instr;
+	thermal_config_t config;
+	materials_list_t materials_list;
+	flp_t *flp = NULL;
+	kernel_t kernels[MAX_ENTRIES];
+	bench_t bench;
+	perf_t perf;
+	int size_out = 0;
+
+	if (!(argc >= 3 && argc % 2)) {
+		usage(argc, argv);
+		return 1;
+	}
+	size = parse_cmdline(table, MAX_ENTRIES, argc, argv);
+	if ((file = str_param(table, size, "c")))
+		size += read_str_pairs(&table[size], MAX_ENTRIES - size, file);
+	size = str_pairs_remove_duplicates(table, size);
+
+	iters = MAX(1, int_param(table, size, "iters", 100));
+	samples = MAX(1, int_param(table, size, "samples", 5));
+	tolerance = double_param(table, size, "tolerance", 0.1);
+	kernel_list = str_param(table, size, "kernels");
+	baseline_in = str_param(table, size, "baseline_in");
+	baseline_out = str_param(table, size, "baseline_out");
+
+	default_materials(&materials_list);
+	if ((file = str_param(table, size, "materials_file")))
+		materials_add_from_file(&materials_list, file);
+	config = default_thermal_config();
+	thermal_config_add_from_strs(&config, &materials_list, table, size);
+	/* the kernels are those of the grid model	*/
+	strcpy(config.model_type, GRID_MODEL_STR);
+	if (!strcmp(config.grid_layer_file, NULLFILE)) {
+		if (!(file = str_param(table, size, "f")))
+			fatal("either -f or -grid_layer_file must be specified\n");
+		flp = read_flp(file, FALSE, FALSE);
+	}
+
+	bench_init(&bench, &config, flp, &materials_list, iters);
+	n_kernels = bench_kernels(&bench, kernels);
+	perf_init(&perf, int_param(table, size, "perf", FALSE));
+
+	if (baseline_in) {
+		n_base = read_str_pairs(base, MAX_ENTRIES, baseline_in);
+		sprintf(str, "%dx%dx%d", bench.grid->rows, bench.grid->cols, bench.grid->n_layers);
+		if ((i = get_str_index(base, n_base, "grid")) < 0 || strcmp(base[i].value, str))
+			warning("baseline was recorded with a different grid\n");
+	}
+	if (baseline_out) {
+		strcpy(out[size_out].name, "grid");
+		sprintf(out[size_out++].value, "%dx%dx%d", bench.grid->rows,
+				bench.grid->cols, bench.grid->n_layers);
+	}
+
+	fprintf(stdout, "grid %dx%d, %d layers, %d blocks, %d calls x %d samples\n",
+			bench.grid->rows, bench.grid->cols, bench.grid->n_layers,
+			bench.grid->total_n_blocks, iters, samples);
+	fprintf(stdout, "%-18s%12s%12s%14s%10s", "kernel", "items", "us/call", "Mitems/s", "GB/s");
+	if (perf.fd[0] >= 0)
+		fprintf(stdout, "%14s%8s", "cycles/item", "IPC");
+	if (baseline_in)
+		fprintf(stdout, "%10s", "vs base");
+	fprintf(stdout, "\n");
+
+	for(i=0; i < n_kernels; i++) {
+		if (!in_list(kernel_list, kernels[i].name))
+			continue;
+		best = 0.0;
+		perf_start(&perf);
+		for(s=0; s < samples; s++) {
+			if (kernels[i].prepare)
+				kernels[i].prepare(&bench);
+			start = prof_now();
+			for(k=0; k < iters; k++)
+				kernels[i].run(&bench);
+			t = prof_now() - start;
+			if (!s || t < best)
+				best = t;
+		}
+		ns = best * 1.0e9 / iters;
+		fprintf(stdout, "%-18s%12.0f%12.3f%14.2f%10.2f", kernels[i].name, kernels[i].items,
+				ns * 1.0e-3, kernels[i].items * 1.0e3 / ns, kernels[i].bytes / ns);
+		if (perf_stop(&perf, &cycles, &instr))
+			fprintf(stdout, "%14.2f%8.2f", cycles / ((double) samples * iters * kernels[i].items),
+					instr / MAX(cycles, 1.0));
+
+		/* ns per call, compared as such	*/
+		if (baseline_in) {
+			if ((s = get_str_index(base, n_base, kernels[i].name)) < 0)
+				fprintf(stdout, "%10s", "n/a");
+			else {
+				t = ns / atof(base[s].value);
+				fprintf(stdout, "%9.2fx", t);
+				if (t > 1.0 + tolerance) {
+					fprintf(stdout, "  REGRESSION");
+					failed = TRUE;
+				}
+			}
+		}
+		fprintf(stdout, "\n");
+		if (baseline_out) {
+			strcpy(out[size_out].name, kernels[i].name);
+			sprintf(out[size_out++].value, "%.3f", ns);
+		}
+	}
+
+	if (baseline_out)
+		dump_str_pairs(out, size_out, baseline_out, "-");
+	perf_close(&perf);
+	bench_cleanup(&bench);
+	if (flp)
+		free_flp(flp, FALSE, FALSE);
+	free_materials(&materials_list);
+	return failed;
+}
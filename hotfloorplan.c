@@ -9,6 +9,7 @@
  * that optimizes the specified metric.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #ifdef _MSC_VER
 #define strcasecmp    _stricmp
@@ -124,6 +125,43 @@ void print_wire_delays(flp_t *flp, double frequency)
 			}
 }
 
+/*
+ * floorplanning of the 3-d stack given by the lcf file. the
+ * floorplan of layer l is written to "<flp_out>.<l>"
+ */
+void floorplan_stack(flp_desc_t *flp_desc, thermal_config_t *thermal_config,
+					 materials_list_t *materials_list,
+					 global_config_t *global_config)
+{
+	int l, *compacted;
+	char file[STR_SIZE+16];
+	flp_t **flps;
+	RC_model_t *model;
+	double *power;
+
+	/* the floorplans of the layers are set by the floorplanner	*/
+	model = alloc_RC_model(thermal_config, NULL, NULL, materials_list, 0, 0);
+	power = dvector(flp_desc->n_units);
+	read_desc_power(flp_desc, power, global_config->power_in);
+	compacted = ivector(flp_desc->n_layers);
+
+	flps = floorplan_3d(flp_desc, model, power, compacted);
+	for(l=0; l < flp_desc->n_layers; l++) {
+		fprintf(stdout, "floorplan of layer %d:\n", l);
+		print_flp_fig(flps[l]);
+		print_wire_delays(flps[l], thermal_config->base_proc_freq);
+		sprintf(file, "%s.%d", global_config->flp_out, l);
+		dump_flp(flps[l], file, FALSE);
+	}
+
+	delete_RC_model(model);
+	for(l=0; l < flp_desc->n_layers; l++)
+		free_flp(flps[l], compacted[l], TRUE);
+	free(flps);
+	free_ivector(compacted);
+	free_dvector(power);
+}
+
 /* main function for the floorplanner	*/
 int main(int argc, char **argv)
 {
@@ -178,18 +216,22 @@ int main(int argc, char **argv)
 		dump_str_pairs(table, size, global_config.dump_config, "-");
 	}
 
-	/* If the grid model is used, things could be really slow!
-	 * Also make sure it is not in the 3-d chip mode (specified
-	 * with the layer configuration file)
-	 */
-	if (!strcmp(thermal_config.model_type, GRID_MODEL_STR)) {
-		if (strcmp(thermal_config.grid_layer_file, NULLFILE))
-			fatal("lcf file specified with the grid model. 3-d chips not supported\n");
+	/* If the grid model is used, things could be really slow!	*/
+	if (!strcmp(thermal_config.model_type, GRID_MODEL_STR))
 		warning("grid model is used. HotFloorplan could be REALLY slow\n");
-	}
 
 	/* description of the functional blocks to be floorplanned	*/
 	flp_desc = read_flp_desc(global_config.flp_desc, &flp_config);
+
+	/* 3-d chip mode (specified with the layer configuration file)	*/
+	if (!strcmp(thermal_config.model_type, GRID_MODEL_STR) &&
+		strcmp(thermal_config.grid_layer_file, NULLFILE)) {
+		floorplan_stack(flp_desc, &thermal_config, &materials_list, &global_config);
+		free_flp_desc(flp_desc);
+		return 0;
+	}
+	if (flp_desc->n_layers > 1)
+		fatal("layers in the floorplan description need the grid model with an lcf file\n");
 	/*
 	 * just an empty frame with blocks' names.
 	 * block positions not known yet.
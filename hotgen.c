@@ -0,0 +1,228 @@
+/*
+ * generator of synthetic inputs for benchmarking HotSpot:
+ * floorplans with a number of cores and their L2 caches,
+ * layer configuration files of stacked chips, microchannel
+ * networks and power traces with a configurable activity.
+ * all the outputs are deterministic for a given seed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "flp.h"
+#include "util.h"
+
+/* power of an idle unit relative to an active one	*/
+#define IDLE_FRACTION	0.1
+
+void usage(int argc, char **argv)
+{
+	fprintf(stdout, "Usage: %s -type <flp|lcf|ptrace|uchan> -o <file> [options]\n", argv[0]);
+	fprintf(stdout, "Generates synthetic inputs for HotSpot.\n");
+	fprintf(stdout, "Options:(may be specified in any order, within \"[]\" means optional)\n");
+	fprintf(stdout, "  -type flp\tfloorplan of a grid of cores, each with an L2 slice below it\n");
+	fprintf(stdout, "     [-cores <n>]\tno. of cores (default 4)\n");
+	fprintf(stdout, "     [-core_size <m>]\tside of a core in meters (default 2e-3)\n");
+	fprintf(stdout, "     [-prefix <str>]\tprefix of the unit names (default none)\n");
+	fprintf(stdout, "  -type lcf\tstack of alternating silicon and TIM layers\n");
+	fprintf(stdout, "      -flp <f1,f2,..>\tfloorplans of the silicon layers, reused cyclically\n");
+	fprintf(stdout, "     [-layers <n>]\tno. of layers (default 2)\n");
+	fprintf(stdout, "  -type ptrace\tpower trace of the units of one or more floorplans\n");
+	fprintf(stdout, "      -flp <f1,f2,..>\tfloorplans whose units dissipate power\n");
+	fprintf(stdout, "     [-steps <n>]\tno. of rows (default 10)\n");
+	fprintf(stdout, "     [-activity <a>]\tprobability that a unit toggles between idle\n");
+	fprintf(stdout, "                \tand active in a row (default 0.2)\n");
+	fprintf(stdout, "     [-density <d>]\tpower density of an active unit in W/m^2 (default 5e5)\n");
+	fprintf(stdout, "  -type uchan\tmicrochannel network of straight horizontal channels\n");
+	fprintf(stdout, "     [-rows <n>]\tno. of rows (default 64)\n");
+	fprintf(stdout, "     [-cols <n>]\tno. of columns (default 64)\n");
+	fprintf(stdout, "     [-pitch <n>]\tevery n-th row is a channel (default 2)\n");
+	fprintf(stdout, "  [-seed <n>]\tseed of the random number generator\n");
+}
+
+/* optional parameters	*/
+static int int_param(str_pair *table, int size, char *name, int def)
+{
+	int idx, val = def;
+	char str[STR_SIZE];
+	if ((idx = get_str_index(table, size, name)) >= 0)
+		if (sscanf(table[idx].value, "%d", &val) != 1) {
+			sprintf(str, "invalid format for parameter %s\n", name);
+			fatal(str);
+		}
+	return val;
+}
+
+static double double_param(str_pair *table, int size, char *name, double def)
+{
+	int idx;
+	double val = def;
+	char str[STR_SIZE];
+	if ((idx = get_str_index(table, size, name)) >= 0)
+		if (sscanf(table[idx].value, "%lf", &val) != 1) {
+			sprintf(str, "invalid format for parameter %s\n", name);
+			fatal(str);
+		}
+	return val;
+}
+
+static char *str_param(str_pair *table, int size, char *name, int required)
+{
+	int idx;
+	char str[STR_SIZE];
+	if ((idx = get_str_index(table, size, name)) >= 0)
+		return table[idx].value;
+	if (required) {
+		sprintf(str, "required parameter %s missing. check usage\n", name);
+		fatal(str);
+	}
+	return NULL;
+}
+
+/* split a comma-separated list in place. returns the no. of items	*/
+static int split_list(char *list, char **items, int max)
+{
+	int n = 0;
+	char *ptr = strtok(list, ",");
+	while (ptr && n < max) {
+		items[n++] = ptr;
+		ptr = strtok(NULL, ",");
+	}
+	return n;
+}
+
+/*
+ * cores are placed on a near-square grid. each core sits on
+ * top of an L2 slice of the same width and half its height
+ */
+void gen_flp(FILE *fp, int cores, double size, char *prefix)
+{
+	int i, cx, cy;
+	double l2 = size / 2.0;
+
+	cx = (int) ceil(sqrt((double) cores));
+	fprintf(fp, "# synthetic floorplan: %d cores\n", cores);
+	fprintf(fp, "# <unit-name>\t<width>\t<height>\t<left-x>\t<bottom-y>\n");
+	for(i=0; i < cores; i++) {
+		cy = i / cx;
+		fprintf(fp, "%score_%d\t%.6e\t%.6e\t%.6e\t%.6e\n", prefix, i, size, size,
+				(i % cx) * size, cy * (size + l2) + l2);
+		fprintf(fp, "%sL2_%d\t%.6e\t%.6e\t%.6e\t%.6e\n", prefix, i, size, l2,
+				(i % cx) * size, cy * (size + l2));
+	}
+}
+
+/* silicon layers with the given floorplans, each followed by a TIM	*/
+void gen_lcf(FILE *fp, int layers, char **flps, int n_flps)
+{
+	int i;
+
+	fprintf(fp, "# synthetic stack: %d layers\n", layers);
+	for(i=0; i < layers; i++) {
+		fprintf(fp, "\n%d\nY\n", i);
+		if (i % 2 == 0)
+			fprintf(fp, "Y\n1.75e6\n0.01\n0.00015\n");
+		else
+			fprintf(fp, "N\n4e6\n0.25\n2.0e-05\n");
+		fprintf(fp, "%s\n", flps[(i / 2) % n_flps]);
+	}
+}
+
+/*
+ * each unit is either active or idle and toggles with
+ * probability 'activity' every row. the power of an
+ * active unit is proportional to its area
+ */
+void gen_ptrace(FILE *fp, flp_t **flps, int n_flps, int steps, double activity,
+				double density, rand_state_t *rs)
+{
+	int i, j, k, n = 0;
+	int *active;
+
+	for(i=0; i < n_flps; i++)
+		n += flps[i]->n_units;
+	active = ivector(n);
+	for(i=0; i < n; i++)
+		active[i] = rand_fraction_r(rs) < 0.5;
+
+	for(i=0, k=0; i < n_flps; i++)
+		for(j=0; j < flps[i]->n_units; j++, k++)
+			fprintf(fp, "%s%s", flps[i]->units[j].name, (k < n-1) ? "\t" : "\n");
+
+	while (steps--) {
+		for(i=0, k=0; i < n_flps; i++)
+			for(j=0; j < flps[i]->n_units; j++, k++) {
+				if (rand_fraction_r(rs) < activity)
+					active[k] = !active[k];
+				fprintf(fp, "%.4f%s", density * flps[i]->units[j].width * flps[i]->units[j].height *
+						(active[k] ? 1.0 : IDLE_FRACTION), (k < n-1) ? "\t" : "\n");
+			}
+	}
+	free_ivector(active);
+}
+
+/* channels run from an inlet on the left to an outlet on the right	*/
+void gen_uchan(FILE *fp, int rows, int cols, int pitch)
+{
+	int i, j, type;
+
+	for(i=0; i < rows; i++)
+		for(j=0; j < cols; j++) {
+			if (i % pitch != pitch - 1)
+				type = 0;		/* SOLID	*/
+			else if (j == 0)
+				type = 2;		/* INLET	*/
+			else if (j == cols - 1)
+				type = 3;		/* OUTLET	*/
+			else
+				type = 1;		/* FLUID	*/
+			fprintf(fp, "%d%s", type, (j < cols-1) ? ", " : "\n");
+		}
+}
+
+int main(int argc, char **argv)
+{
+	str_pair table[MAX_ENTRIES];
+	int i, size, n_flps = 0;
+	char *type, *items[MAX_ENTRIES];
+	flp_t *flps[MAX_ENTRIES];
+	rand_state_t rs;
+	FILE *fp;
+
+	if (!(argc >= 5 && argc % 2)) {
+		usage(argc, argv);
+		return 1;
+	}
+	size = parse_cmdline(table, MAX_ENTRIES, argc, argv);
+	type = str_param(table, size, "type", TRUE);
+	init_rand_r(&rs, int_param(table, size, "seed", RAND_SEED));
+
+	if (!(fp = fopen(str_param(table, size, "o", TRUE), "w")))
+		fatal("unable to open output file\n");
+
+	if (!strcmp(type, "flp")) {
+		gen_flp(fp, int_param(table, size, "cores", 4),
+				double_param(table, size, "core_size", 2e-3),
+				str_param(table, size, "prefix", FALSE) ? str_param(table, size, "prefix", FALSE) : "");
+	} else if (!strcmp(type, "lcf")) {
+		n_flps = split_list(str_param(table, size, "flp", TRUE), items, MAX_ENTRIES);
+		gen_lcf(fp, int_param(table, size, "layers", 2), items, n_flps);
+	} else if (!strcmp(type, "ptrace")) {
+		n_flps = split_list(str_param(table, size, "flp", TRUE), items, MAX_ENTRIES);
+		for(i=0; i < n_flps; i++)
+			flps[i] = read_flp(items[i], FALSE, FALSE);
+		gen_ptrace(fp, flps, n_flps, int_param(table, size, "steps", 10),
+				   double_param(table, size, "activity", 0.2),
+				   double_param(table, size, "density", 5e5), &rs);
+		for(i=0; i < n_flps; i++)
+			free_flp(flps[i], FALSE, FALSE);
+	} else if (!strcmp(type, "uchan")) {
+		gen_uchan(fp, int_param(table, size, "rows", 64), int_param(table, size, "cols", 64),
+				  MAX(1, int_param(table, size, "pitch", 2)));
+	} else
+		fatal("unknown type. check usage\n");
+
+	fclose(fp);
+	return 0;
+}
@@ -292,6 +292,13 @@ void read_temp (RC_model_t *model, double *temp, char *file, int clip);
  */
 void steady_state_temp(RC_model_t *model, double *power, double *temp);
 
+/* same as above, but the solver starts from the incoming
+ * contents of 'temp' (block model) or the previous solution
+ * (grid model). much faster when the floorplan or the power
+ * numbers change only slightly between calls.
+ */
+void steady_state_temp_warm(RC_model_t *model, double *power, double *temp);
+
 /* computation of the transient temperatures. 'power'
  * and 'temp' must be allocated using 'hotspot_vector'.
  * 'populate_R_model' and 'populate_C_model' must be
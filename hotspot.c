@@ -20,6 +20,15 @@
 #include "hotspot.h"
 #include "microchannel.h"
 #include "materials.h"
+#include "ensemble.h"
+#include "variation.h"
+#include "profile.h"
+#include "trace.h"
+#include "stats.h"
+#include "sensor.h"
+#include "events.h"
+#include "snapshot.h"
+#include "state.h"
 
 // My stuff
 #define PRINT_GRID_TRANSIENT 1
@@ -83,6 +92,56 @@ void usage(int argc, char **argv)
   fprintf(stdout, "            \tsteady state temperatures are output to stdout\n");
   fprintf(stdout, "  [-c <file>]\tinput configuration parameters from file (e.g. hotspot.config)\n");
   fprintf(stdout, "  [-d <file>]\toutput configuration parameters to file\n");
+  fprintf(stdout, "  [-steady_batch <prefix>]\tsolve the steady state of every row of the power\n");
+  fprintf(stdout, "            \ttrace as a separate power map and write its temperatures\n");
+  fprintf(stdout, "            \tto <prefix>.<row> (rows are numbered from 0)\n");
+  fprintf(stdout, "  [-ensemble <file>]\tsimulate the power traces listed in <file> (one per line)\n");
+  fprintf(stdout, "            \ttogether instead of -p. the temperature trace of the k-th\n");
+  fprintf(stdout, "            \tone is written to <o>.<k>. requires the grid model\n");
+  fprintf(stdout, "  [-profile_file <file>]\ttime the simulation phases, count the solver work and\n");
+  fprintf(stdout, "            \twrite a JSON report to <file> (or \"stdout\") at exit\n");
+  fprintf(stdout, "  [-mem_limit <MB>]\tfail before allocating if the estimated memory footprint\n");
+  fprintf(stdout, "            \texceeds <MB>. the report of -profile_file has the actual\n");
+  fprintf(stdout, "            \tcurrent and peak bytes per subsystem\n");
+  fprintf(stdout, "  [-pipeline_depth <n>]\tparse the power trace and write the temperature trace\n");
+  fprintf(stdout, "            \ton separate threads, up to <n> rows ahead of the solver\n");
+  fprintf(stdout, "            \t(default %d). 0 does everything on the solver's thread\n", PIPELINE_DEPTH);
+  fprintf(stdout, "  [-aggregate_tolerance <frac>]\tmerge consecutive rows of the power trace whose\n");
+  fprintf(stdout, "            \tblock powers stay within <frac> of the first one into one\n");
+  fprintf(stdout, "            \tinterval. the temperatures of the rows in between are\n");
+  fprintf(stdout, "            \tinterpolated (default 0, no merging)\n");
+  fprintf(stdout, "  [-aggregate_max <n>]\tmax. no. of rows merged into one interval (default %d)\n", AGGREGATE_MAX);
+  fprintf(stdout, "  [-stats_file <file>]\twrite per-block min, max, mean, standard deviation, time\n");
+  fprintf(stdout, "            \tabove thermal_threshold and rainflow-counted thermal cycles\n");
+  fprintf(stdout, "            \tof the transient temperatures to <file>. without -o, the\n");
+  fprintf(stdout, "            \ttemperature trace is not written at all\n");
+  fprintf(stdout, "  [-stats_grid <0/1>]\tthe same for every grid cell of the power dissipating layers\n");
+  fprintf(stdout, "  [-stats_cycle_gate <K>]\tignore temperature swings smaller than this in the\n");
+  fprintf(stdout, "            \tcycle counting (default 0)\n");
+  fprintf(stdout, "  [-sensor_file <file>]\tvirtual sensors (name, layer, x, y and optionally the\n");
+  fprintf(stdout, "            \twidth and height averaged, one per line) read every interval\n");
+  fprintf(stdout, "  [-sensor_out <file>]\tbinary file of the sensor readings (see sensor.h)\n");
+  fprintf(stdout, "  [-sensor_only <0/1>]\tthe sensors are the only output: skip the mapping of the\n");
+  fprintf(stdout, "            \tgrid temperatures to the blocks after each interval\n");
+  fprintf(stdout, "  [-event_file <file>]\twrite only the crossings of the trip points by the block\n");
+  fprintf(stdout, "            \ttemperatures (time, block, up/down, trip point, temperature).\n");
+  fprintf(stdout, "            \twithout -o, the temperature trace is not written at all\n");
+  fprintf(stdout, "  [-trip_points <K,K,...>]\ttrip points of -event_file (default thermal_threshold)\n");
+  fprintf(stdout, "  [-event_hysteresis <K>]\ta block goes down from a trip point only below it\n");
+  fprintf(stdout, "            \tless this (default %g)\n", EVENT_HYSTERESIS);
+  fprintf(stdout, "  [-snapshot_file <file>]\tpublish the block and grid temperatures of every\n");
+  fprintf(stdout, "            \tinterval of a standalone run into a shared file mapping\n");
+  fprintf(stdout, "            \t(e.g. under /dev/shm) that other processes read without\n");
+  fprintf(stdout, "            \tlocks (see snapshot.h)\n");
+  fprintf(stdout, "  [-state_file <file>]\tstate handed over between ThermSniper invocations\n");
+  fprintf(stdout, "            \t(default %s)\n", TRANS_TEMP_FILE);
+  fprintf(stdout, "  [-session <id>]\tid of the ThermSniper run, so that concurrent runs keep\n");
+  fprintf(stdout, "            \tseparate states (<state_file>.<id> without -state_arena)\n");
+  fprintf(stdout, "  [-state_arena <file>]\tkeep the state of the session in a region of <file>\n");
+  fprintf(stdout, "            \t(e.g. under /dev/shm) shared by many sessions\n");
+  fprintf(stdout, "  [-mc_samples <n>]\tMonte Carlo study of material variation: solve the steady\n");
+  fprintf(stdout, "            \tstate of the average power for <n> samples of the -mc_*_sd\n");
+  fprintf(stdout, "            \tparameters and write per-block statistics to -mc_file\n");
   fprintf(stdout, "  [options]\tzero or more options of the form \"-<name> <value>\",\n");
   fprintf(stdout, "           \toverride the options from config file. e.g. \"-model_type block\" selects\n");
   fprintf(stdout, "           \tthe block model while \"-model_type grid\" selects the grid model\n");
@@ -90,111 +149,6 @@ void usage(int argc, char **argv)
 }
 
 
-#include <sys/mman.h>
-#include <fcntl.h> 
-void load_last_trans_temp_mmap(grid_model_t *model, const char *filename,
-                                     void **mapped_region, size_t *mapped_size) {
-    int fd = open(filename, O_RDWR);
-    if (fd < 0) { perror("open"); exit(1); }
-
-    off_t fsize = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
-    *mapped_size = (size_t)fsize;
-
-    void *raw = mmap(NULL, fsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    close(fd);
-    if (raw == MAP_FAILED) fatal("mmap failed\n");
-    *mapped_region = raw;
-
-    int *header = (int *)raw;
-    if (header[0] != MAGIC_MMAP_FILE || header[1] != (trace_num-1)) 
-    {
-        munmap(raw, fsize);
-        fatal("Invalid file header\n");
-    }
-
-    int layers = header[2], rows = header[3], cols = header[4], num_extra = header[5];
-    if (layers != model->n_layers || rows != model->rows || cols != model->cols) 
-    {
-        fprintf(stderr, "Grid mismatch: file [%d,%d,%d], model [%d,%d,%d]\n",
-                layers, rows, cols, model->n_layers, model->rows, model->cols);
-        munmap(raw, fsize);
-        exit(1);
-    }
-
-    double *cuboid_flat = (double *)(header + 6);
-    double *extra_flat = cuboid_flat + ((size_t)layers * rows * cols);
-    double *last_temp_flat = extra_flat + num_extra;
-
-    // Setup last_trans
-    grid_model_vector_t *v = calloc(1, sizeof(grid_model_vector_t));
-    v->cuboid = calloc(layers, sizeof(double **));
-    for (int l = 0; l < layers; l++) {
-        v->cuboid[l] = calloc(rows, sizeof(double *));
-        for (int r = 0; r < rows; r++) {
-            size_t offset = ((size_t)l * rows + r) * cols;
-            v->cuboid[l][r] = &cuboid_flat[offset];
-        }
-    }
-    v->extra = extra_flat;
-    model->last_trans = v;
-
-    // Setup last_temp
-    model->last_temp = last_temp_flat;   
-}
-
-void save_last_trans_temp_mmap(grid_model_t *m, const char *filename, int num_extra) 
-{
-    FILE *f = fopen(filename, "wb");
-    if (!f) { perror("fopen"); exit(1); }
-
-    int header[6] = {
-        MAGIC_MMAP_FILE,
-        trace_num,      
-        m->n_layers,
-        m->rows,
-        m->cols,
-        num_extra
-    };
-    fwrite(header, sizeof(header), 1, f);
-
-    // Write cuboid data
-    for (int l = 0; l < m->n_layers; l++) 
-    {
-        for (int r = 0; r < m->rows; r++) 
-        {
-            fwrite(m->last_trans->cuboid[l][r], sizeof(double), m->cols, f);
-        }
-    }
-    
-    // Write extra nodes data
-    fwrite(m->last_trans->extra, sizeof(double), num_extra, f);
-
-    // Write last_temp
-    size_t total_nodes;
-    if (m->config.model_secondary)
-      total_nodes = m->total_n_blocks + EXTRA + EXTRA_SEC;
-    else
-      total_nodes = m->total_n_blocks + EXTRA;
-    fwrite(m->last_temp, sizeof(double), total_nodes, f);
-
-    fclose(f);
-}
-
-void flush_updated_last_trans_temp(void *mapped_region, size_t mapped_size) 
-{   
-  int *header = (int *)mapped_region;
-  header[1] = trace_num;
-  if (msync(mapped_region, mapped_size, MS_SYNC) != 0) {
-      perror("msync");
-  }
-}
-
-void unload_last_trans_temp(void *mapped_region, size_t mapped_size) 
-{
-    munmap(mapped_region, mapped_size);
-}
-
 /*
  * parse a table of name-value string pairs and add the configuration
  * parameters to 'config'
@@ -212,6 +166,9 @@ void global_config_from_strs(global_config_t *config, str_pair *table, int size)
   if ((idx = get_str_index(table, size, "p")) >= 0) {
       if(sscanf(table[idx].value, "%s", config->p_infile) != 1)
         fatal("invalid format for configuration  parameter p_infile\n");
+  } else if (get_str_index(table, size, "ensemble") >= 0) {
+      /* the traces come from the ensemble list instead	*/
+      strcpy(config->p_infile, NULLFILE);
   } else {
       fatal("required parameter p_infile missing. check usage\n");
   }
@@ -239,6 +196,128 @@ void global_config_from_strs(global_config_t *config, str_pair *table, int size)
   } else {
       strcpy(config->dump_config, NULLFILE);
   }
+  if ((idx = get_str_index(table, size, "steady_batch")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->steady_batch) != 1)
+        fatal("invalid format for configuration  parameter steady_batch\n");
+  } else {
+      strcpy(config->steady_batch, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "ensemble")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->ensemble) != 1)
+        fatal("invalid format for configuration  parameter ensemble\n");
+  } else {
+      strcpy(config->ensemble, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "profile_file")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->profile_file) != 1)
+        fatal("invalid format for configuration  parameter profile_file\n");
+  } else {
+      strcpy(config->profile_file, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "mem_limit")) >= 0) {
+      if(sscanf(table[idx].value, "%lf", &config->mem_limit) != 1)
+        fatal("invalid format for configuration  parameter mem_limit\n");
+  } else {
+      config->mem_limit = 0;
+  }
+  if ((idx = get_str_index(table, size, "pipeline_depth")) >= 0) {
+      if(sscanf(table[idx].value, "%d", &config->pipeline_depth) != 1 || config->pipeline_depth < 0)
+        fatal("invalid format for configuration  parameter pipeline_depth\n");
+  } else {
+      config->pipeline_depth = PIPELINE_DEPTH;
+  }
+  if ((idx = get_str_index(table, size, "aggregate_tolerance")) >= 0) {
+      if(sscanf(table[idx].value, "%lf", &config->aggregate_tolerance) != 1 || config->aggregate_tolerance < 0)
+        fatal("invalid format for configuration  parameter aggregate_tolerance\n");
+  } else {
+      config->aggregate_tolerance = 0;
+  }
+  if ((idx = get_str_index(table, size, "aggregate_max")) >= 0) {
+      if(sscanf(table[idx].value, "%d", &config->aggregate_max) != 1 || config->aggregate_max < 1)
+        fatal("invalid format for configuration  parameter aggregate_max\n");
+  } else {
+      config->aggregate_max = AGGREGATE_MAX;
+  }
+  if ((idx = get_str_index(table, size, "stats_file")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->stats_file) != 1)
+        fatal("invalid format for configuration  parameter stats_file\n");
+  } else {
+      strcpy(config->stats_file, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "stats_grid")) >= 0) {
+      if(sscanf(table[idx].value, "%d", &config->stats_grid) != 1)
+        fatal("invalid format for configuration  parameter stats_grid\n");
+  } else {
+      config->stats_grid = 0;
+  }
+  if ((idx = get_str_index(table, size, "stats_cycle_gate")) >= 0) {
+      if(sscanf(table[idx].value, "%lf", &config->stats_cycle_gate) != 1 || config->stats_cycle_gate < 0)
+        fatal("invalid format for configuration  parameter stats_cycle_gate\n");
+  } else {
+      config->stats_cycle_gate = 0;
+  }
+  if ((idx = get_str_index(table, size, "sensor_file")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->sensor_file) != 1)
+        fatal("invalid format for configuration  parameter sensor_file\n");
+  } else {
+      strcpy(config->sensor_file, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "sensor_out")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->sensor_out) != 1)
+        fatal("invalid format for configuration  parameter sensor_out\n");
+  } else {
+      strcpy(config->sensor_out, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "sensor_only")) >= 0) {
+      if(sscanf(table[idx].value, "%d", &config->sensor_only) != 1)
+        fatal("invalid format for configuration  parameter sensor_only\n");
+  } else {
+      config->sensor_only = 0;
+  }
+  if ((idx = get_str_index(table, size, "event_file")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->event_file) != 1)
+        fatal("invalid format for configuration  parameter event_file\n");
+  } else {
+      strcpy(config->event_file, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "trip_points")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->trip_points) != 1)
+        fatal("invalid format for configuration  parameter trip_points\n");
+  } else {
+      strcpy(config->trip_points, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "event_hysteresis")) >= 0) {
+      if(sscanf(table[idx].value, "%lf", &config->event_hysteresis) != 1 || config->event_hysteresis < 0)
+        fatal("invalid format for configuration  parameter event_hysteresis\n");
+  } else {
+      config->event_hysteresis = EVENT_HYSTERESIS;
+  }
+  if ((idx = get_str_index(table, size, "snapshot_file")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->snapshot_file) != 1)
+        fatal("invalid format for configuration  parameter snapshot_file\n");
+  } else {
+      strcpy(config->snapshot_file, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "state_file")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->state_file) != 1)
+        fatal("invalid format for configuration  parameter state_file\n");
+  } else {
+      strcpy(config->state_file, TRANS_TEMP_FILE);
+  }
+  if ((idx = get_str_index(table, size, "session")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->session) != 1)
+        fatal("invalid format for configuration  parameter session\n");
+  } else {
+      strcpy(config->session, NULLFILE);
+  }
+  if ((idx = get_str_index(table, size, "state_arena")) >= 0) {
+      if(sscanf(table[idx].value, "%s", config->state_arena) != 1)
+        fatal("invalid format for configuration  parameter state_arena\n");
+  } else {
+      strcpy(config->state_arena, NULLFILE);
+  }
+  if (!strcmp(config->sensor_file, NULLFILE) != !strcmp(config->sensor_out, NULLFILE))
+    fatal("-sensor_file and -sensor_out go together\n");
   if ((idx = get_str_index(table, size, "detailed_3D")) >= 0) {
       if(sscanf(table[idx].value, "%s", config->detailed_3D) != 1)
         fatal("invalid format for configuration  parameter lc\n");
@@ -307,7 +386,7 @@ void global_config_from_strs(global_config_t *config, str_pair *table, int size)
  */
 int global_config_to_strs(global_config_t *config, str_pair *table, int max_entries)
 {
-  if (max_entries < 8)
+  if (max_entries < 28)
     fatal("not enough entries in table\n");
 
   sprintf(table[0].name, "f");
@@ -318,6 +397,26 @@ int global_config_to_strs(global_config_t *config, str_pair *table, int max_entr
   sprintf(table[5].name, "detailed_3D");
   sprintf(table[6].name, "use_microchannels");
   sprintf(table[7].name, "materials_file");
+  sprintf(table[8].name, "steady_batch");
+  sprintf(table[9].name, "ensemble");
+  sprintf(table[10].name, "profile_file");
+  sprintf(table[11].name, "mem_limit");
+  sprintf(table[12].name, "pipeline_depth");
+  sprintf(table[13].name, "aggregate_tolerance");
+  sprintf(table[14].name, "aggregate_max");
+  sprintf(table[15].name, "stats_file");
+  sprintf(table[16].name, "stats_grid");
+  sprintf(table[17].name, "stats_cycle_gate");
+  sprintf(table[18].name, "sensor_file");
+  sprintf(table[19].name, "sensor_out");
+  sprintf(table[20].name, "sensor_only");
+  sprintf(table[21].name, "event_file");
+  sprintf(table[22].name, "trip_points");
+  sprintf(table[23].name, "event_hysteresis");
+  sprintf(table[24].name, "snapshot_file");
+  sprintf(table[25].name, "state_file");
+  sprintf(table[26].name, "session");
+  sprintf(table[27].name, "state_arena");
   // sprintf(table[8].name, "v");                          
   // sprintf(table[9].name, "t");  
 
@@ -329,130 +428,231 @@ int global_config_to_strs(global_config_t *config, str_pair *table, int max_entr
   sprintf(table[5].value, "%s", config->detailed_3D);
   sprintf(table[6].value, "%d", config->use_microchannels);
   sprintf(table[7].value, "%s", config->materials_file);
+  sprintf(table[8].value, "%s", config->steady_batch);
+  sprintf(table[9].value, "%s", config->ensemble);
+  sprintf(table[10].value, "%s", config->profile_file);
+  sprintf(table[11].value, "%g", config->mem_limit);
+  sprintf(table[12].value, "%d", config->pipeline_depth);
+  sprintf(table[13].value, "%g", config->aggregate_tolerance);
+  sprintf(table[14].value, "%d", config->aggregate_max);
+  sprintf(table[15].value, "%s", config->stats_file);
+  sprintf(table[16].value, "%d", config->stats_grid);
+  sprintf(table[17].value, "%g", config->stats_cycle_gate);
+  sprintf(table[18].value, "%s", config->sensor_file);
+  sprintf(table[19].value, "%s", config->sensor_out);
+  sprintf(table[20].value, "%d", config->sensor_only);
+  sprintf(table[21].value, "%s", config->event_file);
+  sprintf(table[22].value, "%s", config->trip_points);
+  sprintf(table[23].value, "%g", config->event_hysteresis);
+  sprintf(table[24].value, "%s", config->snapshot_file);
+  sprintf(table[25].value, "%s", config->state_file);
+  sprintf(table[26].value, "%s", config->session);
+  sprintf(table[27].value, "%s", config->state_arena);
   // sprintf(table[8].value, "%s", volt_vector);
   // sprintf(table[9].value, "%d", trace_num);
 
-  return 8;
+  return 28;
 }
 
 /*
- * read a single line of trace file containing names
- * of functional blocks
+ * solve the steady state temperatures of the 'n' power maps
+ * in 'power' together and dump those of map k into the file
+ * '<prefix>.k'. the files can be used as init files later
  */
-int read_names(FILE *fp, char **names)
+void dump_steady_batch(RC_model_t *model, double **power, int n, char *prefix)
 {
-  char line[LINE_SIZE], temp[LINE_SIZE], *src;
-  int i;
+  int k;
+  double **temp;
+  char file[STR_SIZE+16];
+
+  temp = (double **) calloc(n, sizeof(double *));
+  if (!temp)
+    fatal("memory allocation error\n");
+  for(k=0; k < n; k++) {
+      temp[k] = hotspot_vector(model);
+      /* initial guess for the temperature-leakage loop	*/
+      set_temp(model, temp[k], model->config->init_temp);
+  }
+
+  printf("Computing steady-state temperatures of %d power maps...\n", n);
+  steady_state_temp_batch(model, power, temp, n);
 
-  /* skip empty lines	*/
-  do {
-      /* read the entire line	*/
-      fgets(line, LINE_SIZE, fp);
-      if (feof(fp))
-        fatal("not enough names in trace file\n");
-      strcpy(temp, line);
-      src = strtok(temp, " \r\t\n");
-  } while (!src);
-
-  /* new line not read yet	*/
-  if(line[strlen(line)-1] != '\n')
-    fatal("line too long\n");
-
-  /* chop the names from the line read	*/
-  for(i=0,src=line; *src && i < MAX_UNITS; i++) {
-      if(!sscanf(src, "%s", names[i]))
-        fatal("invalid format of names\n");
-      src += strlen(names[i]);
-      while (isspace((int)*src))
-        src++;
-  }
-  if(*src && i == MAX_UNITS)
-    fatal("no. of units exceeded limit\n");
-
-  return i;
+  for(k=0; k < n; k++) {
+      sprintf(file, "%s.%d", prefix, k);
+      dump_temp(model, temp[k], file);
+      free_dvector(temp[k]);
+  }
+  free(temp);
 }
 
-/* read a single line of power trace numbers	*/
-int read_vals(FILE *fp, double *vals)
+/*
+ * permute a row of power numbers from the trace file order
+ * ('names') to the floorplan order of the grid model
+ */
+void trace_to_grid_vector(grid_model_t *model, char **names, double *vals, double *v)
 {
-  char line[LINE_SIZE], temp[LINE_SIZE], *src;
-  int i;
+  int i, j, idx, base, count;
 
-  /* skip empty lines	*/
-  do {
-      /* read the entire line	*/
-      fgets(line, LINE_SIZE, fp);
-      if (feof(fp))
-        return 0;
-      strcpy(temp, line);
-      src = strtok(temp, " \r\t\n");
-  } while (!src);
-
-  /* new line not read yet	*/
-  if(line[strlen(line)-1] != '\n')
-    fatal("line too long\n");
-
-  /* chop the power values from the line read	*/
-  for(i=0,src=line; *src && i < MAX_UNITS; i++) {
-      if(!sscanf(src, "%s", temp) || !sscanf(src, "%lf", &vals[i]))
-        fatal("invalid format of values\n");
-      src += strlen(temp);
-      while (isspace((int)*src))
-        src++;
-  }
-  if(*src && i == MAX_UNITS)
-    fatal("no. of entries exceeded limit\n");
-
-  return i;
+  for(i=0, base=0, count=0; i < model->n_layers; i++) {
+      if(model->layers[i].has_power) {
+          for(j=0; j < model->layers[i].flp->n_units; j++) {
+              idx = get_blk_index(model->layers[i].flp, names[count+j]);
+              v[base+idx] = vals[count+j];
+          }
+          count += model->layers[i].flp->n_units;
+      }
+      base += model->layers[i].flp->n_units;
+  }
 }
 
-/* write a single line of functional unit names	*/
-void write_names(FILE *fp, char **names, int size)
+/* and back	*/
+void grid_vector_to_trace(grid_model_t *model, char **names, double *v, double *vals)
 {
-  int i;
-  for(i=0; i < size-1; i++)
-    fprintf(fp, "%s\t", names[i]);
-  fprintf(fp, "%s\n", names[i]);
+  int i, j, idx, base, count;
+
+  for(i=0, base=0, count=0; i < model->n_layers; i++) {
+      if(model->layers[i].has_power) {
+          for(j=0; j < model->layers[i].flp->n_units; j++) {
+              idx = get_blk_index(model->layers[i].flp, names[count+j]);
+              vals[count+j] = v[base+idx];
+          }
+          count += model->layers[i].flp->n_units;
+      }
+      base += model->layers[i].flp->n_units;
+  }
 }
 
-/* write a single line of temperature trace	*/
-void write_vals(FILE *fp, double *vals, int size)
+/* the trace pipeline's callback: permute a row of power numbers	*/
+void permute_trace_row(trace_order_t *order, double *vals, double *power)
 {
   int i;
-  for(i=0; i < size-1; i++)
-    fprintf(fp, "%.2f\t", vals[i]);
-  fprintf(fp, "%.2f\n", vals[i]);
+
+  if (order->model->type == BLOCK_MODEL)
+    for(i=0; i < order->n; i++)
+      power[get_blk_index(order->flp, order->names[i])] = vals[i];
+  else
+    trace_to_grid_vector(order->model->grid, order->names, vals, power);
 }
 
-/* write a single line of power trace (in W)	*/
-void write_vals_power(FILE *fp, double *vals, int size)
+/*
+ * can the power numbers of a row be merged into the interval that
+ * starts with 'first'? each block may deviate from its power in the
+ * first row by 'tol' of the larger of the latter and the mean block
+ * power (so that idle blocks do not split the interval on noise)
+ */
+static int aggregate_fits(grid_model_t *model, double *first, double *power, double tol)
 {
   int i;
-  for(i=0; i < size-1; i++)
-    fprintf(fp, "%.2f\t", vals[i]);
-  fprintf(fp, "%.2f\n", vals[i]);
+  double mean = 0;
+
+  for(i=0; i < model->total_n_blocks; i++)
+    mean += fabs(first[i]);
+  mean /= model->total_n_blocks;
+  for(i=0; i < model->total_n_blocks; i++)
+    if (fabs(power[i] - first[i]) > tol * MAX(fabs(first[i]), mean))
+      return FALSE;
+  return TRUE;
 }
 
-char **alloc_names(int nr, int nc)
+/*
+ * transient simulation of all the power traces listed in the
+ * file 'list' as one ensemble sharing the grid model. all of
+ * them start from the block temperatures in 'init'. the
+ * temperature trace of the k-th one is written to '<prefix>.k'.
+ * the simulation stops at the end of the shortest trace
+ */
+void simulate_ensemble(RC_model_t *model, char *list, double *init, char *prefix, int n)
 {
-  int i;
-  char **m;
-
-  m = (char **) calloc (nr, sizeof(char *));
-  assert(m != NULL);
-  m[0] = (char *) calloc (nr * nc, sizeof(char));
-  assert(m[0] != NULL);
+  int s, k = 0, size = 0, num, lines = 0, done = FALSE;
+  char file[STR_SIZE+16];
+  char ***names = NULL;
+  FILE *fp, **pin = NULL, **tout = NULL;
+  double **power, *vals, *temp, start;
+  grid_ensemble_t *e;
+
+  if (model->type != GRID_MODEL)
+    fatal("-ensemble requires the grid model\n");
+  if (model->config->leakage_used)
+    fatal("-ensemble does not support the temperature-leakage loop\n");
+
+  /* open all the traces	*/
+  if (!(fp = fopen(list, "r")))
+    fatal("unable to open ensemble list file\n");
+  while (fscanf(fp, "%s", file) == 1) {
+      if (k == size) {
+          size = size ? 2 * size : 16;
+          pin = (FILE **) realloc(pin, size * sizeof(FILE *));
+          tout = (FILE **) realloc(tout, size * sizeof(FILE *));
+          names = (char ***) realloc(names, size * sizeof(char **));
+          if (!pin || !tout || !names)
+            fatal("memory allocation error\n");
+      }
+      if (!(pin[k] = fopen(file, "r")))
+        fatal("unable to open power trace input file\n");
+      names[k] = alloc_names(MAX_UNITS, STR_SIZE);
+      if(read_names(pin[k], names[k]) != n)
+        fatal("no. of units in floorplan and trace file differ\n");
+      sprintf(file, "%s.%d", prefix, k);
+      if (!(tout[k] = fopen(file, "w")))
+        fatal("unable to open temperature trace file for output\n");
+      write_names(tout[k], names[k], n);
+      k++;
+  }
+  fclose(fp);
+  if (!k)
+    fatal("no power traces in ensemble list file\n");
+
+  e = alloc_grid_ensemble(model->grid, k);
+  power = (double **) calloc(k, sizeof(double *));
+  if (!power)
+    fatal("memory allocation error\n");
+  for(s=0; s < k; s++) {
+      power[s] = hotspot_vector(model);
+      set_ensemble_temp(e, s, init);
+  }
+  vals = dvector(MAX_UNITS);
+  temp = hotspot_vector(model);
+
+  printf("Simulating an ensemble of %d power traces...\n", k);
+  while (!done) {
+      for(s=0; s < k && !done; s++) {
+          if ((num = read_vals(pin[s], vals)) == 0)
+            done = TRUE;
+          else if (num != n)
+            fatal("invalid trace file format\n");
+          else
+            trace_to_grid_vector(model->grid, names[s], vals, power[s]);
+      }
+      if (done)
+        break;
 
-  for (i = 1; i < nr; i++)
-    m[i] =  m[0] + nc * i;
+      compute_temp_ensemble(e, power, model->config->sampling_intvl);
 
-  return m;
-}
+      start = prof_begin();
+      for(s=0; s < k; s++) {
+          get_ensemble_temp(e, s, temp);
+          grid_vector_to_trace(model->grid, names[s], temp, vals);
+          write_vals(tout[s], vals, n);
+      }
+      prof_end(PROF_OUTPUT, start);
+      lines++;
+  }
+  if(!lines)
+    fatal("no power numbers in trace file\n");
 
-void free_names(char **m)
-{
-  free(m[0]);
-  free(m);
+  for(s=0; s < k; s++) {
+      fclose(pin[s]);
+      fclose(tout[s]);
+      free_names(names[s]);
+      free_dvector(power[s]);
+  }
+  free(pin);
+  free(tout);
+  free(names);
+  free(power);
+  free_dvector(vals);
+  free_dvector(temp);
+  delete_grid_ensemble(e);
 }
 
 void print_dashed_line(int length) {
@@ -525,10 +725,43 @@ void print_simulation_summary(thermal_config_t thermal_config, RC_model_t *model
  */
 int main(int argc, char **argv)
 {
-  int i, j, idx, base = 0, count = 0, n = 0, first_invocation;
-  void *mapped_region = NULL;
-  size_t mapped_size = 0;
+  int i, j, idx, base = 0, n = 0, first_invocation;
+  /* transient state handed over between ThermSniper invocations	*/
+  state_file_t *state = NULL;
   int num, size, lines = 0, do_transient = TRUE;
+  int do_batch = FALSE, batch_size = 0;
+  /* start of the run and of the timed phases	*/
+  double t_run = prof_now(), start;
+  /* pre-flight memory estimate per tag and in total	*/
+  double mem_estimate[MEM_N_TAGS], mem_total;
+  char mem_str[STR_SIZE];
+  /* power maps of all the rows for -steady_batch	*/
+  double **batch_power = NULL;
+  /* stages of the trace processing	*/
+  trace_pipe_t *pipe;
+  trace_row_t *row;
+  trace_order_t order;
+  /* rows merged into the current interval and their no.	*/
+  trace_row_t **group;
+  int k, agg_max = 1;
+  /* mean power of the interval and block temperatures at its start	*/
+  double *agg_power = NULL, *agg_prev = NULL;
+  /* streaming statistics of the temperatures and the grid layers they cover	*/
+  stats_t *stats = NULL;
+  int *stats_layers;
+  /* virtual sensors, their readings (at the end and the start of an
+   * interval and of a row in between) and output file
+   */
+  sensors_t *sensors = NULL;
+  double *sensor_vals = NULL, *sensor_prev = NULL, *sensor_row = NULL;
+  FILE *sout = NULL;
+  /* threshold events, their trip points and their state for ThermSniper	*/
+  events_t *events = NULL;
+  double trips[MAX_TRIPS], *event_vals;
+  int n_trips;
+  size_t aux_size;
+  /* latest temperatures for other processes	*/
+  snapshot_t *snapshot = NULL;
   char **names;
   double *vals;
   double *vals_withLeak;
@@ -556,6 +789,8 @@ int main(int argc, char **argv)
   str_pair table[MAX_ENTRIES];
   /* material properties */
   materials_list_t materials_list;
+  /* Monte Carlo variation study parameters	*/
+  variation_config_t variation_config;
 
   /* variables for natural convection iterations */
   int natural = 0;
@@ -574,6 +809,8 @@ int main(int argc, char **argv)
   printf("Parsing input files...\n");
   size = parse_cmdline(table, MAX_ENTRIES, argc, argv);
   global_config_from_strs(&global_config, table, size);
+  if (strcmp(global_config.profile_file, NULLFILE))
+    profile_start(t_run);
 
   /* Assemble vector with vdd information of cores */
   int length_v = strlen(volt_vector);
@@ -584,10 +821,19 @@ int main(int argc, char **argv)
       volt[j++] = 10 * (volt_vector[i] - '0') + (volt_vector[i+2] - '0');
   }
 
-  /* no transient simulation, only steady state	*/
-  if(!strcmp(global_config.t_outfile, NULLFILE))
+  /* no transient simulation, only steady state. a standalone run
+   * may simulate the transient only for its statistics, any run
+   * only for its sensor readings or threshold events
+   */
+  if(!strcmp(global_config.t_outfile, NULLFILE) &&
+     (!strcmp(global_config.stats_file, NULLFILE) || trace_num != -1) &&
+     !strcmp(global_config.sensor_out, NULLFILE) && !strcmp(global_config.event_file, NULLFILE))
     do_transient = FALSE;
 
+  /* one steady state solve per row of the power trace	*/
+  if(strcmp(global_config.steady_batch, NULLFILE))
+    do_batch = TRUE;
+
   /* read configuration file	*/
   if (strcmp(global_config.config, NULLFILE))
     size += read_str_pairs(&table[size], MAX_ENTRIES, global_config.config);
@@ -616,6 +862,8 @@ int main(int argc, char **argv)
   thermal_config = default_thermal_config();
   /* modify according to command line / config file	*/
   thermal_config_add_from_strs(&thermal_config, &materials_list, table, size);
+  variation_config = default_variation_config();
+  variation_config_add_from_strs(&variation_config, table, size);
 
   use_microchannels = global_config.use_microchannels;
   if(use_microchannels) {
@@ -645,6 +893,7 @@ int main(int argc, char **argv)
       size += thermal_config_to_strs(&thermal_config, &table[size], MAX_ENTRIES-size);
       if(use_microchannels)
         size += microchannel_config_to_strs(microchannel_config, &table[size], MAX_ENTRIES-size);
+      size += variation_config_to_strs(&variation_config, &table[size], MAX_ENTRIES-size);
       /* prefix the name of the variable with a '-'	*/
       dump_str_pairs(table, size, global_config.dump_config, "-");
   }
@@ -667,6 +916,27 @@ int main(int argc, char **argv)
     fatal("Either LCF or FLP file must be specified\n");
   }
 
+  /* estimate the memory footprint before allocating: the model and
+   * the unit names of one trace
+   */
+  mem_total = estimate_RC_model_memory(&thermal_config, flp, do_transient, mem_estimate);
+  mem_estimate[MEM_TRACE] += MAX_UNITS * (STR_SIZE + sizeof(char *));
+  mem_total += MAX_UNITS * (STR_SIZE + sizeof(char *));
+  printf("Estimated memory footprint: %.1f MB\n", mem_total / (1 << 20));
+  if (global_config.mem_limit > 0 && mem_total > global_config.mem_limit * (1 << 20)) {
+      sprintf(mem_str, "estimated memory of %.1f MB exceeds -mem_limit. by subsystem (MB):",
+              mem_total / (1 << 20));
+      for(i=0; i < MEM_N_TAGS; i++)
+        sprintf(mem_str + strlen(mem_str), " %s %.1f", mem_tag_names[i], mem_estimate[i] / (1 << 20));
+      strcat(mem_str, "\n");
+      fatal(mem_str);
+  }
+  if (profile.enabled)
+    for(i=0; i < MEM_N_TAGS; i++)
+      profile.mem_estimate[i] = mem_estimate[i];
+
+  prof_end(PROF_PARSE, t_run);
+
   //BU_3D: added do_detailed_3D to alloc_RC_model. Detailed 3D modeling can only be used with grid-level modeling.
   /* allocate and initialize the RC model	*/
   model = alloc_RC_model(&thermal_config, flp, microchannel_config, &materials_list, do_detailed_3D, use_microchannels);
@@ -705,7 +975,18 @@ int main(int argc, char **argv)
   /* using hotspot_vector to internally allocate any extra nodes needed	*/
   if (do_transient)
     model->grid->last_temp = hotspot_vector(model);
-  power = hotspot_vector(model);
+  /* with ThermSniper, the grid and block temperatures live in the
+   * state file, into which the model integrates in place. it has
+   * room for the state of the threshold events of all blocks too
+   */
+  if (do_transient && trace_num >= 0)
+    aux_size = events_state_size(model->grid->total_n_blocks, MAX_TRIPS);
+  if (do_transient && trace_num == 0)
+    state = create_state_file(model->grid, global_config.state_file, global_config.session,
+                              global_config.state_arena, aux_size);
+  else if (do_transient && trace_num > 0)
+    state = open_state_file(model->grid, global_config.state_file, global_config.session,
+                            global_config.state_arena, aux_size, trace_num - 1);
   power_withLeak = hotspot_vector(model); // TODO: only use if temperature leakage loop active
   overall_power = hotspot_vector(model);
 
@@ -736,11 +1017,39 @@ int main(int argc, char **argv)
   } else
     fatal("unknown model type\n");
 
+  /* an ensemble of power traces replaces the single trace	*/
+  if (strcmp(global_config.ensemble, NULLFILE)) {
+      if (!strcmp(global_config.t_outfile, NULLFILE))
+        fatal("-ensemble requires a temperature trace output file (-o)\n");
+      if (strcmp(global_config.stats_file, NULLFILE))
+        warning("-stats_file is not supported with -ensemble. ignored\n");
+      /* the ensemble always starts afresh	*/
+      if (strcmp(model->config->init_file, NULLFILE))
+        read_temp(model, model->grid->last_temp, model->config->init_file, model->config->dtm_used);
+      else
+        set_temp(model, model->grid->last_temp, model->config->init_temp);
+      simulate_ensemble(model, global_config.ensemble, model->grid->last_temp,
+                        global_config.t_outfile, n);
+
+      if(!model->grid->has_lcf)
+        free_flp(flp, FALSE, FALSE);
+      delete_RC_model(model);
+      free_materials(&materials_list);
+      free_microchannel(microchannel_config);
+      free_dvector(overall_power);
+      free_dvector(power_withLeak);
+      if (profile.enabled)
+        profile_report(global_config.profile_file);
+      printf("Simulation complete.\n");
+      return 0;
+  }
+
   if(!(pin = fopen(global_config.p_infile, "r")))
     fatal("unable to open power trace input file\n");
-  if(do_transient && !(tout = fopen(global_config.t_outfile, "a")))
+  if(do_transient && strcmp(global_config.t_outfile, NULLFILE) &&
+     !(tout = fopen(global_config.t_outfile, "a")))
     fatal("unable to open temperature trace file for output\n");
-  if(do_transient && model->config->leakage_used && !(pout_withLeak = fopen(global_config.pTot_outfile, "a")))
+  if(tout && model->config->leakage_used && !(pout_withLeak = fopen(global_config.pTot_outfile, "a")))
     fatal("unable to open trace file (total power with leakage) for output\n");
 
   /* names of functional units	*/
@@ -748,51 +1057,168 @@ int main(int argc, char **argv)
   if(read_names(pin, names) != n)
     fatal("no. of units in floorplan and trace file differ\n");
 
-  /* header lines of trace files and cleanup of old TRANS_TEMP_FILE */
+  /* header lines of trace files	*/
   if (trace_num<=0 && do_transient)
   {
     printf("Writing header of trace files...\n");
-    write_names(tout, names, n);
-    if(model->config->leakage_used) write_names(pout_withLeak, names, n);
-
-    if (trace_num==0)
-    {
-      if (access(TRANS_TEMP_FILE, F_OK) == 0) 
-      {
-          printf("Warning: Deleting detected obsolete file: %s\n", TRANS_TEMP_FILE);
-          if (unlink(TRANS_TEMP_FILE) != 0) {
-            fatal("Could not delete old transient temp data file\n");
-          }
-      }
+    if (tout) {
+      write_names(tout, names, n);
+      if(model->config->leakage_used) write_names(pout_withLeak, names, n);
     }
   }
-  else if(trace_num>0 && do_transient)
-  {
-    load_last_trans_temp_mmap(model->grid, TRANS_TEMP_FILE, &mapped_region, &mapped_size);
-  }
 
-  /* read the instantaneous power trace	*/
-  vals = dvector(MAX_UNITS);
-  vals_withLeak = dvector(MAX_UNITS);
-  while ((num=read_vals(pin, vals)) != 0) {
-      if(num != n)
+  /* read the instantaneous power trace. the rows come parsed and
+   * permuted to the floorplan order from the reader of the pipeline
+   */
+  order.model = model;
+  order.flp = flp;
+  order.names = names;
+  order.n = n;
+  if (model->type == BLOCK_MODEL)
+    num = model->block->n_nodes;
+  else
+    num = model->grid->total_n_blocks + EXTRA + (model->config->model_secondary ? EXTRA_SEC : 0);
+
+  /* merging of rows into longer intervals. in a standalone transient
+   * run only, as ThermSniper passes one row per invocation
+   */
+  if (global_config.aggregate_tolerance > 0) {
+      if (!do_transient || do_batch || trace_num != -1 || model->type != GRID_MODEL)
+        warning("-aggregate_tolerance applies to standalone transient runs of the grid model only. ignored\n");
+      else if (strcmp(model->config->grid_transient_file, NULLFILE))
+        fatal("-aggregate_tolerance cannot be used with -grid_transient_file\n");
+      else {
+          agg_max = global_config.aggregate_max;
+          agg_power = hotspot_vector(model);
+          agg_prev = dvector(n);
+      }
+  }
+  /* statistics of the temperatures, besides or instead of the traces	*/
+  if (strcmp(global_config.stats_file, NULLFILE)) {
+      if (!do_transient || trace_num != -1)
+        warning("-stats_file applies to standalone transient runs only. ignored\n");
+      else {
+          k = 0;
+          stats_layers = ivector(model->type == GRID_MODEL ? model->grid->n_layers : 1);
+          if (global_config.stats_grid && model->type == GRID_MODEL)
+            for(i=0; i < model->grid->n_layers; i++)
+              if (model->grid->layers[i].has_power)
+                stats_layers[k++] = i;
+          stats = alloc_stats(names, n, k, stats_layers,
+                              k ? model->grid->rows : 0, k ? model->grid->cols : 0,
+                              model->config->thermal_threshold, global_config.stats_cycle_gate);
+          free_ivector(stats_layers);
+      }
+  }
+  /* virtual sensors, read after every interval	*/
+  if (strcmp(global_config.sensor_file, NULLFILE)) {
+      if (model->type != GRID_MODEL)
+        fatal("-sensor_file requires the grid model\n");
+      sensors = read_sensors(model->grid, global_config.sensor_file);
+      sensor_vals = dvector(sensors->n);
+      sensor_prev = dvector(sensors->n);
+      sensor_row = dvector(sensors->n);
+      /* ThermSniper invocations after the first one append	*/
+      if (!(sout = fopen(global_config.sensor_out, (trace_num > 0) ? "ab" : "wb")))
+        fatal("unable to open sensor output file\n");
+      if (trace_num <= 0)
+        write_sensor_header(sout, sensors);
+      if (global_config.sensor_only) {
+          if (tout || stats || strcmp(global_config.event_file, NULLFILE) ||
+              model->config->leakage_used || natural)
+            fatal("-sensor_only cannot be used with -o, -stats_file, -event_file, the temperature-leakage loop or natural convection\n");
+          model->grid->skip_g2b = TRUE;
+      }
+  }
+  /* threshold events. the hysteresis state starts from the block
+   * temperatures or, in ThermSniper, carries over from the previous
+   * invocation
+   */
+  if (strcmp(global_config.event_file, NULLFILE)) {
+      if (model->type != GRID_MODEL)
+        fatal("-event_file requires the grid model\n");
+      if (strcmp(global_config.trip_points, NULLFILE))
+        n_trips = parse_trips(global_config.trip_points, trips);
+      else {
+          trips[0] = model->config->thermal_threshold;
+          n_trips = 1;
+      }
+      event_vals = dvector(n);
+      grid_vector_to_trace(model->grid, names, model->grid->last_temp, event_vals);
+      events = alloc_events(global_config.event_file, trace_num > 0, names, n, trips, n_trips,
+                            global_config.event_hysteresis, event_vals);
+      free_dvector(event_vals);
+      if (state && trace_num > 0 && !load_events_state(events, state_aux(state, &aux_size), aux_size))
+        warning("no event state of the previous invocation. starting from the temperatures\n");
+  }
+  /* temperatures for readers in other processes	*/
+  if (strcmp(global_config.snapshot_file, NULLFILE)) {
+      if (!do_transient || model->type != GRID_MODEL)
+        fatal("-snapshot_file requires a transient simulation with the grid model\n");
+      /* the block temperatures would be stale	*/
+      if (global_config.sensor_only)
+        fatal("-snapshot_file cannot be used with -sensor_only\n");
+      /* each invocation would recreate the mapping under its readers	*/
+      if (trace_num != -1)
+        fatal("-snapshot_file applies to standalone runs only\n");
+      snapshot = alloc_snapshot(model->grid, global_config.snapshot_file);
+  }
+  group = (trace_row_t **) calloc(agg_max, sizeof(trace_row_t *));
+  if (!group)
+    fatal("memory allocation error\n");
+
+  /* the solver holds the rows of an interval until it is done	*/
+  pipe = trace_pipe_start(pin, tout, (tout && model->config->leakage_used) ? pout_withLeak : NULL,
+                          n, num, global_config.pipeline_depth, agg_max,
+                          (permute_fn_ptr) permute_trace_row, &order);
+  row = trace_pipe_next(pipe);
+  while (row->num != 0) {
+      if(row->num != n) {
+        /* the rows before are written first	*/
+        trace_pipe_stop(pipe);
         fatal("invalid trace file format\n");
+      }
+      /* gather the following rows while their power stays close to
+       * that of the first one. the row that ends the interval (if
+       * read) starts the next one
+       */
+      group[0] = row;
+      k = 1;
+      while (k < agg_max && (row = trace_pipe_next(pipe))->num == n &&
+             aggregate_fits(model->grid, group[0]->power, row->power, global_config.aggregate_tolerance))
+        group[k++] = row;
+      for(j=0; j < k; j++)
+        group[j]->write = (tout != NULL);
+
+      power = group[0]->power;
+      vals = group[k-1]->vals;
+      vals_withLeak = group[k-1]->vals2;
+      /* the interval is simulated with the mean power of its rows	*/
+      if (k > 1) {
+          for(i=0; i < num; i++) {
+              agg_power[i] = 0;
+              for(j=0; j < k; j++)
+                agg_power[i] += group[j]->power[i];
+              agg_power[i] /= k;
+          }
+          power = agg_power;
+          /* temperatures at the start of the interval	*/
+          grid_vector_to_trace(model->grid, names, model->grid->last_temp, agg_prev);
+          if (sensors)
+            sensor_temps(sensors, model->grid->last_trans, sensor_prev);
+      }
 
-      /* permute the power numbers according to the floorplan order	*/
-      if (model->type == BLOCK_MODEL)
-        for(i=0; i < n; i++)
-          power[get_blk_index(flp, names[i])] = vals[i];
-      else
-        for(i=0, base=0, count=0; i < model->grid->n_layers; i++) {
-            if(model->grid->layers[i].has_power) {
-                for(j=0; j < model->grid->layers[i].flp->n_units; j++) {
-                    idx = get_blk_index(model->grid->layers[i].flp, names[count+j]);
-                    power[base+idx] = vals[count+j];
-                }
-                count += model->grid->layers[i].flp->n_units;
-            }
-            base += model->grid->layers[i].flp->n_units;
-        }
+      /* keep a copy of each row for the batched steady state solve	*/
+      if (do_batch) {
+          if (lines == batch_size) {
+              batch_size = batch_size ? 2 * batch_size : 16;
+              batch_power = (double **) realloc(batch_power, batch_size * sizeof(double *));
+              if (!batch_power)
+                fatal("memory allocation error\n");
+          }
+          batch_power[lines] = hotspot_vector(model);
+          copy_temp(model, batch_power[lines], power);
+      }
 
       /* compute temperature	*/
       if (do_transient) {
@@ -807,9 +1233,10 @@ int main(int argc, char **argv)
           if(trace_num==-1) printf("Computing temperatures for t = %e...\n", lines*model->config->sampling_intvl); //standalone run
           else printf("Computing temperatures for t = %e...\n", trace_num*model->config->sampling_intvl);
 
-          compute_temp(model, power, first_invocation, power_withLeak, model->config->sampling_intvl);
+          compute_temp(model, power, first_invocation, power_withLeak, k * model->config->sampling_intvl);
+
 
-        
+        start = prof_begin();
         // Print grid transient temperatures to file if one has been specified
         if(model->type == GRID_MODEL && strcmp(model->config->grid_transient_file, NULLFILE)) {
           dump_transient_temp_grid(model->grid, model->config->sampling_intvl, model->config->grid_transient_file);
@@ -817,61 +1244,119 @@ int main(int argc, char **argv)
           /* permute back to the trace file order	*/
           if (model->type == BLOCK_MODEL)
             fatal("HotSpot was run with block model. Incompatible with ThermSniper toolchain.\n");
-          else
-            for(i=0, base=0, count=0; i < model->grid->n_layers; i++) 
-            {
-                if(model->grid->layers[i].has_power) {
-                    for(j=0; j < model->grid->layers[i].flp->n_units; j++) {
-                        idx = get_blk_index(model->grid->layers[i].flp, names[count+j]);
-                        vals[count+j] = model->grid->last_temp[base+idx];
-                        if(model->config->leakage_used) vals_withLeak[count+j] = power_withLeak[base+idx];
-                    }
-                    count += model->grid->layers[i].flp->n_units;
+          else {
+            grid_vector_to_trace(model->grid, names, model->grid->last_temp, vals);
+            if(model->config->leakage_used)
+              grid_vector_to_trace(model->grid, names, power_withLeak, vals_withLeak);
+            /* linear in time back onto the rows of the interval	*/
+            for(j=0; j < k-1; j++)
+              for(i=0; i < n; i++) {
+                  group[j]->vals[i] = agg_prev[i] + (vals[i] - agg_prev[i]) * (j+1) / k;
+                  group[j]->vals2[i] = vals_withLeak[i];
+              }
+            if (stats) {
+                for(j=0; j < k; j++)
+                  stats_add_blocks(stats, group[j]->vals, model->config->sampling_intvl);
+                for(j=0; j < stats->n_layers; j++)
+                  stats_add_cells(stats, j, model->grid->last_trans->cuboid[stats->layers[j]][0],
+                                  k * model->config->sampling_intvl);
+            }
+            /* one reading per row, interpolated as the blocks	*/
+            if (sensors) {
+                sensor_temps(sensors, model->grid->last_trans, sensor_vals);
+                for(j=0; j < k-1; j++) {
+                    for(i=0; i < sensors->n; i++)
+                      sensor_row[i] = sensor_prev[i] + (sensor_vals[i] - sensor_prev[i]) * (j+1) / k;
+                    write_sensor_row(sout, sensors, (lines + j + 1) * model->config->sampling_intvl,
+                                     sensor_row);
                 }
-                base += model->grid->layers[i].flp->n_units;
+                write_sensor_row(sout, sensors, ((trace_num == -1) ? lines + k : trace_num + 1) *
+                                 model->config->sampling_intvl, sensor_vals);
             }
-          /* output instantaneous temperature trace	*/
-          write_vals(tout, vals, n);
-          /* output power values obtained if temperature leakage loop is employed */
-          if(model->config->leakage_used) write_vals_power(pout_withLeak, vals_withLeak, n);
+            if (events)
+              for(j=0; j < k; j++)
+                events_add(events, ((trace_num == -1) ? lines + j + 1 : trace_num + 1) *
+                           model->config->sampling_intvl, model->config->sampling_intvl, group[j]->vals);
+          }
+          prof_end(PROF_OUTPUT, start);
       }
 
       /* for computing average	*/
       if (model->type == BLOCK_MODEL)
         for(i=0; i < n; i++)
-          overall_power[i] += power[i];
+          overall_power[i] += k * power[i];
       else
         for(i=0, base=0; i < model->grid->n_layers; i++) {
             if(model->grid->layers[i].has_power)
               for(j=0; j < model->grid->layers[i].flp->n_units; j++)
               {
-                if(model->config->leakage_used) overall_power[base+j] += power_withLeak[base+j];
-                else overall_power[base+j] += power[base+j];
+                /* the variation study computes the leakage itself	*/
+                if(model->config->leakage_used && do_transient && !variation_config.mc_samples)
+                  overall_power[base+j] += k * power_withLeak[base+j];
+                else overall_power[base+j] += k * power[base+j];
               }
             base += model->grid->layers[i].flp->n_units;
         }
 
-      lines++;
+      /* the instantaneous temperature trace (and the power values of
+       * the temperature leakage loop) are written by the writer
+       */
+      for(j=0; j < k; j++)
+        trace_pipe_done(pipe, group[j]);
+      lines += k;
+      if (k == agg_max)
+        row = trace_pipe_next(pipe);
+  }
+  trace_pipe_stop(pipe);
+  free(group);
+  if (stats) {
+      stats_write(stats, global_config.stats_file);
+      free_stats(stats);
+  }
+  if (snapshot) {
+      model->grid->snapshot = NULL;
+      free_snapshot(snapshot);
+  }
+  if (events) {
+      /* committed with the temperatures below	*/
+      if (state)
+        save_events_state(events, state_aux(state, &aux_size), aux_size);
+      free_events(events);
+  }
+  if (sensors) {
+      fclose(sout);
+      free_sensors(sensors);
+      free_dvector(sensor_vals);
+      free_dvector(sensor_prev);
+      free_dvector(sensor_row);
+  }
+  if (agg_power) {
+      free_dvector(agg_power);
+      free_dvector(agg_prev);
   }
   if(!lines)
     fatal("no power numbers in trace file\n");
 
-  /* save transient temperature data for next ThermSniper HotSpot invocation */
-  if(trace_num==0)
-  {
-    int extra_nodes;
-    int model_secondary = model->config->model_secondary;
-    if (model_secondary)
-      extra_nodes = EXTRA + EXTRA_SEC;
-    else
-      extra_nodes = EXTRA;
-    save_last_trans_temp_mmap(model->grid, TRANS_TEMP_FILE, extra_nodes); 
+  if (do_batch) {
+      dump_steady_batch(model, batch_power, lines, global_config.steady_batch);
+      for(i=0; i < lines; i++)
+        free_dvector(batch_power[i]);
+      free(batch_power);
   }
-  else if(trace_num>0)
+
+  /* the rows of this invocation are out before its state is committed	*/
+  if (tout)
   {
-    flush_updated_last_trans_temp(mapped_region, mapped_size);
+    fclose(tout);
+    if(model->config->leakage_used) fclose(pout_withLeak);
   }
 
+  /* save transient temperature data for next ThermSniper HotSpot invocation */
+  start = prof_begin();
+  if (state)
+    commit_state_file(state, trace_num);
+  prof_end(PROF_OUTPUT, start);
+
   /* for computing average	*/
   if (model->type == BLOCK_MODEL)
     for(i=0; i < n; i++) {
@@ -887,6 +1372,12 @@ int main(int argc, char **argv)
           }
         base += model->grid->layers[i].flp->n_units;
     }
+
+  /* Monte Carlo variation study on the average power	*/
+  if (variation_config.mc_samples > 0)
+    run_variation(&variation_config, model->config, flp, microchannel_config, &materials_list,
+                  do_detailed_3D, use_microchannels, overall_power);
+
   // /* natural convection r_convec iteration, for steady-state only */ 
   // natural_convergence = 0;  
   // if (natural) { /* natural convection is used */  
@@ -937,25 +1428,20 @@ int main(int argc, char **argv)
 #endif
 
   /* cleanup	*/
-  if(trace_num>0) unload_last_trans_temp(mapped_region, mapped_size); 
+  if (state)
+    close_state_file(state, model->grid);
   fclose(pin);
-  if (do_transient)
-  {
-    fclose(tout);
-    if(model->config->leakage_used) fclose(pout_withLeak);
-  }
   if(!model->grid->has_lcf)
     free_flp(flp, FALSE, FALSE);
   delete_RC_model(model);
   free_materials(&materials_list);
   free_microchannel(microchannel_config);
-  free_dvector(power);
   free_dvector(overall_power);
   free_dvector(power_withLeak);
   free_names(names);
-  free_dvector(vals);
-  free_dvector(vals_withLeak);
 
+  if (profile.enabled)
+    profile_report(global_config.profile_file);
   printf("Simulation complete.\n");
   return 0;
 }
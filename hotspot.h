@@ -2,6 +2,12 @@
 #define __HOTSPOT_H_
 
 #include "util.h"
+#include "temperature.h"
+
+/* default max. no. of trace rows merged into one interval	*/
+#define AGGREGATE_MAX	64
+/* default hysteresis (in K) of the threshold events	*/
+#define EVENT_HYSTERESIS	1.0
 
 /* global configuration parameters for HotSpot	*/
 typedef struct global_config_t_st
@@ -20,6 +26,45 @@ typedef struct global_config_t_st
 	char config[STR_SIZE];
 	/* output configuration parameters to file	*/
 	char dump_config[STR_SIZE];
+	/* prefix of the per-row steady state temperature files	*/
+	char steady_batch[STR_SIZE];
+	/* list of power trace files simulated as one ensemble	*/
+	char ensemble[STR_SIZE];
+	/* JSON profiling report at exit	*/
+	char profile_file[STR_SIZE];
+	/* refuse to run if the estimated memory exceeds this (in MB, 0 for no limit)	*/
+	double mem_limit;
+	/* rows the trace pipeline works ahead of the solver (0 for no threads)	*/
+	int pipeline_depth;
+	/* max. relative power deviation of the rows merged into one interval (0 for none)	*/
+	double aggregate_tolerance;
+	/* max. no. of rows merged into one interval	*/
+	int aggregate_max;
+	/* summary of the temperature statistics (see stats.h)	*/
+	char stats_file[STR_SIZE];
+	/* statistics of the grid cells of the power dissipating layers too?	*/
+	int stats_grid;
+	/* min. swing (in K) of a thermal cycle	*/
+	double stats_cycle_gate;
+	/* virtual sensors (see sensor.h) and the binary file of their readings	*/
+	char sensor_file[STR_SIZE];
+	char sensor_out[STR_SIZE];
+	/* only the sensors are read: skip the grid to block mapping	*/
+	int sensor_only;
+	/* threshold events (see events.h): output file, comma separated
+	 * trip points (thermal_threshold if none) and their hysteresis (K)
+	 */
+	char event_file[STR_SIZE];
+	char trip_points[STR_SIZE];
+	double event_hysteresis;
+	/* shared file mapping of the latest temperatures (see snapshot.h)	*/
+	char snapshot_file[STR_SIZE];
+	/* state handed over between ThermSniper invocations (see state.h):
+	 * the file, the id of the session and the arena shared by sessions
+	 */
+	char state_file[STR_SIZE];
+	char session[STR_SIZE];
+	char state_arena[STR_SIZE];
 	/* input microchannel configuration file */
 	int use_microchannels;
 
@@ -40,4 +85,16 @@ void global_config_from_strs(global_config_t *config, str_pair *table, int size)
  */
 int global_config_to_strs(global_config_t *config, str_pair *table, int max_entries);
 
+/* the model's order of the rows of a power trace	*/
+typedef struct trace_order_t_st
+{
+	RC_model_t *model;
+	flp_t *flp;
+	/* names in the trace file order	*/
+	char **names;
+	int n;
+}trace_order_t;
+/* permute 'vals' from the trace file order into 'power'	*/
+void permute_trace_row(trace_order_t *order, double *vals, double *power);
+
 #endif
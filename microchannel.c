@@ -259,6 +259,7 @@ void microchannel_build_network(microchannel_config_t *config) {
   char line[MAX_LINE_SIZE], str[STR_SIZE];
   char *cell;
   int cell_type, i = 0, j = 0;
+  mem_tag_t tag = mem_set_tag(MEM_UCHAN);
   FILE *fp = fopen(config->network_file, "r");
 
   if(DEBUG)
@@ -277,14 +278,14 @@ void microchannel_build_network(microchannel_config_t *config) {
   if(DEBUG)
     fprintf(stderr, "num_rows: %d, num_cols: %d\n", nr, nc);
 
-  config->cell_types = calloc(nr, sizeof(int *));
+  config->cell_types = tcalloc(nr, sizeof(int *));
 
   if (config->cell_types == NULL) {
     fprintf(stderr, "ERROR: Couldn't allocate space for cell_types array");
   }
 
   for(i = 0; i < nr; i++) {
-    config->cell_types[i] = calloc(nc, sizeof(int));
+    config->cell_types[i] = tcalloc(nc, sizeof(int));
 
     if (config->cell_types[i] == NULL) {
       fprintf(stderr, "ERROR: Couldn't allocate space for cell_types[%d] array", i);
@@ -356,6 +357,7 @@ void microchannel_build_network(microchannel_config_t *config) {
   build_pressure_matrix(config);
   printf("Solving pressure circuit...\n");
   solve_pressure_circuit(config);
+  mem_set_tag(tag);
 }
 
 double hydroC(microchannel_config_t *config) {
@@ -375,6 +377,31 @@ double hydroC(microchannel_config_t *config) {
   return ret_val;
 }
 
+int count_fluid_cells(char *network_file) {
+  char line[MAX_LINE_SIZE], str[STR_SIZE];
+  char *cell;
+  int cell_type, n = 0;
+  FILE *fp = fopen(network_file, "r");
+
+  if(!fp) {
+    strncpy(str, "Unable to open ", STR_SIZE);
+    strncat(str, network_file, STR_SIZE - strlen(str));
+    strncat(str, "\n", STR_SIZE - strlen(str));
+    fatal(str);
+  }
+
+  while(fgets(line, MAX_LINE_SIZE, fp)) {
+    for(cell = strtok(line, " ,\n"); cell; cell = strtok(NULL, " ,\n")) {
+      cell_type = atoi(cell);
+      if(cell_type == FLUID || cell_type == INLET || cell_type == OUTLET)
+        n++;
+    }
+  }
+
+  fclose(fp);
+  return n;
+}
+
 void build_pressure_matrix(microchannel_config_t *config) {
   int i, j;
   int nr = config->num_rows;
@@ -383,13 +410,13 @@ void build_pressure_matrix(microchannel_config_t *config) {
   int n = 0;
   config->nnz = 0;
 
-  mapping = calloc(nr, sizeof(int *));
+  mapping = tcalloc(nr, sizeof(int *));
 
   if(mapping == NULL)
     fatal("Unable to allocate pressure circuit mapping\n");
 
   for(i = 0; i < nr; i++) {
-    mapping[i] = calloc(nc, sizeof(int));
+    mapping[i] = tcalloc(nc, sizeof(int));
 
     if(mapping[i] == NULL) {
       fatal("Unable to allocate pressure circuit mapping\n");
@@ -417,18 +444,18 @@ void build_pressure_matrix(microchannel_config_t *config) {
     extra_pressure_nodes = 1;
   }
 
-  config->A = calloc(config->n_fluid_cells + extra_pressure_nodes, sizeof(double *));
+  config->A = tcalloc(config->n_fluid_cells + extra_pressure_nodes, sizeof(double *));
 
   if(!config->A)
     fatal("Unable to allocate matrix A for pressure circuit\n");
   for(i = 0; i < config->n_fluid_cells + extra_pressure_nodes; i++) {
-    config->A[i] = calloc(config->n_fluid_cells, sizeof(double));
+    config->A[i] = tcalloc(config->n_fluid_cells, sizeof(double));
 
     if(!config->A[i])
       fatal("Unable to allocate matrix A for pressure circuit\n");
   }
 
-  config->b = calloc(config->n_fluid_cells + extra_pressure_nodes, sizeof(double));
+  config->b = tcalloc(config->n_fluid_cells + extra_pressure_nodes, sizeof(double));
 
   if(!config->b)
     fatal("Unable to allocate matrix b for pressure circuit\n");
@@ -588,27 +615,27 @@ void free_microchannel(microchannel_config_t *config) {
   if(config) {
     if(config->cell_types) {
       for(i = 0; i < config->num_rows; i++) {
-        free(config->cell_types[i]);
+        tfree(config->cell_types[i]);
       }
-      free(config->cell_types);
+      tfree(config->cell_types);
     }
 
     if(config->A) {
       for(i = 0; i < config->n_fluid_cells; i++) {
-        free(config->A[i]);
+        tfree(config->A[i]);
       }
-      free(config->A);
+      tfree(config->A);
     }
 
     if(config->b) {
-      free(config->b);
+      tfree(config->b);
     }
 
     if(config->mapping) {
       for(i = 0; i < config->num_rows; i++) {
-        free(config->mapping[i]);
+        tfree(config->mapping[i]);
       }
-      free(config->mapping);
+      tfree(config->mapping);
     }
 
     free(config);
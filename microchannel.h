@@ -94,6 +94,8 @@ void microchannel_config_add_from_strs(microchannel_config_t *config, materials_
 int microchannel_config_to_strs(microchannel_config_t *config, str_pair *table, int max_entries);
 void microchannel_build_network(microchannel_config_t *config);
 void build_pressure_matrix(microchannel_config_t *config);
+// number of fluid, inlet and outlet cells in a network file
+int count_fluid_cells(char *network_file);
 double flow_rate(microchannel_config_t *config, int cell1_i, int cell1_j, int cell2_i, int cell2_j);
 void copy_microchannel(microchannel_config_t *src, microchannel_config_t *dst);
 void free_microchannel(microchannel_config_t * config);
@@ -263,43 +263,46 @@ int NPE_swap_cut_unit(NPE_t *expr, int pos)
 	return TRUE;
 }
 
-/* make a random move out of the above	*/
-NPE_t *make_random_move(NPE_t *expr)
+/* make a random move out of the above, in place	*/
+void NPE_random_move(NPE_t *expr, rand_state_t *rng, NPE_move_t *move)
 {
-	int i, move, count = 0, done = FALSE, m3_count;
-	NPE_t *copy = NPE_duplicate(expr);
+	int i, count = 0, done = FALSE, m3_count;
 
 	while (!done && count < MAX_MOVES) {
 		/* choose one of three moves	*/
-		move = rand_upto(3);
-		switch(move) {
+		move->type = rand_upto_r(rng, 3);
+		switch(move->type) {
 			case 0:	/* swap adjacent units	*/
 				/* leave the unit last in the NPE	*/
-				i = rand_upto(expr->n_units-1);
+				i = rand_upto_r(rng, expr->n_units-1);
+				move->pos = expr->unit_pos[i];
 				#if VERBOSE > 2
-				fprintf(stdout, "making M1 at %d\n", expr->unit_pos[i]);
+				fprintf(stdout, "making M1 at %d\n", move->pos);
 				#endif
-				NPE_swap_units(copy, expr->unit_pos[i]);
+				NPE_swap_units(expr, move->pos);
 				done = TRUE;
 				break;
 
 			case 1:	/* invert an arbitrary chain	*/
-				i = rand_upto(expr->n_chains);
+				i = rand_upto_r(rng, expr->n_chains);
+				move->pos = expr->chain_pos[i];
 				#if VERBOSE > 2
-				fprintf(stdout, "making M2 at %d\n", expr->chain_pos[i]);
+				fprintf(stdout, "making M2 at %d\n", move->pos);
 				#endif
-				NPE_invert_chain(copy, expr->chain_pos[i]);
+				NPE_invert_chain(expr, move->pos);
 				done = TRUE;
 				break;
 
 			case 2:	/* swap a unit and an adjacent cut_type	*/
 				m3_count = 0; 
 				while (!done && m3_count < MAX_MOVES) {
-					i = rand_upto(expr->n_flips);
+					i = rand_upto_r(rng, expr->n_flips);
+					move->pos = expr->flip_pos[i];
 					#if VERBOSE > 2
-					fprintf(stdout, "making M3 at %d\n", expr->flip_pos[i]);
+					fprintf(stdout, "making M3 at %d\n", move->pos);
 					#endif
-					done = NPE_swap_cut_unit(copy, expr->flip_pos[i]);
+					/* illegal swaps leave expr untouched	*/
+					done = NPE_swap_cut_unit(expr, move->pos);
 					m3_count++;
 				}
 				break;
@@ -316,7 +319,37 @@ NPE_t *make_random_move(NPE_t *expr)
 		sprintf(msg, "tried %d moves, now giving up\n", MAX_MOVES); 
 		fatal(msg);
 	}
+}
+
+/* 
+ * all three moves are their own inverses when 
+ * made again at the same position
+ */
+void NPE_undo_move(NPE_t *expr, NPE_move_t *move)
+{
+	switch(move->type) {
+		case 0:
+			NPE_swap_units(expr, move->pos);
+			break;
+		case 1:
+			NPE_invert_chain(expr, move->pos);
+			break;
+		case 2:
+			if (!NPE_swap_cut_unit(expr, move->pos))
+				fatal("unable to undo NPE move\n");
+			break;
+		default:
+			fatal("unknown move type\n");
+			break;
+	}
+}
 
+/* make a random move out of the above	*/
+NPE_t *make_random_move(NPE_t *expr, rand_state_t *rng)
+{
+	NPE_move_t move;
+	NPE_t *copy = NPE_duplicate(expr);
+	NPE_random_move(copy, rng, &move);
 	return copy;
 }
 
@@ -355,3 +388,17 @@ NPE_t *NPE_duplicate(NPE_t *expr)
 	return copy;
 }
 
+/* copy 'src' into 'dst' (of the same size)	*/
+void NPE_copy(NPE_t *dst, NPE_t *src)
+{
+	if (dst->size != src->size)
+		fatal("NPE sizes do not match\n");
+	memcpy(dst->elements, src->elements, src->size * sizeof(int));
+	dst->n_units = src->n_units;
+	memcpy(dst->unit_pos, src->unit_pos, src->n_units * sizeof(int));
+	dst->n_flips = src->n_flips;
+	memcpy(dst->flip_pos, src->flip_pos, src->n_flips * sizeof(int));
+	dst->n_chains = src->n_chains;
+	memcpy(dst->chain_pos, src->chain_pos, src->n_chains * sizeof(int));
+	memcpy(dst->ballot_count, src->ballot_count, src->size * sizeof(int));
+}
@@ -29,6 +29,15 @@ typedef struct NPE_t_st
 	int *ballot_count;
 }NPE_t;
 
+/* an NPE move - for undoing it	*/
+typedef struct NPE_move_t_st
+{
+	/* M1, M2 or M3 (0, 1 or 2)	*/
+	int type;
+	/* position in the NPE where it was made	*/
+	int pos;
+}NPE_move_t;
+
 /* NPE routines	*/
 
 /* the starting solution for simulated annealing	*/
@@ -46,9 +55,17 @@ void NPE_swap_units(NPE_t *expr, int pos);
 void NPE_invert_chain(NPE_t *expr, int pos);
 /* move M3 - swap adjacent cut_type and unit in the NPE	*/
 int NPE_swap_cut_unit(NPE_t *expr, int pos);
-/* make a random move out of the above	*/
-NPE_t *make_random_move(NPE_t *expr);
+/* make a random move out of the above, drawing from 'rng'	*/
+NPE_t *make_random_move(NPE_t *expr, rand_state_t *rng);
+/* 
+ * same as above but in place. the move made is returned
+ * in 'move' so that it can be undone
+ */
+void NPE_random_move(NPE_t *expr, rand_state_t *rng, NPE_move_t *move);
+void NPE_undo_move(NPE_t *expr, NPE_move_t *move);
 /* make a copy of this NPE	*/
 NPE_t *NPE_duplicate(NPE_t *expr);
+/* copy 'src' into 'dst' (of the same size)	*/
+void NPE_copy(NPE_t *dst, NPE_t *src);
 
 #endif
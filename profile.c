@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "profile.h"
+#include "util.h"
+
+profile_t profile;
+
+static const char *phase_names[PROF_N_PHASES] = {
+	"parse", "alloc", "populate_R", "populate_C", "xlate_b2g",
+	"integrate", "solve", "xlate_g2b", "leakage", "output"
+};
+
+double prof_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+void prof_end(prof_phase_t phase, double start)
+{
+	if (!profile.enabled)
+		return;
+	profile.phase_time[phase] += prof_now() - start;
+	profile.phase_calls[phase]++;
+}
+
+void prof_step(double h)
+{
+	int bin;
+
+	if (!profile.enabled)
+		return;
+	profile.steps_accepted++;
+	bin = (h > 0) ? (int) floor(log10(h)) - PROF_STEP_MIN_EXP : 0;
+	profile.step_hist[MID3(0, bin, PROF_STEP_BINS-1)]++;
+}
+
+void profile_start(double start)
+{
+	memset(&profile, 0, sizeof(profile_t));
+	profile.enabled = TRUE;
+	profile.start = start;
+	mem_track(TRUE);
+}
+
+void profile_report(char *file)
+{
+	FILE *fp = stdout;
+	int i;
+	long long cur, peak;
+	double estimate = 0;
+	struct rusage usage;
+
+	if (strcmp(file, "stdout") && !(fp = fopen(file, "w")))
+		fatal("unable to open profile file for output\n");
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"wall_seconds\": %.6f,\n", prof_now() - profile.start);
+	/* in kilobytes on linux	*/
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(fp, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+	fprintf(fp, "  \"phases\": {\n");
+	for(i=0; i < PROF_N_PHASES; i++)
+		fprintf(fp, "    \"%s\": {\"calls\": %ld, \"seconds\": %.6f}%s\n", phase_names[i],
+				profile.phase_calls[i], profile.phase_time[i],
+				(i < PROF_N_PHASES-1) ? "," : "");
+	fprintf(fp, "  },\n");
+	fprintf(fp, "  \"transient\": {\n");
+	fprintf(fp, "    \"slope_evals\": %ld,\n", profile.slope_evals);
+	fprintf(fp, "    \"steps_accepted\": %ld,\n", profile.steps_accepted);
+	fprintf(fp, "    \"steps_rejected\": %ld,\n", profile.steps_rejected);
+	fprintf(fp, "    \"intervals_skipped\": %ld,\n", profile.intervals_skipped);
+	fprintf(fp, "    \"step_size_histogram\": {");
+	for(i=0; i < PROF_STEP_BINS; i++)
+		fprintf(fp, "\"1e%d\": %ld%s", i + PROF_STEP_MIN_EXP, profile.step_hist[i],
+				(i < PROF_STEP_BINS-1) ? ", " : "");
+	fprintf(fp, "}\n");
+	fprintf(fp, "  },\n");
+	fprintf(fp, "  \"steady\": {\"calls\": %ld, \"iterations\": %ld},\n",
+			profile.solver_calls, profile.solver_iters);
+	fprintf(fp, "  \"leakage\": {\"iterations\": %ld},\n", profile.leakage_iters);
+	fprintf(fp, "  \"allocations\": {\"count\": %ld, \"bytes\": %lld},\n",
+			profile.allocs, profile.alloc_bytes);
+	/* tracked bytes per subsystem against the pre-flight estimate	*/
+	for(i=0; i < MEM_N_TAGS; i++)
+		estimate += profile.mem_estimate[i];
+	mem_usage(MEM_N_TAGS, &cur, &peak);
+	fprintf(fp, "  \"memory\": {\n");
+	fprintf(fp, "    \"current_bytes\": %lld, \"peak_bytes\": %lld, \"estimate_bytes\": %.0f,\n",
+			cur, peak, estimate);
+	fprintf(fp, "    \"tags\": {\n");
+	for(i=0; i < MEM_N_TAGS; i++) {
+		mem_usage(i, &cur, &peak);
+		fprintf(fp, "      \"%s\": {\"current_bytes\": %lld, \"peak_bytes\": %lld, \"estimate_bytes\": %.0f}%s\n",
+				mem_tag_names[i], cur, peak, profile.mem_estimate[i], (i < MEM_N_TAGS-1) ? "," : "");
+	}
+	fprintf(fp, "    }\n");
+	fprintf(fp, "  }\n");
+	fprintf(fp, "}\n");
+
+	if (fp != stdout)
+		fclose(fp);
+}
@@ -0,0 +1,78 @@
+#ifndef __PROFILE_H_
+#define __PROFILE_H_
+
+#include "util.h"
+
+/*
+ * run-time profiling of the simulator. when enabled (-profile_file),
+ * the phases below are timed with a monotonic clock and the solvers
+ * count their work. the report is written as JSON at exit. when
+ * disabled, the cost is a test of 'profile.enabled' per probe. the
+ * counters are not atomic. with worker threads (e.g. -mc_threads),
+ * they are approximate. profiling also turns on the memory accounting
+ * of util.c (see mem_track).
+ */
+
+/* timed phases	*/
+typedef enum prof_phase_t_en
+{
+	PROF_PARSE,			/* command line, config and floorplan files	*/
+	PROF_ALLOC,			/* alloc_RC_model	*/
+	PROF_POPULATE_R,	/* populate_R_model	*/
+	PROF_POPULATE_C,	/* populate_C_model	*/
+	PROF_B2G,			/* xlate_vector_b2g	*/
+	PROF_INTEGRATE,		/* transient solver	*/
+	PROF_SOLVE,			/* steady state linear solver	*/
+	PROF_G2B,			/* xlate_temp_g2b	*/
+	PROF_LEAKAGE,		/* leakage and tuning power evaluation	*/
+	PROF_OUTPUT,		/* writing of the traces and state	*/
+	PROF_N_PHASES
+}prof_phase_t;
+
+/* step sizes are binned by decade from 10^PROF_STEP_MIN_EXP s upwards	*/
+#define PROF_STEP_MIN_EXP	-12
+#define PROF_STEP_BINS		13
+
+typedef struct profile_t_st
+{
+	int enabled;
+	/* time of profile_start	*/
+	double start;
+	double phase_time[PROF_N_PHASES];
+	long phase_calls[PROF_N_PHASES];
+	/* transient solver	*/
+	long slope_evals;
+	long steps_accepted, steps_rejected;
+	long step_hist[PROF_STEP_BINS];
+	/* intervals answered by the steady state (see quiet_tolerance)	*/
+	long intervals_skipped;
+	/* steady state solver (iterations are Gauss-Seidel sweeps)	*/
+	long solver_calls, solver_iters;
+	/* temperature-leakage loop	*/
+	long leakage_iters;
+	/* allocations through tcalloc (incl. the vectors and matrices of util.c)	*/
+	long allocs;
+	long long alloc_bytes;
+	/* pre-flight memory estimate per tag	*/
+	double mem_estimate[MEM_N_TAGS];
+}profile_t;
+
+extern profile_t profile;
+
+/* monotonic time in seconds	*/
+double prof_now(void);
+/* start of a timed region. no clock read when disabled	*/
+#define prof_begin()	(profile.enabled ? prof_now() : 0.0)
+/* end of a timed region started at 'start'	*/
+void prof_end(prof_phase_t phase, double start);
+/* counting	*/
+#define PROF_COUNT(field, n)	do { if (profile.enabled) profile.field += (n); } while(0)
+/* record an accepted step of size 'h'	*/
+void prof_step(double h);
+
+/* enable profiling. 'start' is the time the run began	*/
+void profile_start(double start);
+/* write the JSON report to 'file' (stdout for "stdout")	*/
+void profile_report(char *file);
+
+#endif
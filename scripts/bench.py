@@ -0,0 +1,182 @@
+#!/usr/bin/python3
+
+import argparse
+import csv
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+usage = """
+Benchmark suite of HotSpot on synthetic chips (see hotgen).
+
+For every no. of cores, no. of layers, grid size and HotSpot binary
+(backend), it times a steady state solve of one power map and a
+transient simulation of a power trace, using -profile_file. Each row
+of the CSV output has the time per grid cell per step (per solve for
+the steady state), the peak RSS and the max. block temperature error
+against the run with the largest grid size (the reference). The
+transient simulation of each grid size starts from its own steady
+state of the power map (-init_file), so that its error at the end of
+the trace includes that of the discretization rather than only the
+few steps from a uniform initial temperature.
+"""
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+# the grid model adds the spreader and the sink to the chip layers
+PACK_LAYERS = 2
+# without an LCF, the chip is a silicon layer and an interface layer
+DEFAULT_CHIP_LAYERS = 2
+
+FIELDS = ["backend", "mode", "cores", "layers", "rows", "cols", "cells", "seconds",
+          "steps", "ns_per_cell_step", "peak_rss_kb", "max_err"]
+
+
+def int_list(s):
+  return [int(x) for x in s.split(",")]
+
+
+def run(cmd, cwd):
+  res = subprocess.run(cmd, cwd=cwd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                       universal_newlines=True)
+  if res.returncode:
+    sys.exit(f"command failed: {' '.join(cmd)}\n{res.stderr}")
+
+
+def generate(hotgen, work, cores, layers, steps, activity, seed):
+  """
+  synthetic chip. returns the input options of hotspot, the no. of
+  chip layers and the prefix of the power traces
+  """
+  base = f"c{cores}_l{layers}"
+  flps = []
+  for k in range(max(1, (layers + 1) // 2)):
+    flp = f"c{cores}_p{k}.flp"
+    run([hotgen, "-type", "flp", "-cores", str(cores), "-prefix", f"p{k}_", "-o", flp], work)
+    flps.append(flp)
+  for name, n in (("steady", 1), ("trace", steps)):
+    run([hotgen, "-type", "ptrace", "-flp", ",".join(flps), "-steps", str(n),
+         "-activity", str(activity), "-seed", str(seed), "-o", f"{base}.{name}.ptrace"], work)
+  if layers <= 1:
+    return ["-f", flps[0]], DEFAULT_CHIP_LAYERS, base
+  lcf = f"{base}.lcf"
+  run([hotgen, "-type", "lcf", "-layers", str(layers), "-flp", ",".join(flps), "-o", lcf], work)
+  return ["-grid_layer_file", lcf], layers, base
+
+
+def read_steady(file):
+  temps = {}
+  with open(file) as fp:
+    for line in fp:
+      f = line.split()
+      if len(f) == 2 and not f[0].startswith("inode_"):
+        temps[f[0]] = float(f[1])
+  return temps
+
+
+def read_last_row(file):
+  with open(file) as fp:
+    lines = [l.split() for l in fp if l.strip()]
+  return dict(zip(lines[0], map(float, lines[-1])))
+
+
+def max_err(temps, ref):
+  common = set(temps) & set(ref)
+  return max(abs(temps[k] - ref[k]) for k in common) if common else float("nan")
+
+
+def bench_one(hotspot, work, inputs, base, prefix, mode, size, sampling_intvl):
+  prof = os.path.join(work, f"{prefix}.json")
+  grid = [hotspot, "-model_type", "grid", "-grid_rows", str(size), "-grid_cols", str(size)] + inputs
+  cmd = grid + ["-profile_file", prof]
+  if mode == "steady":
+    out = f"{prefix}.steady"
+    cmd += ["-p", f"{base}.steady.ptrace", "-steady_batch", out]
+    run(cmd, work)
+    temps = read_steady(os.path.join(work, out + ".0"))
+  else:
+    out = os.path.join(work, f"{prefix}.ttrace")
+    if os.path.exists(out):
+      os.remove(out)
+    # initial temperatures, not timed
+    run(grid + ["-p", f"{base}.steady.ptrace", "-steady_batch", f"{prefix}.init"], work)
+    cmd += ["-p", f"{base}.trace.ptrace", "-init_file", f"{prefix}.init.0", "-o", out]
+    if sampling_intvl:
+      cmd += ["-sampling_intvl", str(sampling_intvl)]
+    run(cmd, work)
+    temps = read_last_row(out)
+  with open(prof) as fp:
+    return temps, json.load(fp)
+
+
+def main():
+  parser = argparse.ArgumentParser(description=usage, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument("--hotspot", action="append",
+                      help="<label>=<binary> of a backend to time (repeatable, default ./hotspot)")
+  parser.add_argument("--hotgen", default=os.path.join(ROOT, "hotgen"))
+  parser.add_argument("--sizes", type=int_list, default=[64, 128, 256],
+                      help="grid sizes, powers of two (e.g. 64,128,256,512,1024)")
+  parser.add_argument("--cores", type=int_list, default=[4, 16], help="perfect squares")
+  parser.add_argument("--layers", type=int_list, default=[1, 4],
+                      help="1 for a single floorplan, else no. of layers of an LCF")
+  parser.add_argument("--modes", default="steady,transient")
+  parser.add_argument("--steps", type=int, default=10, help="rows of the transient trace")
+  parser.add_argument("--sampling_intvl", type=float,
+                      help="seconds per row of the transient trace (default of hotspot)")
+  parser.add_argument("--activity", type=float, default=0.2)
+  parser.add_argument("--seed", type=int, default=1)
+  parser.add_argument("--work", help="keep the inputs and outputs in this directory")
+  parser.add_argument("-o", "--output", default="bench.csv")
+  args = parser.parse_args()
+
+  backends = [b.split("=", 1) if "=" in b else ["default", b]
+              for b in (args.hotspot or [os.path.join(ROOT, "hotspot")])]
+  sizes = sorted(set(args.sizes))
+  work = args.work or tempfile.mkdtemp(prefix="hotspot-bench-")
+  os.makedirs(work, exist_ok=True)
+
+  with open(args.output, "w", newline="") as fp:
+    out = csv.DictWriter(fp, fieldnames=FIELDS)
+    out.writeheader()
+    for cores in args.cores:
+      for layers in args.layers:
+        inputs, chip_layers, base = generate(os.path.abspath(args.hotgen), work, cores, layers,
+                                       args.steps, args.activity, args.seed)
+        for label, hotspot in backends:
+          for mode in args.modes.split(","):
+            rows = []
+            for size in sizes:
+              prefix = f"{label}_{mode}_c{cores}_l{layers}_g{size}"
+              print(f"{prefix}...", flush=True)
+              temps, prof = bench_one(os.path.abspath(hotspot), work, inputs, base, prefix, mode, size,
+                                    args.sampling_intvl)
+              cells = size * size * (chip_layers + PACK_LAYERS)
+              if mode == "steady":
+                seconds = prof["phases"]["solve"]["seconds"]
+                steps = prof["steady"]["calls"]
+              else:
+                seconds = prof["phases"]["integrate"]["seconds"]
+                steps = prof["transient"]["steps_accepted"]
+              rows.append((temps, {
+                "backend": label, "mode": mode, "cores": cores, "layers": layers,
+                "rows": size, "cols": size, "cells": cells, "seconds": f"{seconds:.6f}",
+                "steps": steps,
+                "ns_per_cell_step": f"{seconds * 1e9 / (cells * max(steps, 1)):.3f}",
+                "peak_rss_kb": prof["peak_rss_kb"]}))
+            # the finest grid is the reference
+            ref = rows[-1][0]
+            for temps, row in rows:
+              row["max_err"] = f"{max_err(temps, ref):.3f}"
+              out.writerow(row)
+            fp.flush()
+
+  if not args.work:
+    shutil.rmtree(work)
+  print(f"results written to {args.output}")
+
+
+if __name__ == "__main__":
+  main()
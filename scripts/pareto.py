@@ -0,0 +1,207 @@
+#!/usr/bin/python3
+
+import argparse
+import csv
+import json
+import math
+import os
+import shutil
+import sys
+import tempfile
+
+from bench import ROOT, int_list, run, generate, read_last_row
+
+usage = """
+Accuracy versus speed of HotSpot's transient simulation.
+
+Runs the same workload for every combination of HotSpot binary
+(backend), grid size and RK4 tolerance, and compares the block and grid
+temperatures with those of a reference run (finer grid, tighter
+tolerance, first backend). Reports the max./RMS errors over the whole
+trace, the error of the peak temperature and of the time at which a
+block first reaches the threshold, and the run time. The configurations
+on the Pareto front of run time versus max. block error are marked, as
+is the cheapest one within the error budget.
+
+The workload is either given (--flp or --lcf, --ptrace and optionally
+--config) or a synthetic chip from hotgen.
+"""
+
+FIELDS = ["backend", "rows", "cols", "rk4_tolerance", "seconds", "block_max_err",
+          "block_rms_err", "peak_err", "ttt_err", "grid_max_err", "grid_rms_err", "pareto"]
+
+
+def float_list(s):
+  return [float(x) for x in s.split(",")]
+
+
+def read_trace(file):
+  """block temperatures of every row of a temperature trace"""
+  with open(file) as fp:
+    lines = [l.split() for l in fp if l.strip()]
+  return lines[0], [list(map(float, l)) for l in lines[1:]]
+
+
+def read_grid_last(file):
+  """grid temperatures of the last step of a grid transient file, per layer"""
+  layers, cur = {}, None
+  with open(file) as fp:
+    for line in fp:
+      if line.startswith("t ="):
+        layers = {}
+      elif line.startswith("Layer"):
+        cur = layers.setdefault(int(line.split()[1][:-1]), [])
+      elif line.strip():
+        cur.append(float(line.split()[1]))
+  return layers
+
+
+def time_to_threshold(rows, intvl, threshold):
+  """time at which the hottest block first reaches 'threshold'. None if never"""
+  prev = None
+  for k, row in enumerate(rows):
+    peak = max(row)
+    if peak >= threshold:
+      if prev is None or peak == prev:
+        return (k + 1) * intvl
+      # linear interpolation within the interval
+      return (k + (threshold - prev) / (peak - prev)) * intvl
+    prev = peak
+  return None
+
+
+def compare_blocks(names, rows, ref_names, ref_rows):
+  idx = [ref_names.index(n) for n in names]
+  diffs = [r[j] - ref[idx[j]] for r, ref in zip(rows, ref_rows) for j in range(len(names))]
+  return max(map(abs, diffs)), math.sqrt(sum(d * d for d in diffs) / len(diffs))
+
+
+def compare_grids(grid, size, ref, ref_size):
+  """the coarse grid is sampled at the centers of the cells of the reference"""
+  diffs = []
+  for l in ref:
+    for i in range(ref_size):
+      for j in range(ref_size):
+        ci, cj = i * size // ref_size, j * size // ref_size
+        diffs.append(grid[l][ci * size + cj] - ref[l][i * ref_size + j])
+  return max(map(abs, diffs)), math.sqrt(sum(d * d for d in diffs) / len(diffs))
+
+
+def simulate(hotspot, work, inputs, size, tol, prefix):
+  ttrace = os.path.join(work, f"{prefix}.ttrace")
+  gtrace = os.path.join(work, f"{prefix}.grid.ttrace")
+  prof = os.path.join(work, f"{prefix}.json")
+  for f in (ttrace, gtrace):
+    if os.path.exists(f):
+      os.remove(f)
+  print(f"{prefix}...", flush=True)
+  run([hotspot, "-model_type", "grid", "-grid_rows", str(size), "-grid_cols", str(size),
+       "-rk4_tolerance", str(tol), "-o", ttrace, "-grid_transient_file", gtrace,
+       "-profile_file", prof] + inputs, work)
+  with open(prof) as fp:
+    seconds = json.load(fp)["wall_seconds"]
+  names, rows = read_trace(ttrace)
+  return names, rows, read_grid_last(gtrace), seconds
+
+
+def main():
+  parser = argparse.ArgumentParser(description=usage, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument("--hotspot", action="append",
+                      help="<label>=<binary> of a backend (repeatable, default ./hotspot)")
+  parser.add_argument("--hotgen", default=os.path.join(ROOT, "hotgen"))
+  parser.add_argument("--sizes", type=int_list, default=[16, 32, 64])
+  parser.add_argument("--tolerances", type=float_list, default=[0.01, 0.1])
+  parser.add_argument("--ref-size", type=int, default=128)
+  parser.add_argument("--ref-tol", type=float, default=1e-4)
+  parser.add_argument("--budget", type=float, default=0.5, help="max. block error allowed (K)")
+  parser.add_argument("--threshold", type=float,
+                      help="temperature (K) for the time to threshold. default: midway to the "
+                           "reference peak")
+  parser.add_argument("--flp")
+  parser.add_argument("--lcf")
+  parser.add_argument("--ptrace")
+  parser.add_argument("--config")
+  parser.add_argument("--cores", type=int, default=4)
+  parser.add_argument("--layers", type=int, default=1)
+  parser.add_argument("--steps", type=int, default=20)
+  parser.add_argument("--activity", type=float, default=0.2)
+  parser.add_argument("--seed", type=int, default=1)
+  parser.add_argument("--sampling-intvl", type=float, default=5e-4)
+  parser.add_argument("--work", help="keep the inputs and outputs in this directory")
+  parser.add_argument("-o", "--output", default="pareto.csv")
+  args = parser.parse_args()
+
+  backends = [b.split("=", 1) if "=" in b else ["default", b]
+              for b in (args.hotspot or [os.path.join(ROOT, "hotspot")])]
+  work = args.work or tempfile.mkdtemp(prefix="hotspot-pareto-")
+  os.makedirs(work, exist_ok=True)
+
+  if args.ptrace:
+    if not (args.flp or args.lcf):
+      sys.exit("--ptrace requires --flp or --lcf")
+    inputs = ["-p", os.path.abspath(args.ptrace)]
+    inputs += ["-grid_layer_file", os.path.abspath(args.lcf)] if args.lcf else ["-f", os.path.abspath(args.flp)]
+    if args.config:
+      inputs += ["-c", os.path.abspath(args.config)]
+  else:
+    inputs, _, base = generate(os.path.abspath(args.hotgen), work, args.cores, args.layers,
+                               args.steps, args.activity, args.seed)
+    inputs += ["-p", f"{base}.trace.ptrace"]
+  inputs += ["-sampling_intvl", str(args.sampling_intvl)]
+
+  ref_names, ref_rows, ref_grid, _ = simulate(os.path.abspath(backends[0][1]), work, inputs,
+                                              args.ref_size, args.ref_tol, "reference")
+  ref_peak = max(map(max, ref_rows))
+  threshold = args.threshold or (min(ref_rows[0]) + ref_peak) / 2
+  ref_ttt = time_to_threshold(ref_rows, args.sampling_intvl, threshold)
+
+  results = []
+  for label, hotspot in backends:
+    for size in args.sizes:
+      for tol in args.tolerances:
+        names, rows, grid, seconds = simulate(os.path.abspath(hotspot), work, inputs, size, tol,
+                                              f"{label}_g{size}_t{tol}")
+        bmax, brms = compare_blocks(names, rows, ref_names, ref_rows)
+        gmax, grms = compare_grids(grid, size, ref_grid, args.ref_size)
+        ttt = time_to_threshold(rows, args.sampling_intvl, threshold)
+        if ttt is None or ref_ttt is None:
+          ttt_err = 0.0 if ttt == ref_ttt else float("inf")
+        else:
+          ttt_err = abs(ttt - ref_ttt)
+        results.append({"backend": label, "rows": size, "cols": size, "rk4_tolerance": tol,
+                        "seconds": seconds, "block_max_err": bmax, "block_rms_err": brms,
+                        "peak_err": abs(max(map(max, rows)) - ref_peak), "ttt_err": ttt_err,
+                        "grid_max_err": gmax, "grid_rms_err": grms})
+
+  # non-dominated in (run time, max. block error)
+  for r in results:
+    r["pareto"] = int(not any(o["seconds"] <= r["seconds"] and o["block_max_err"] <= r["block_max_err"] and
+                              (o["seconds"] < r["seconds"] or o["block_max_err"] < r["block_max_err"])
+                              for o in results))
+
+  with open(args.output, "w", newline="") as fp:
+    out = csv.DictWriter(fp, fieldnames=FIELDS)
+    out.writeheader()
+    for r in results:
+      out.writerow({k: (f"{v:.6g}" if isinstance(v, float) else v) for k, v in r.items()})
+
+  print(f"threshold {threshold:.2f} K, reached at {ref_ttt} s in the reference")
+  print("pareto front (seconds, max. block error):")
+  for r in sorted((r for r in results if r["pareto"]), key=lambda r: r["seconds"]):
+    print(f"  {r['backend']} {r['rows']}x{r['cols']} tol {r['rk4_tolerance']}: "
+          f"{r['seconds']:.3f} s, {r['block_max_err']:.3f} K")
+  ok = [r for r in results if r["block_max_err"] <= args.budget]
+  if ok:
+    r = min(ok, key=lambda r: r["seconds"])
+    print(f"cheapest within {args.budget} K: {r['backend']} {r['rows']}x{r['cols']} "
+          f"tol {r['rk4_tolerance']} ({r['seconds']:.3f} s)")
+  else:
+    print(f"no configuration is within {args.budget} K")
+
+  if not args.work:
+    shutil.rmtree(work)
+  print(f"results written to {args.output}")
+
+
+if __name__ == "__main__":
+  main()
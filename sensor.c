@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensor.h"
+#include "temperature_grid.h"
+#include "util.h"
+
+/* grid line below 'f' (in cells) and the fraction towards the next one	*/
+static void bracket(double f, int size, int *lo, double *frac)
+{
+	f = MID3(0, f, size - 1);
+	*lo = MIN((int) floor(f), MAX(size - 2, 0));
+	*frac = (size > 1) ? f - *lo : 0;
+}
+
+/* bilinear interpolation between the centres of the four nearest cells	*/
+static void resolve_point(grid_model_t *model, sensor_t *s)
+{
+	int i, j, k = 0, di, dj;
+	double cw = model->width / model->cols, ch = model->height / model->rows;
+	double fi, fj, wi, wj;
+
+	/* row 0 is at the top of the chip	*/
+	bracket((model->height - s->y) / ch - 0.5, model->rows, &i, &fi);
+	bracket(s->x / cw - 0.5, model->cols, &j, &fj);
+	s->n = 4;
+	s->idx = (int *) tcalloc(4, sizeof(int));
+	s->w = (double *) tcalloc(4, sizeof(double));
+	for(di=0; di < 2; di++)
+		for(dj=0; dj < 2; dj++) {
+			wi = di ? fi : 1 - fi;
+			wj = dj ? fj : 1 - fj;
+			s->idx[k] = (s->layer * model->rows + MIN(i + di, model->rows - 1)) * model->cols +
+						MIN(j + dj, model->cols - 1);
+			s->w[k++] = wi * wj;
+		}
+}
+
+/* average over the cells under the footprint, weighted by the overlap	*/
+static void resolve_footprint(grid_model_t *model, sensor_t *s)
+{
+	int i, j, i1, i2, j1, j2, k = 0;
+	double cw = model->width / model->cols, ch = model->height / model->rows;
+	double l, r, b, t, ox, oy, total = 0;
+
+	l = MAX(s->x - s->width / 2, 0);
+	r = MIN(s->x + s->width / 2, model->width);
+	b = MAX(s->y - s->height / 2, 0);
+	t = MIN(s->y + s->height / 2, model->height);
+	if (r <= l || t <= b)
+		fatal("sensor footprint outside the chip\n");
+	j1 = MAX((int) floor(l / cw), 0);
+	j2 = MIN((int) ceil(r / cw), model->cols);
+	i1 = MAX(model->rows - (int) ceil(t / ch), 0);
+	i2 = MIN(model->rows - (int) floor(b / ch), model->rows);
+
+	s->idx = (int *) tcalloc((i2 - i1) * (j2 - j1), sizeof(int));
+	s->w = (double *) tcalloc((i2 - i1) * (j2 - j1), sizeof(double));
+	for(i=i1; i < i2; i++)
+		for(j=j1; j < j2; j++) {
+			ox = MIN(r, (j + 1) * cw) - MAX(l, j * cw);
+			oy = MIN(t, model->height - i * ch) - MAX(b, model->height - (i + 1) * ch);
+			if (ox <= 0 || oy <= 0)
+				continue;
+			s->idx[k] = (s->layer * model->rows + i) * model->cols + j;
+			s->w[k] = ox * oy;
+			total += s->w[k++];
+		}
+	s->n = k;
+	for(k=0; k < s->n; k++)
+		s->w[k] /= total;
+}
+
+sensors_t *read_sensors(grid_model_t *model, char *file)
+{
+	char str[LINE_SIZE], copy[LINE_SIZE], msg[STR_SIZE + 64];
+	char *ptr;
+	int i, size = 0;
+	sensor_t *s;
+	sensors_t *list;
+	FILE *fp;
+	mem_tag_t tag;
+
+	if (!(fp = fopen(file, "r"))) {
+		sprintf(msg, "error: %s could not be opened for reading\n", file);
+		fatal(msg);
+	}
+	list = (sensors_t *) calloc(1, sizeof(sensors_t));
+	if (!list)
+		fatal("memory allocation error\n");
+	while (fgets(str, LINE_SIZE, fp)) {
+		strcpy(copy, str);
+		/* ignore comments and empty lines	*/
+		ptr = strtok(str, " \r\t\n");
+		if (!ptr || ptr[0] == '#')
+			continue;
+		if (list->n == size) {
+			size = size ? 2 * size : 16;
+			list->s = (sensor_t *) realloc(list->s, size * sizeof(sensor_t));
+			if (!list->s)
+				fatal("memory allocation error\n");
+		}
+		s = &list->s[list->n++];
+		memset(s, 0, sizeof(sensor_t));
+		i = sscanf(copy, "%s%d%lf%lf%lf%lf", s->name, &s->layer, &s->x, &s->y,
+				   &s->width, &s->height);
+		if ((i != 4 && i != 6) || s->width < 0 || s->height < 0)
+			fatal("invalid sensor file format\n");
+		if (s->layer < 0 || s->layer >= model->n_layers)
+			fatal("sensor layer out of range\n");
+		if (s->x < 0 || s->x > model->width || s->y < 0 || s->y > model->height)
+			fatal("sensor position outside the chip\n");
+	}
+	fclose(fp);
+	if (!list->n)
+		fatal("no sensors in sensor file\n");
+
+	tag = mem_set_tag(MEM_MAP);
+	for(i=0; i < list->n; i++) {
+		s = &list->s[i];
+		if (s->width > 0 && s->height > 0)
+			resolve_footprint(model, s);
+		else
+			resolve_point(model, s);
+	}
+	mem_set_tag(tag);
+	return list;
+}
+
+void free_sensors(sensors_t *list)
+{
+	int i;
+
+	for(i=0; i < list->n; i++) {
+		tfree(list->s[i].idx);
+		tfree(list->s[i].w);
+	}
+	free(list->s);
+	free(list);
+}
+
+void sensor_temps(sensors_t *list, grid_model_vector_t *v, double *temp)
+{
+	int i, k;
+	double *cells = v->cuboid[0][0];
+	sensor_t *s;
+
+	for(i=0; i < list->n; i++) {
+		s = &list->s[i];
+		temp[i] = 0;
+		for(k=0; k < s->n; k++)
+			temp[i] += s->w[k] * cells[s->idx[k]];
+	}
+}
+
+void write_sensor_header(FILE *fp, sensors_t *list)
+{
+	int i;
+
+	fwrite(SENSOR_MAGIC, 1, strlen(SENSOR_MAGIC), fp);
+	fwrite(&list->n, sizeof(int), 1, fp);
+	for(i=0; i < list->n; i++)
+		fwrite(list->s[i].name, 1, strlen(list->s[i].name) + 1, fp);
+}
+
+void write_sensor_row(FILE *fp, sensors_t *list, double time, double *temp)
+{
+	int i;
+	float f;
+
+	fwrite(&time, sizeof(double), 1, fp);
+	for(i=0; i < list->n; i++) {
+		f = (float) temp[i];
+		fwrite(&f, sizeof(float), 1, fp);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef __SENSOR_H_
+#define __SENSOR_H_
+
+#include <stdio.h>
+
+#include "temperature_grid.h"
+#include "util.h"
+
+/*
+ * virtual thermal sensors of the grid model. each sensor sits at a
+ * point of a layer or averages a rectangular footprint around it.
+ * the positions are resolved only once into grid cell indices and
+ * weights (bilinear between the four nearest cell centres for a
+ * point, overlap area for a footprint), so that a reading costs a
+ * handful of multiply-adds instead of a full grid-to-block mapping.
+ *
+ * sensor file format: one sensor per line,
+ * <name> <layer> <x> <y> [<width> <height>]
+ * with the position of the centre (in m) from the bottom-left
+ * corner of the chip and the layer numbered as in the grid model
+ * (0 is the first layer of the LCF). '#' starts a comment line
+ */
+typedef struct sensor_t_st
+{
+	char name[STR_SIZE];
+	int layer;
+	double x, y, width, height;
+	/* cells read (indices into the layers of the grid) and their weights	*/
+	int n;
+	int *idx;
+	double *w;
+}sensor_t;
+
+typedef struct sensors_t_st
+{
+	int n;
+	sensor_t *s;
+}sensors_t;
+
+/* read the sensors in 'file' and resolve them against the grid of 'model'	*/
+sensors_t *read_sensors(grid_model_t *model, char *file);
+void free_sensors(sensors_t *s);
+/* readings of all the sensors from the grid temperatures 'v'	*/
+void sensor_temps(sensors_t *s, grid_model_vector_t *v, double *temp);
+
+/*
+ * compact binary output: the magic "HSNS", the no. of sensors
+ * (int) and their NUL-terminated names, then per interval the
+ * time (double, in s) and the readings (float, in K)
+ */
+#define SENSOR_MAGIC	"HSNS"
+void write_sensor_header(FILE *fp, sensors_t *s);
+void write_sensor_row(FILE *fp, sensors_t *s, double time, double *temp);
+
+#endif
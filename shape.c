@@ -121,21 +121,15 @@ void print_shape(shape_t *shape)
 	fprintf(stdout, "\n");	
 }
 
-/* shape curve arithmetic	*/
-shape_t *shape_add(shape_t *shape1, shape_t *shape2, int cut_type)
+/* no. of entries in the sum of two shape curves	*/
+static int shape_add_size(shape_t *shape1, shape_t *shape2, int cut_type)
 {
-	int i=0, j=0, k=0, total=0, m, n;
-	shape_t *sum;
-
-	sum = (shape_t *) calloc(1, sizeof(shape_t));
-	if (!sum)
-		fatal("memory allocation error\n");
+	int i=0, j=0, total=0, m, n;
 
 	/* shortcuts	*/	
 	m = shape1->size;
 	n = shape2->size;
 
-	/* determine result size	*/
 	while(i < m && j < n) {
 		if (cut_type == CUT_VERTICAL) {
 			if (shape1->y[i] >= shape2->y[j])
@@ -150,18 +144,19 @@ shape_t *shape_add(shape_t *shape1, shape_t *shape2, int cut_type)
 		}
 		total++;
 	}
+	return total;
+}
 
-	sum->x = (double *) calloc(total, sizeof(double));
-	sum->y = (double *) calloc(total, sizeof(double));
-	sum->left_pos = (int *) calloc(total, sizeof(int));
-	sum->right_pos = (int *) calloc(total, sizeof(int));
-	sum->median = (double *) calloc(total, sizeof(double));
-	if (!sum->x || !sum->y || !sum->left_pos || 
-	    !sum->right_pos || !sum->median)
-		fatal("memory allocation error\n");
-	sum->size = total;	
+/* fill 'sum' (of the right size) with the sum of two shape curves	*/
+static void shape_add_fill(shape_t *sum, shape_t *shape1, shape_t *shape2,
+						   int cut_type)
+{
+	int i=0, j=0, k=0, total = sum->size, m, n;
+
+	/* shortcuts	*/	
+	m = shape1->size;
+	n = shape2->size;
 
-	i=j=0;
 	while(i < m && j < n) {
 		/* vertical add	*/
 		if (cut_type == CUT_VERTICAL) {
@@ -193,7 +188,109 @@ shape_t *shape_add(shape_t *shape1, shape_t *shape2, int cut_type)
 		}
 		k++;
 	}
+}
+
+/* shape curve arithmetic	*/
+shape_t *shape_add(shape_t *shape1, shape_t *shape2, int cut_type)
+{
+	int total;
+	shape_t *sum;
+
+	sum = (shape_t *) calloc(1, sizeof(shape_t));
+	if (!sum)
+		fatal("memory allocation error\n");
+
+	/* determine result size	*/
+	total = shape_add_size(shape1, shape2, cut_type);
+
+	sum->x = (double *) calloc(total, sizeof(double));
+	sum->y = (double *) calloc(total, sizeof(double));
+	sum->left_pos = (int *) calloc(total, sizeof(int));
+	sum->right_pos = (int *) calloc(total, sizeof(int));
+	sum->median = (double *) calloc(total, sizeof(double));
+	if (!sum->x || !sum->y || !sum->left_pos || 
+	    !sum->right_pos || !sum->median)
+		fatal("memory allocation error\n");
+	sum->size = total;	
+
+	shape_add_fill(sum, shape1, shape2, cut_type);
+	return sum;
+}
+
+/* shape pool routines	*/
+
+/* constructor	*/
+shape_pool_t *new_shape_pool(void)
+{
+	shape_pool_t *pool = (shape_pool_t *) calloc(1, sizeof(shape_pool_t));
+	if (!pool)
+		fatal("memory allocation error\n");
+	return pool;
+}
+
+/* destructor - frees the curves in the free lists	*/
+void free_shape_pool(shape_pool_t *pool)
+{
+	int b;
+	shape_t *shape;
+	for(b=0; b < SHAPE_POOL_BUCKETS; b++)
+		while ((shape = pool->free_list[b])) {
+			pool->free_list[b] = shape->next;
+			free(shape);
+		}
+	free(pool);
+}
+
+/* bucket of the smallest capacity that can hold 'size' entries	*/
+static int shape_pool_bucket(int size)
+{
+	int b = 0;
+	while ((1 << b) < size)
+		b++;
+	if (b >= SHAPE_POOL_BUCKETS)
+		fatal("shape curve too large for the shape pool\n");
+	return b;
+}
+
+/* a curve of 'size' entries from the pool	*/
+static shape_t *shape_pool_get(shape_pool_t *pool, int size)
+{
+	int b = shape_pool_bucket(size), cap = 1 << b;
+	shape_t *shape = pool->free_list[b];
+
+	if (shape) {
+		pool->free_list[b] = shape->next;
+	} else {
+		/* header followed by the doubles and then the ints	*/
+		char *block = (char *) malloc(sizeof(shape_t) + 
+									  cap * (3 * sizeof(double) + 2 * sizeof(int)));
+		if (!block)
+			fatal("memory allocation error\n");
+		shape = (shape_t *) block;
+		shape->capacity = cap;
+		shape->x = (double *) (block + sizeof(shape_t));
+		shape->y = shape->x + cap;
+		shape->median = shape->y + cap;
+		shape->left_pos = (int *) (shape->median + cap);
+		shape->right_pos = shape->left_pos + cap;
+	}
+	shape->next = NULL;
+	shape->size = size;
+	return shape;
+}
 
+void shape_pool_put(shape_pool_t *pool, shape_t *shape)
+{
+	int b = shape_pool_bucket(shape->capacity);
+	shape->next = pool->free_list[b];
+	pool->free_list[b] = shape;
+}
+
+shape_t *shape_add_pooled(shape_pool_t *pool, shape_t *shape1,
+						  shape_t *shape2, int cut_type)
+{
+	shape_t *sum = shape_pool_get(pool, shape_add_size(shape1, shape2, cut_type));
+	shape_add_fill(sum, shape1, shape2, cut_type);
 	return sum;
 }
 
@@ -401,9 +498,14 @@ int min_area_pos(shape_t *curve)
  * the added up shape curves. 'pos' denotes the current
  * added up orientation. 'leftx' & 'bottomy' denote the
  * left and bottom ends of the current bounding rectangle
+ * and 'width' & 'height' its size, which could be larger
+ * than the orientation's when a dead block has been
+ * compacted into it. the shape curves are left untouched
+ * so that the tree can be reused
  */
 int recursive_sizing (tree_node_t *node, int pos, 
 					   double leftx, double bottomy,
+					   double width, double height,
 					   int dead_count, int compact_dead,
 					   double compact_ratio,
 #if VERBOSE > 1					   
@@ -416,8 +518,8 @@ int recursive_sizing (tree_node_t *node, int pos,
 
 	/* leaf node. fill the placeholder	*/
 	if (node->label.unit >= 0) {
-		flp->units[node->label.unit].width = self->x[pos];
-		flp->units[node->label.unit].height = self->y[pos];
+		flp->units[node->label.unit].width = width;
+		flp->units[node->label.unit].height = height;
 		flp->units[node->label.unit].leftx = leftx;
 		flp->units[node->label.unit].bottomy = bottomy;
 	} else {
@@ -430,6 +532,7 @@ int recursive_sizing (tree_node_t *node, int pos,
 		/* location of the first dead block	+ offset */
 		idx = (flp->n_units + 1) / 2 + dead_count;
 
+		/* bounding rectangles of the children	*/
 		x1 = left->x[self->left_pos[pos]];
 		x2 = right->x[self->right_pos[pos]];
 		y1 = left->y[self->left_pos[pos]];
@@ -441,16 +544,13 @@ int recursive_sizing (tree_node_t *node, int pos,
 			 * if a dead block has been previously compacted away from this
 			 * bounding rectangle, absorb that area into the child also
 			 */
-			if(self->y[pos] > MAX(y1, y2)) {
-				left->y[self->left_pos[pos]] += (self->y[pos] - MAX(y1, y2));
-				right->y[self->right_pos[pos]] += (self->y[pos] - MAX(y1, y2));
-				y1 = left->y[self->left_pos[pos]];
-				y2 = right->y[self->right_pos[pos]];
-			}	
-			if(self->x[pos] > (x1+x2)) {
-				right->x[self->right_pos[pos]] += self->x[pos]-(x1+x2);
-				x2 = right->x[self->right_pos[pos]];
+			if(height > MAX(y1, y2)) {
+				double delta = height - MAX(y1, y2);
+				y1 += delta;
+				y2 += delta;
 			}	
+			if(width > (x1+x2))
+				x2 = width - x1;
 
 			flp->units[idx].width = (y2 >= y1) ? x1 : x2;
 			flp->units[idx].height = fabs(y2 - y1);
@@ -467,39 +567,37 @@ int recursive_sizing (tree_node_t *node, int pos,
 				*compacted_area += (flp->units[idx].width * flp->units[idx].height);
 				#endif
 				if (y2 >= y1) 
-					left->y[self->left_pos[pos]] = y2;
+					y1 = y2;
 				else
-					right->y[self->right_pos[pos]] = y1;
+					y2 = y1;
 			} else {
 				dead_count++;
 			}
 
 			/* left and bottom don't change for the left child	*/
 			dead_count = recursive_sizing(node->left, self->left_pos[pos],
-										 leftx, bottomy, dead_count, compact_dead, 
-										 compact_ratio,
+										 leftx, bottomy, x1, y1, dead_count,
+										 compact_dead, compact_ratio,
 			#if VERBOSE > 1
 										 compacted_area,
 			#endif
 										 flp);
 			dead_count = recursive_sizing(node->right, self->right_pos[pos],
 										 leftx + self->median[pos], bottomy, 
-										 dead_count, compact_dead, compact_ratio,
+										 x2, y2, dead_count, compact_dead,
+										 compact_ratio,
 			#if VERBOSE > 1
 										 compacted_area,
 			#endif
 										 flp);
 		} else {
-			if(self->x[pos] > MAX(x1, x2)) {
-				left->x[self->left_pos[pos]] += (self->x[pos] - MAX(x1, x2));
-				right->x[self->right_pos[pos]] += (self->x[pos] - MAX(x1, x2));
-				x1 = left->x[self->left_pos[pos]];
-				x2 = right->x[self->right_pos[pos]];
-			}	
-			if(self->y[pos] > (y1+y2)) {
-				right->y[self->right_pos[pos]] += self->y[pos]-(y1+y2);
-				y2 = right->y[self->right_pos[pos]];
+			if(width > MAX(x1, x2)) {
+				double delta = width - MAX(x1, x2);
+				x1 += delta;
+				x2 += delta;
 			}	
+			if(height > (y1+y2))
+				y2 = height - y1;
 
 			flp->units[idx].width = fabs(x2 - x1);
 			flp->units[idx].height = (x2 >= x1) ? y1 : y2;
@@ -511,24 +609,25 @@ int recursive_sizing (tree_node_t *node, int pos,
 				*compacted_area += (flp->units[idx].width * flp->units[idx].height);
 				#endif
 				if (x2 >= x1) 
-					left->x[self->left_pos[pos]] = x2;
+					x1 = x2;
 				else
-					right->x[self->right_pos[pos]] = x1;
+					x2 = x1;
 			} else {
 				dead_count++;
 			}
 
 			/* left and bottom don't change for the left child	*/
 			dead_count = recursive_sizing(node->left, self->left_pos[pos],
-										 leftx, bottomy, dead_count, compact_dead, 
-										 compact_ratio,
+										 leftx, bottomy, x1, y1, dead_count,
+										 compact_dead, compact_ratio,
 			#if VERBOSE > 1
 										 compacted_area,
 			#endif
 										 flp);
 			dead_count = recursive_sizing(node->right, self->right_pos[pos],
 							 			 leftx, bottomy + self->median[pos], 
-										 dead_count, compact_dead, compact_ratio,
+										 x2, y2, dead_count, compact_dead,
+										 compact_ratio,
 			#if VERBOSE > 1
 										 compacted_area,
 			#endif
@@ -553,8 +652,9 @@ int tree_to_flp(tree_node_t *root, flp_t *flp, int compact_dead,
 	#if VERBOSE > 1									  
 	double compacted_area = 0.0;
 	#endif								  
-	int dead_count = recursive_sizing(root, pos, 0.0, 0.0, 0, 
-					 				  compact_dead, compact_ratio,
+	int dead_count = recursive_sizing(root, pos, 0.0, 0.0,
+									  root->curve->x[pos], root->curve->y[pos],
+									  0, compact_dead, compact_ratio,
 	#if VERBOSE > 1									  
 									  &compacted_area,
 	#endif								  
@@ -568,3 +668,158 @@ int tree_to_flp(tree_node_t *root, flp_t *flp, int compact_dead,
 	#endif
 	return compacted;
 }
+
+/* persistent slicing tree routines	*/
+
+/* constructor	*/
+slicing_tree_t *new_slicing_tree(flp_desc_t *flp_desc, NPE_t *expr)
+{
+	int i;
+	slicing_tree_t *tree;
+
+	tree = (slicing_tree_t *) calloc(1, sizeof(slicing_tree_t));
+	if (!tree)
+		fatal("memory allocation error\n");
+	tree->size = expr->size;
+	tree->nodes = (tree_node_t *) calloc(tree->size, sizeof(tree_node_t));
+	tree->start = (int *) calloc(tree->size, sizeof(int));
+	tree->elements = (int *) calloc(tree->size, sizeof(int));
+	tree->undo_nodes = (tree_node_t *) calloc(tree->size, sizeof(tree_node_t));
+	tree->undo_start = (int *) calloc(tree->size, sizeof(int));
+	tree->undo_pos = (int *) calloc(tree->size, sizeof(int));
+	if (!tree->nodes || !tree->start || !tree->elements ||
+		!tree->undo_nodes || !tree->undo_start || !tree->undo_pos)
+		fatal("memory allocation error\n");
+	tree->stack = new_tree_node_stack();
+	tree->pool = new_shape_pool();
+
+	/* 
+	 * start from an expression that differs everywhere so 
+	 * that the first update builds the whole tree
+	 */
+	for(i=0; i < tree->size; i++)
+		tree->elements[i] = (expr->elements[i] >= 0) ? -1 : 0;
+	slicing_tree_update(tree, flp_desc, expr);
+	slicing_tree_commit(tree);
+
+	return tree;
+}
+
+/* 
+ * leaves share the shape curves of flp_desc. only those
+ * of the internal nodes are owned by the tree (its pool)
+ */
+static void free_node_curve(slicing_tree_t *tree, tree_node_t *node)
+{
+	if (node->curve && node->label.unit < 0)
+		shape_pool_put(tree->pool, node->curve);
+}
+
+/* destructor	*/
+void free_slicing_tree(slicing_tree_t *tree)
+{
+	int i;
+	slicing_tree_commit(tree);
+	for(i=0; i < tree->size; i++)
+		free_node_curve(tree, &tree->nodes[i]);
+	free_shape_pool(tree->pool);
+	free(tree->nodes);
+	free(tree->start);
+	free(tree->elements);
+	free(tree->undo_nodes);
+	free(tree->undo_start);
+	free(tree->undo_pos);
+	free_tree_node_stack(tree->stack);
+	free(tree);
+}
+
+tree_node_t *slicing_tree_root(slicing_tree_t *tree)
+{
+	return &tree->nodes[tree->size-1];
+}
+
+tree_node_t *slicing_tree_update(slicing_tree_t *tree,
+								 flp_desc_t *flp_desc, NPE_t *expr)
+{
+	int i, lo, hi, start;
+	tree_node_t *node, *left = NULL, *right = NULL;
+	tree_node_stack_t *stack = tree->stack;
+
+	if (expr->size != tree->size)
+		fatal("NPE size does not match the slicing tree\n");
+	if (tree->n_undo)
+		fatal("previous slicing tree update neither committed nor rolled back\n");
+
+	/* window of the changed elements	*/
+	for(lo=0; lo < tree->size && tree->elements[lo] == expr->elements[lo]; lo++);
+	if (lo == tree->size)
+		return slicing_tree_root(tree);
+	for(hi=tree->size-1; tree->elements[hi] == expr->elements[hi]; hi--);
+
+	/* 
+	 * a node's subexpression occupies the positions 
+	 * [start, i]. it has to be recomputed iff that
+	 * range overlaps the window
+	 */
+	tree_node_stack_clear(stack);
+	for (i=0; i < tree->size; i++) {
+		node = &tree->nodes[i];
+		if (expr->elements[i] >= 0) {
+			start = i;
+		} else {
+			right = tree_node_stack_pop(stack);
+			left = tree_node_stack_pop(stack);
+			start = tree->start[left - tree->nodes];
+		}
+		if (i >= lo && start <= hi) {
+			/* log the old node	*/
+			tree->undo_nodes[tree->n_undo] = *node;
+			tree->undo_start[tree->n_undo] = tree->start[i];
+			tree->undo_pos[tree->n_undo] = i;
+			tree->n_undo++;
+
+			/* leaf */
+			if (expr->elements[i] >= 0) {
+				node->curve = flp_desc->units[expr->elements[i]].shape;
+				node->left = node->right = NULL;
+				node->label.unit = expr->elements[i];
+			/*	internal node denoting a cut	*/
+			} else {
+				node->curve = shape_add_pooled(tree->pool, left->curve,
+											   right->curve, expr->elements[i]);
+				node->left = left;
+				node->right = right;
+				node->label.cut_type = expr->elements[i];
+			}
+			tree->start[i] = start;
+			tree->elements[i] = expr->elements[i];
+		}
+		tree_node_stack_push(stack, node);
+	}
+	tree_node_stack_clear(stack);
+
+	return slicing_tree_root(tree);
+}
+
+/* drop the nodes replaced by the last update	*/
+void slicing_tree_commit(slicing_tree_t *tree)
+{
+	int i;
+	for(i=0; i < tree->n_undo; i++)
+		free_node_curve(tree, &tree->undo_nodes[i]);
+	tree->n_undo = 0;
+}
+
+/* restore the nodes replaced by the last update	*/
+void slicing_tree_rollback(slicing_tree_t *tree)
+{
+	int i, pos;
+	for(i=tree->n_undo-1; i >= 0; i--) {
+		pos = tree->undo_pos[i];
+		free_node_curve(tree, &tree->nodes[pos]);
+		tree->nodes[pos] = tree->undo_nodes[i];
+		tree->start[pos] = tree->undo_start[i];
+		tree->elements[pos] = tree->nodes[pos].label.unit;
+	}
+	tree->n_undo = 0;
+}
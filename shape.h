@@ -24,8 +24,26 @@ typedef struct shape_t_st
    */
   double *median;
   int size;
+  /* 
+   * for curves from a shape pool - no. of entries 
+   * allocated and the link in the pool's free list
+   */
+  int capacity;
+  struct shape_t_st *next;
 }shape_t;
 
+/* 
+ * pool of shape curves with free lists bucketed by capacity
+ * (powers of two). each curve is allocated in a single block
+ * and is recycled instead of being freed. this keeps malloc
+ * out of the annealing moves
+ */
+#define SHAPE_POOL_BUCKETS	32
+typedef struct shape_pool_t_st
+{
+	shape_t *free_list[SHAPE_POOL_BUCKETS];
+}shape_pool_t;
+
 /* slicing tree node	*/
 typedef struct tree_node_t_st
 {
@@ -56,6 +74,14 @@ shape_t *shape_from_aspect(double area, double min,
 shape_t *shape_add(shape_t *shape1, shape_t *shape2, int cut_type);
 /* uninitialization	*/
 void free_shape(shape_t *shape); 
+/* shape pool constructor/destructor	*/
+shape_pool_t *new_shape_pool(void);
+void free_shape_pool(shape_pool_t *pool);
+/* shape_add with the result drawn from 'pool'	*/
+shape_t *shape_add_pooled(shape_pool_t *pool, shape_t *shape1,
+						  shape_t *shape2, int cut_type);
+/* return a curve to its pool	*/
+void shape_pool_put(shape_pool_t *pool, shape_t *shape);
 /* position in the shape curve with minimum area	*/
 int min_area_pos(shape_t *curve);
 /* debug print	*/
@@ -82,6 +108,48 @@ void print_tree(tree_node_t *root, flp_desc_t *flp_desc);
  * corresponding to the `pos'th entry of root->curve
  */
 void print_tree_relevant(tree_node_t *root, int pos, flp_desc_t *flp_desc);
+/* 
+ * slicing tree that persists across the annealing moves.
+ * its nodes are indexed by their position in the NPE. an
+ * update to a new NPE recomputes only the shape curves of
+ * the nodes whose subexpressions changed, i.e., the paths
+ * from the changed elements to the root. the nodes it
+ * replaces are logged so that the update can be undone
+ */
+typedef struct slicing_tree_t_st
+{
+	tree_node_t *nodes;
+	/* first NPE position of each node's subexpression	*/
+	int *start;
+	/* the NPE elements the tree currently represents	*/
+	int *elements;
+	int size;
+	tree_node_stack_t *stack;
+	/* for the shape curves of the internal nodes	*/
+	shape_pool_t *pool;
+
+	/* undo log - replaced nodes and their positions	*/
+	tree_node_t *undo_nodes;
+	int *undo_start;
+	int *undo_pos;
+	int n_undo;
+}slicing_tree_t;
+
+/* constructor/destructor	*/
+slicing_tree_t *new_slicing_tree(flp_desc_t *flp_desc, NPE_t *expr);
+void free_slicing_tree(slicing_tree_t *tree);
+/* 
+ * update the tree to represent 'expr' (of the same size).
+ * returns its root
+ */
+tree_node_t *slicing_tree_update(slicing_tree_t *tree,
+								 flp_desc_t *flp_desc, NPE_t *expr);
+/* keep or undo the last update	*/
+void slicing_tree_commit(slicing_tree_t *tree);
+void slicing_tree_rollback(slicing_tree_t *tree);
+/* current root	*/
+tree_node_t *slicing_tree_root(slicing_tree_t *tree);
+
 /* 
  * convert slicing tree into actual floorplan
  * returns the number of dead blocks compacted
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "temperature_grid.h"
+#include "util.h"
+
+/* point the fields of 's' into the region at 'base'	*/
+static void layout(snapshot_t *s, void *base)
+{
+	s->hdr = (snapshot_header_t *) base;
+	s->names = (char *) base + sizeof(snapshot_header_t);
+	s->frames = (double *) (s->names + (size_t) s->hdr->n_blocks * STR_SIZE);
+	s->frame_size = 2 + s->hdr->n_blocks + s->hdr->n_cells;
+}
+
+snapshot_t *alloc_snapshot(grid_model_t *model, char *file)
+{
+	int i, j, base, fd, n_cells = model->n_layers * model->rows * model->cols;
+	snapshot_header_t hdr;
+	snapshot_t *s;
+	void *region;
+
+	s = (snapshot_t *) tcalloc(1, sizeof(snapshot_t));
+	s->size = sizeof(snapshot_header_t) + (size_t) model->total_n_blocks * STR_SIZE +
+			  2 * (2 + model->total_n_blocks + (size_t) n_cells) * sizeof(double);
+	if (strcmp(file, NULLFILE)) {
+		if ((fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fd, s->size))
+			fatal("unable to create snapshot file\n");
+		region = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (region == MAP_FAILED)
+			fatal("unable to map snapshot file\n");
+		s->mapped = TRUE;
+	} else
+		region = tcalloc(1, s->size);
+
+	memset(&hdr, 0, sizeof(snapshot_header_t));
+	hdr.n_blocks = model->total_n_blocks;
+	hdr.n_cells = n_cells;
+	hdr.n_layers = model->n_layers;
+	hdr.rows = model->rows;
+	hdr.cols = model->cols;
+	memcpy(region, &hdr, sizeof(snapshot_header_t));
+	layout(s, region);
+	for(i=0, base=0; i < model->n_layers; i++) {
+		for(j=0; j < model->layers[i].flp->n_units; j++)
+			strcpy(&s->names[(base + j) * STR_SIZE], model->layers[i].flp->units[j].name);
+		base += model->layers[i].flp->n_units;
+	}
+	/* readers of the file check the magic last	*/
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(s->hdr->magic, SNAPSHOT_MAGIC, sizeof(s->hdr->magic));
+
+	model->snapshot = s;
+	return s;
+}
+
+void free_snapshot(snapshot_t *s)
+{
+	if (s->mapped)
+		munmap(s->hdr, s->size);
+	else
+		tfree(s->hdr);
+	tfree(s);
+}
+
+/* word by word, as readers may be copying the frame concurrently	*/
+static void store_frame(double *dst, double *src, size_t n)
+{
+	size_t i;
+
+	for(i=0; i < n; i++)
+		__atomic_store(&dst[i], &src[i], __ATOMIC_RELAXED);
+}
+
+static void load_frame(double *dst, double *src, size_t n)
+{
+	size_t i;
+
+	for(i=0; i < n; i++)
+		__atomic_load(&src[i], &dst[i], __ATOMIC_RELAXED);
+}
+
+static void write_frame(snapshot_t *s, int k, double *blocks, double *cells)
+{
+	double head[2] = {s->time, (double) s->intervals};
+	double *f = s->frames + k * s->frame_size;
+
+	store_frame(f, head, 2);
+	store_frame(f + 2, blocks, s->hdr->n_blocks);
+	store_frame(f + 2 + s->hdr->n_blocks, cells, s->hdr->n_cells);
+}
+
+void publish_snapshot(snapshot_t *s, double time_elapsed, double *blocks, double *cells)
+{
+	/* only the writer changes the counter	*/
+	unsigned long long seq = s->hdr->seq;
+
+	s->time += time_elapsed;
+	s->intervals++;
+	/* readers go to frame 1 while frame 0 is written and vice versa	*/
+	__atomic_store_n(&s->hdr->seq, seq + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	write_frame(s, 0, blocks, cells);
+	__atomic_store_n(&s->hdr->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	write_frame(s, 1, blocks, cells);
+}
+
+snapshot_t *open_snapshot(char *file)
+{
+	int fd;
+	struct stat st;
+	snapshot_t *s;
+	void *region;
+
+	if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st))
+		fatal("unable to open snapshot file\n");
+	region = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (region == MAP_FAILED || st.st_size < sizeof(snapshot_header_t) ||
+		strncmp(((snapshot_header_t *) region)->magic, SNAPSHOT_MAGIC, 8))
+		fatal("invalid snapshot file\n");
+
+	s = (snapshot_t *) tcalloc(1, sizeof(snapshot_t));
+	s->size = st.st_size;
+	s->mapped = TRUE;
+	layout(s, region);
+	if (s->size < sizeof(snapshot_header_t) + (size_t) s->hdr->n_blocks * STR_SIZE +
+				  2 * s->frame_size * sizeof(double))
+		fatal("invalid snapshot file\n");
+	return s;
+}
+
+long read_snapshot(snapshot_t *s, double *time, double *blocks, double *cells)
+{
+	unsigned long long seq;
+	double head[2], *f;
+
+	do {
+		seq = __atomic_load_n(&s->hdr->seq, __ATOMIC_ACQUIRE);
+		f = s->frames + (seq & 1) * s->frame_size;
+		load_frame(head, f, 2);
+		if (blocks)
+			load_frame(blocks, f + 2, s->hdr->n_blocks);
+		if (cells)
+			load_frame(cells, f + 2 + s->hdr->n_blocks, s->hdr->n_cells);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&s->hdr->seq, __ATOMIC_RELAXED) != seq);
+
+	if (time)
+		*time = head[0];
+	return (long) head[1];
+}
@@ -0,0 +1,69 @@
+#ifndef __SNAPSHOT_H_
+#define __SNAPSHOT_H_
+
+#include <stddef.h>
+
+#include "temperature_grid.h"
+#include "util.h"
+
+/*
+ * lock-free snapshots of the temperatures of a grid model, for
+ * readers in other threads or processes (dashboards, DTM agents)
+ * while the solver advances. after every interval, compute_temp_grid
+ * publishes the block and grid cell temperatures into two frames
+ * guarded by a sequence counter (a seqlock 'latch'). while the
+ * writer updates one frame, readers are directed to the other, so
+ * that the writer never waits. the counter changes twice per
+ * publication and a reader retries whenever it changed during its
+ * copy, i.e. whenever a publication overlapped the read. a reader
+ * that is slow compared to the interval rate may thus retry several
+ * times. the snapshot lives in private memory or in a shared file
+ * mapping (e.g. under /dev/shm) that other processes open with
+ * open_snapshot
+ */
+#define SNAPSHOT_MAGIC	"HSSNAP1"
+
+/* layout of the mapping: the header, the block names, then the two frames	*/
+typedef struct snapshot_header_t_st
+{
+	char magic[8];
+	int n_blocks, n_cells;
+	/* shape of the grid (n_cells = n_layers * rows * cols)	*/
+	int n_layers, rows, cols, reserved;
+	/* incremented twice per publication. odd while frame 0 is written	*/
+	unsigned long long seq;
+}snapshot_header_t;
+
+typedef struct snapshot_t_st
+{
+	snapshot_header_t *hdr;
+	/* STR_SIZE characters per block, in the order of the model's blocks	*/
+	char *names;
+	/* each frame: time, interval no., block temperatures, cell temperatures	*/
+	double *frames;
+	size_t frame_size, size;
+	/* shared file mapping or private memory?	*/
+	int mapped;
+	/* writer's time and no. of intervals	*/
+	double time;
+	long intervals;
+}snapshot_t;
+
+/*
+ * snapshot of 'model', published by compute_temp_grid from now on.
+ * in a file mapping if 'file' is not NULLFILE
+ */
+snapshot_t *alloc_snapshot(grid_model_t *model, char *file);
+void free_snapshot(snapshot_t *s);
+/* publish the temperatures at the end of an interval of 'time_elapsed'	*/
+void publish_snapshot(snapshot_t *s, double time_elapsed, double *blocks, double *cells);
+
+/* map a snapshot published by another process (read only)	*/
+snapshot_t *open_snapshot(char *file);
+/*
+ * consistent copy of the latest frame. 'blocks' and/or 'cells' may
+ * be NULL. returns the no. of intervals published (0 for none yet)
+ */
+long read_snapshot(snapshot_t *s, double *time, double *blocks, double *cells);
+
+#endif
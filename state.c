@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "state.h"
+#include "temperature_grid.h"
+#include "util.h"
+
+static state_slot_t *slot_header(state_file_t *s, int k)
+{
+	return (state_slot_t *) ((char *) s->region + sysconf(_SC_PAGESIZE) + k * s->hdr->slot_size);
+}
+
+static double *slot_data(state_file_t *s, int k)
+{
+	return (double *) ((char *) slot_header(s, k) + STATE_SLOT_DATA);
+}
+
+/* of the sequence no. and trace_num in 'h' and the data of slot 'k'	*/
+static unsigned long long slot_checksum(state_file_t *s, state_slot_t *h, int k)
+{
+	unsigned long long c = hash_bytes(HASH_INIT, &h->seq, sizeof(h->seq));
+
+	c = hash_bytes(c, &h->trace_num, sizeof(h->trace_num));
+	return hash_bytes(c, slot_data(s, k), s->data_size);
+}
+
+/*
+ * replace the model's last_trans and last_temp by pointers into
+ * slot 'k', in the same layout as dcuboid_tail with the package
+ * nodes after the grid cells, followed by the block temperatures
+ */
+static void attach(state_file_t *s, grid_model_t *model, int k)
+{
+	int i, j, nl = model->n_layers, nr = model->rows, nc = model->cols;
+	double *data = slot_data(s, k);
+	grid_model_vector_t *v;
+
+	v = (grid_model_vector_t *) tcalloc(1, sizeof(grid_model_vector_t));
+	v->cuboid = (double ***) tcalloc(nl, sizeof(double **));
+	v->cuboid[0] = (double **) tcalloc(nl * nr, sizeof(double *));
+	for(i=0; i < nl; i++) {
+		v->cuboid[i] = v->cuboid[0] + nr * i;
+		for(j=0; j < nr; j++)
+			v->cuboid[i][j] = data + (nr * nc) * i + nc * j;
+	}
+	v->extra = data + (size_t) nl * nr * nc;
+	s->v = v;
+	s->slot = k;
+
+	if (model->last_trans)
+		free_grid_model_vector(model->last_trans);
+	if (model->last_temp)
+		free_dvector(model->last_temp);
+	model->last_trans = v;
+	model->last_temp = v->extra + s->hdr->n_extra;
+}
+
+/* header of a state of 'model' and the size of its slots' data	*/
+static void layout(grid_model_t *model, int aux_size, state_header_t *hdr, size_t *data_size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+
+	memset(hdr, 0, sizeof(state_header_t));
+	hdr->magic = MAGIC_MMAP_FILE;
+	hdr->version = STATE_VERSION;
+	hdr->n_layers = model->n_layers;
+	hdr->rows = model->rows;
+	hdr->cols = model->cols;
+	hdr->n_extra = model->config.model_secondary ? EXTRA + EXTRA_SEC : EXTRA;
+	hdr->n_temp = model->total_n_blocks + hdr->n_extra;
+	hdr->aux_size = aux_size;
+	*data_size = ((size_t) hdr->n_layers * hdr->rows * hdr->cols + hdr->n_extra + hdr->n_temp) * sizeof(double) +
+				 aux_size;
+	hdr->slot_size = (STATE_SLOT_DATA + *data_size + page - 1) / page * page;
+}
+
+/* write lock on a range of 'fd', held till it is closed	*/
+static void lock_range(int fd, off_t offset, off_t size)
+{
+	struct flock l;
+
+	memset(&l, 0, sizeof(struct flock));
+	l.l_type = F_WRLCK;
+	l.l_whence = SEEK_SET;
+	l.l_start = offset;
+	l.l_len = size;
+	if (fcntl(fd, F_SETLK, &l))
+		fatal("state of the session is in use by another run\n");
+}
+
+/* a session id names a file next to the state file or an arena entry	*/
+static void check_session(char *session)
+{
+	if (!*session || strchr(session, '/') || !strcmp(session, ".") || !strcmp(session, "..") ||
+		strlen(session) >= STATE_SESSION_SIZE)
+		fatal("a session id must have 1 to 63 characters, no '/' and not be '.' or '..'\n");
+}
+
+/*
+ * offset of the region of 'session' in 'arena', with the directory
+ * locked while it is looked up or extended. if '*size' is not 0, the
+ * region is created, or replaced by a new one if its size differs
+ * (the arena does not reuse space). otherwise, it must exist and
+ * '*size' is set to its size
+ */
+static off_t arena_region(state_file_t *s, char *arena, char *session, size_t *size)
+{
+	int i;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t dir_size = (sizeof(state_arena_t) + STATE_SESSIONS * sizeof(state_entry_t) + page - 1) / page * page;
+	struct stat st;
+	state_arena_t *a;
+	state_entry_t *entries, *e = NULL;
+	off_t offset;
+
+	if (!strcmp(session, NULLFILE))
+		fatal("a state arena needs a session id\n");
+	if ((s->fd = open(arena, O_RDWR | O_CREAT, 0644)) < 0 || flock(s->fd, LOCK_EX) || fstat(s->fd, &st))
+		fatal("unable to open state arena\n");
+	if (!st.st_size && (!*size || posix_fallocate(s->fd, 0, dir_size)))
+		fatal("unable to create state arena\n");
+	a = (state_arena_t *) mmap(NULL, dir_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (a == MAP_FAILED)
+		fatal("unable to map state arena\n");
+	entries = (state_entry_t *) (a + 1);
+	if (!st.st_size) {
+		a->magic = STATE_ARENA_MAGIC;
+		a->version = STATE_VERSION;
+		a->end = dir_size;
+	} else if (st.st_size < dir_size || a->magic != STATE_ARENA_MAGIC || a->version != STATE_VERSION)
+		fatal("invalid state arena\n");
+
+	for(i=0; i < a->n_sessions && !e; i++)
+		if (!strcmp(entries[i].session, session))
+			e = &entries[i];
+	if (!e && !*size)
+		fatal("no state of the session in the state arena\n");
+	if (!e) {
+		if (a->n_sessions == STATE_SESSIONS)
+			fatal("state arena is full\n");
+		e = &entries[a->n_sessions++];
+		strcpy(e->session, session);
+	}
+	lock_range(s->fd, (char *) e - (char *) a, sizeof(state_entry_t));
+	if (*size && e->size != *size) {
+		if (posix_fallocate(s->fd, a->end, *size))
+			fatal("unable to grow state arena\n");
+		e->offset = a->end;
+		e->size = *size;
+		a->end += *size;
+	}
+	*size = e->size;
+	offset = e->offset;
+	msync(a, dir_size, MS_SYNC);
+	munmap(a, dir_size);
+	flock(s->fd, LOCK_UN);
+	return offset;
+}
+
+/*
+ * lock and map the state of 'session' (see state.h). if 'size' is
+ * not 0, a new state of that many bytes replaces the old one
+ */
+static void acquire(state_file_t *s, char *file, char *session, char *arena, size_t size)
+{
+	char path[2 * STR_SIZE], msg[3 * STR_SIZE];
+	off_t offset = 0;
+	struct stat st;
+
+	if (strcmp(session, NULLFILE))
+		check_session(session);
+	if (strcmp(arena, NULLFILE))
+		offset = arena_region(s, arena, session, &size);
+	else {
+		if (strcmp(session, NULLFILE))
+			sprintf(path, "%s.%s", file, session);
+		else
+			strcpy(path, file);
+		if ((s->fd = open(path, size ? O_RDWR | O_CREAT : O_RDWR, 0644)) < 0) {
+			sprintf(msg, "error: state file %s could not be opened\n", path);
+			fatal(msg);
+		}
+		if (flock(s->fd, LOCK_EX | LOCK_NB))
+			fatal("state file is in use by another run\n");
+		/* allocate all blocks now rather than fault on a full disk later	*/
+		if (size && (ftruncate(s->fd, 0) || posix_fallocate(s->fd, 0, size)))
+			fatal("unable to create state file\n");
+		if (!size) {
+			if (fstat(s->fd, &st))
+				fatal("unable to open state file\n");
+			size = st.st_size;
+		}
+	}
+	if (size < sysconf(_SC_PAGESIZE))
+		fatal("invalid state file\n");
+	s->size = size;
+	s->region = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, offset);
+	if (s->region == MAP_FAILED)
+		fatal("unable to map state file\n");
+	s->hdr = (state_header_t *) s->region;
+}
+
+state_file_t *create_state_file(grid_model_t *model, char *file, char *session, char *arena,
+								int aux_size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	state_header_t hdr;
+	state_file_t *s;
+
+	s = (state_file_t *) tcalloc(1, sizeof(state_file_t));
+	layout(model, aux_size, &hdr, &s->data_size);
+	acquire(s, file, session, arena, page + 2 * hdr.slot_size);
+	/* a reused region may have an old state	*/
+	memcpy(s->hdr, &hdr, sizeof(state_header_t));
+	memset(slot_header(s, 0), 0, sizeof(state_slot_t));
+	memset(slot_header(s, 1), 0, sizeof(state_slot_t));
+	/* on disk before any slot can be, as the commits only sync their slot	*/
+	if (msync(s->region, page, MS_SYNC))
+		fatal("unable to sync state file\n");
+	attach(s, model, 0);
+	return s;
+}
+
+state_file_t *open_state_file(grid_model_t *model, char *file, char *session, char *arena,
+							  int aux_size, int prev)
+{
+	int k, latest = -1, found = -1;
+	long page = sysconf(_SC_PAGESIZE);
+	state_header_t hdr;
+	state_slot_t *h;
+	state_file_t *s;
+	char msg[STR_SIZE];
+
+	s = (state_file_t *) tcalloc(1, sizeof(state_file_t));
+	acquire(s, file, session, arena, 0);
+	if (s->hdr->magic != MAGIC_MMAP_FILE || s->hdr->version != STATE_VERSION)
+		fatal("invalid state file header\n");
+	layout(model, aux_size, &hdr, &s->data_size);
+	if (memcmp(s->hdr, &hdr, sizeof(state_header_t)))
+		fatal("state file does not match the model\n");
+	if (s->size < page + 2 * hdr.slot_size)
+		fatal("invalid state file size\n");
+
+	/*
+	 * latest slot committed completely by invocation 'prev'. the other
+	 * one may be from the invocation that is being rerun
+	 */
+	for(k=0; k < 2; k++) {
+		h = slot_header(s, k);
+		if (!h->seq || h->checksum != slot_checksum(s, h, k))
+			continue;
+		if (latest < 0 || h->seq > slot_header(s, latest)->seq)
+			latest = k;
+		if (h->trace_num == prev && (found < 0 || h->seq > slot_header(s, found)->seq))
+			found = k;
+	}
+	if (latest < 0)
+		fatal("no consistent state in state file\n");
+	if (found < 0) {
+		sprintf(msg, "state file is from invocation %d, expected %d\n",
+				slot_header(s, latest)->trace_num, prev);
+		fatal(msg);
+	}
+	s->seq = slot_header(s, found)->seq;
+
+	/* work on a copy in the other slot, invalidated till the commit	*/
+	k = 1 - found;
+	memset(slot_header(s, k), 0, sizeof(state_slot_t));
+	memcpy(slot_data(s, k), slot_data(s, found), s->data_size);
+	attach(s, model, k);
+	return s;
+}
+
+void *state_aux(state_file_t *s, size_t *size)
+{
+	*size = s->hdr->aux_size;
+	return (char *) slot_data(s, s->slot) + s->data_size - s->hdr->aux_size;
+}
+
+void commit_state_file(state_file_t *s, int trace_num)
+{
+	state_slot_t h, *dst = slot_header(s, s->slot);
+
+	/* data first. a crash before the header is written keeps the old slot	*/
+	if (msync(dst, s->hdr->slot_size, MS_SYNC))
+		fatal("unable to sync state file\n");
+	memset(&h, 0, sizeof(state_slot_t));
+	h.seq = s->seq + 1;
+	h.trace_num = trace_num;
+	h.checksum = slot_checksum(s, &h, s->slot);
+	/* a torn header fails the checksum	*/
+	memcpy(dst, &h, sizeof(state_slot_t));
+	if (msync(dst, sysconf(_SC_PAGESIZE), MS_SYNC))
+		fatal("unable to sync state file\n");
+	s->seq = h.seq;
+}
+
+void close_state_file(state_file_t *s, grid_model_t *model)
+{
+	if (model->last_trans == s->v) {
+		model->last_trans = NULL;
+		model->last_temp = NULL;
+	}
+	tfree(s->v->cuboid[0]);
+	tfree(s->v->cuboid);
+	tfree(s->v);
+	munmap(s->region, s->size);
+	close(s->fd);
+	tfree(s);
+}
@@ -0,0 +1,119 @@
+#ifndef __STATE_H_
+#define __STATE_H_
+
+#include <stddef.h>
+
+#include "temperature_grid.h"
+#include "util.h"
+
+/*
+ * transient state of a grid model handed over between ThermSniper
+ * invocations (TRANS_TEMP_FILE). the file holds two slots, each with
+ * the grid temperatures (last_trans), the block temperatures
+ * (last_temp), an auxiliary area of the caller (the hysteresis state
+ * of the threshold events) and a header with a sequence no. and a
+ * checksum. the model integrates in place in one slot of the mapping
+ * while the other one keeps the state of the previous invocation. a
+ * commit syncs the data before the slot header, so that after a crash
+ * at any point, the valid slot with the highest sequence no. is a
+ * consistent state. an invocation starts from the latest valid slot
+ * of the previous one, so that it can be rerun even after its own
+ * commit. layout: a page with the file header, then the two slots,
+ * each page aligned.
+ *
+ * the state of a session is either a file of its own, locked with
+ * flock while an invocation runs, or a region of an arena file (e.g.
+ * under /dev/shm) shared by many sessions. the arena starts with a
+ * directory of the sessions, updated under flock of the whole file,
+ * and each region is locked with a record lock on its directory
+ * entry. regions are page aligned and never move, so the arena only
+ * grows at the end
+ */
+#define STATE_VERSION	3
+/* offset of the data from the start of a slot	*/
+#define STATE_SLOT_DATA	64
+
+#define STATE_ARENA_MAGIC	0x48504152
+#define STATE_SESSIONS		256
+#define STATE_SESSION_SIZE	64
+
+typedef struct state_header_t_st
+{
+	int magic, version;
+	/* shape of the grid and no. of package nodes	*/
+	int n_layers, rows, cols, n_extra;
+	/* no. of block temperatures (incl. package nodes) and bytes of the auxiliary area	*/
+	int n_temp, aux_size;
+	/* bytes from the start of a slot to the next	*/
+	long long slot_size;
+}state_header_t;
+
+typedef struct state_slot_t_st
+{
+	/* 0 for a slot never committed	*/
+	unsigned long long seq;
+	int trace_num, reserved;
+	/* of seq, trace_num and the data	*/
+	unsigned long long checksum;
+}state_slot_t;
+
+/* directory of an arena: this header followed by STATE_SESSIONS entries	*/
+typedef struct state_arena_t_st
+{
+	int magic, version;
+	/* entries in use	*/
+	int n_sessions, reserved;
+	/* end of the last region	*/
+	long long end;
+}state_arena_t;
+
+typedef struct state_entry_t_st
+{
+	char session[STATE_SESSION_SIZE];
+	/* region of the session in the arena	*/
+	long long offset, size;
+}state_entry_t;
+
+typedef struct state_file_t_st
+{
+	/* kept open for the lock	*/
+	int fd;
+	/* mapping of the session's state	*/
+	void *region;
+	size_t size;
+	state_header_t *hdr;
+	/* slot the model's state lives in and its data size in bytes	*/
+	int slot;
+	size_t data_size;
+	/* sequence no. of the last commit	*/
+	unsigned long long seq;
+	/* pointers into the slot, as model->last_trans	*/
+	grid_model_vector_t *v;
+}state_file_t;
+
+/*
+ * the state of 'session' is the region of that name in 'arena' if
+ * it is not NULLFILE. otherwise, it is 'file', suffixed with
+ * '.<session>' unless 'session' is NULLFILE. a session id has less
+ * than STATE_SESSION_SIZE characters, no '/' and is not '.' or '..'.
+ *
+ * create makes a new state with an auxiliary area of 'aux_size' bytes
+ * at its final size (replacing an old one) and points the model's
+ * last_trans and last_temp into its first slot
+ */
+state_file_t *create_state_file(grid_model_t *model, char *file, char *session, char *arena,
+								int aux_size);
+/*
+ * map a state and point the model into a copy of the latest
+ * consistent state committed by invocation 'prev'
+ */
+state_file_t *open_state_file(grid_model_t *model, char *file, char *session, char *arena,
+							  int aux_size, int prev);
+/* auxiliary area of the model's slot, committed with the temperatures	*/
+void *state_aux(state_file_t *s, size_t *size);
+/* atomically make the model's state that of invocation 'trace_num'	*/
+void commit_state_file(state_file_t *s, int trace_num);
+/* unmap and unlock. the model's last_trans and last_temp are reset to NULL	*/
+void close_state_file(state_file_t *s, grid_model_t *model);
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stats.h"
+#include "util.h"
+
+static const double bin_edges[STATS_BINS-1] = STATS_BIN_EDGES;
+
+/* initial depth of a reversal stack	*/
+#define STATS_REV_INIT	8
+
+stats_t *alloc_stats(char **names, int n_blocks, int n_layers, int *layers,
+					 int rows, int cols, double threshold, double gate)
+{
+	int i;
+	stats_t *s;
+	mem_tag_t tag = mem_set_tag(MEM_STATS);
+
+	s = (stats_t *) tcalloc(1, sizeof(stats_t));
+	s->names = names;
+	s->n_blocks = n_blocks;
+	s->n_layers = n_layers;
+	s->rows = rows;
+	s->cols = cols;
+	s->threshold = threshold;
+	s->gate = gate;
+	if (n_layers) {
+		s->layers = (int *) tcalloc(n_layers, sizeof(int));
+		memcpy(s->layers, layers, n_layers * sizeof(int));
+	}
+	s->n_units = n_blocks + 1 + n_layers * rows * cols;
+	s->units = (stats_unit_t *) tcalloc(s->n_units, sizeof(stats_unit_t));
+	for(i=0; i < s->n_units; i++) {
+		s->units[i].cap = STATS_REV_INIT;
+		s->units[i].rev = (double *) tcalloc(STATS_REV_INIT, sizeof(double));
+	}
+	mem_set_tag(tag);
+	return s;
+}
+
+void free_stats(stats_t *s)
+{
+	int i;
+
+	for(i=0; i < s->n_units; i++)
+		tfree(s->units[i].rev);
+	tfree(s->units);
+	tfree(s->layers);
+	tfree(s);
+}
+
+/* a (half) cycle of range 'range'	*/
+static void count_cycle(stats_unit_t *u, double range, double weight)
+{
+	int i;
+
+	for(i=0; i < STATS_BINS-1 && range >= bin_edges[i]; i++);
+	u->hist[i] += weight;
+	u->cycles += weight;
+	u->max_range = MAX(u->max_range, range);
+}
+
+/*
+ * push a reversal and pair off the cycles it closes (the
+ * three-point rainflow algorithm of ASTM E1049, on a stack)
+ */
+static void push_reversal(stats_unit_t *u, double x)
+{
+	double *rev, r1, r2;
+
+	if (u->n_rev == u->cap) {
+		mem_tag_t tag = mem_set_tag(MEM_STATS);
+		rev = (double *) tcalloc(2 * u->cap, sizeof(double));
+		memcpy(rev, u->rev, u->n_rev * sizeof(double));
+		tfree(u->rev);
+		u->rev = rev;
+		u->cap *= 2;
+		mem_set_tag(tag);
+	}
+	rev = u->rev;
+	rev[u->n_rev++] = x;
+	while (u->n_rev >= 3) {
+		r1 = fabs(rev[u->n_rev-1] - rev[u->n_rev-2]);
+		r2 = fabs(rev[u->n_rev-2] - rev[u->n_rev-3]);
+		if (r1 < r2)
+			break;
+		if (u->n_rev == 3) {
+			/* the range contains the starting point	*/
+			count_cycle(u, r2, 0.5);
+			rev[0] = rev[1];
+			rev[1] = rev[2];
+			u->n_rev = 2;
+		} else {
+			count_cycle(u, r2, 1.0);
+			rev[u->n_rev-3] = rev[u->n_rev-1];
+			u->n_rev -= 2;
+		}
+	}
+}
+
+/*
+ * turning points of the temperature. an excursion ends only when
+ * the temperature has come back from its extreme by more than the
+ * gate, which filters out the ripple of the solver and the trace
+ */
+static void add_rainflow(stats_unit_t *u, double x, double gate)
+{
+	if (!u->n_rev && !u->dir) {
+		push_reversal(u, x);
+		u->ext = x;
+	} else if (!u->dir) {
+		if (fabs(x - u->ext) > gate) {
+			u->dir = (x > u->ext) ? 1 : -1;
+			u->ext = x;
+		}
+	} else if ((x - u->ext) * u->dir >= 0)
+		u->ext = x;
+	else if (fabs(x - u->ext) > gate) {
+		push_reversal(u, u->ext);
+		u->dir = -u->dir;
+		u->ext = x;
+	}
+}
+
+static void add_unit(stats_t *s, stats_unit_t *u, double x, double dt)
+{
+	int first = (u->time == 0);
+	double p = first ? x : u->last, d, frac;
+
+	if (first)
+		u->min = u->max = x;
+	u->min = MIN(u->min, x);
+	u->max = MAX(u->max, x);
+	u->time += dt;
+	d = x - u->mean;
+	u->mean += d * dt / u->time;
+	u->m2 += dt * d * (x - u->mean);
+	if (!first)
+		u->max_rate = MAX(u->max_rate, fabs(x - p) / dt);
+
+	/* part of the interval above the threshold, linear in between	*/
+	if (p > s->threshold && x > s->threshold)
+		frac = 1.0;
+	else if (p > s->threshold)
+		frac = (p - s->threshold) / (p - x);
+	else if (x > s->threshold)
+		frac = (x - s->threshold) / (x - p);
+	else
+		frac = 0.0;
+	u->above += frac * dt;
+	if (p > s->threshold)
+		u->dwell += frac * dt;
+	else
+		u->dwell = frac * dt;
+	u->max_dwell = MAX(u->max_dwell, u->dwell);
+
+	add_rainflow(u, x, s->gate);
+	u->last = x;
+}
+
+void stats_add_blocks(stats_t *s, double *temp, double dt)
+{
+	int i;
+	double lo = temp[0], hi = temp[0];
+
+	for(i=0; i < s->n_blocks; i++) {
+		add_unit(s, &s->units[i], temp[i], dt);
+		lo = MIN(lo, temp[i]);
+		hi = MAX(hi, temp[i]);
+	}
+	add_unit(s, &s->units[s->n_blocks], hi, dt);
+	s->intervals++;
+	s->time += dt;
+	if (hi - lo > s->max_spread) {
+		s->max_spread = hi - lo;
+		s->max_spread_time = s->time;
+	}
+}
+
+void stats_add_cells(stats_t *s, int k, double *temp, double dt)
+{
+	int i;
+	stats_unit_t *u = &s->units[s->n_blocks + 1 + k * s->rows * s->cols];
+
+	for(i=0; i < s->rows * s->cols; i++)
+		add_unit(s, &u[i], temp[i], dt);
+}
+
+static void write_unit(FILE *fp, stats_unit_t *u)
+{
+	int i;
+
+	/* the residue of the rainflow stack counts as half cycles	*/
+	if (u->dir)
+		push_reversal(u, u->ext);
+	for(i=0; i+1 < u->n_rev; i++)
+		count_cycle(u, fabs(u->rev[i+1] - u->rev[i]), 0.5);
+	u->n_rev = 0;
+	u->dir = 0;
+
+	fprintf(fp, "\t%.2f\t%.2f\t%.2f\t%.3f\t%g\t%g\t%.4g\t%g\t%.2f", u->min, u->max, u->mean,
+			(u->time > 0) ? sqrt(u->m2 / u->time) : 0.0, u->above, u->max_dwell,
+			u->max_rate, u->cycles, u->max_range);
+	for(i=0; i < STATS_BINS; i++)
+		fprintf(fp, "\t%g", u->hist[i]);
+	fprintf(fp, "\n");
+}
+
+void stats_write(stats_t *s, char *file)
+{
+	FILE *fp = stdout;
+	int i, k, r, c;
+	stats_unit_t *u = s->units;
+
+	if (strcmp(file, "stdout") && !(fp = fopen(file, "w")))
+		fatal("unable to open statistics file for output\n");
+
+	fprintf(fp, "# %ld intervals over %g s. threshold %.2f K, cycle gate %g K\n",
+			s->intervals, s->time, s->threshold, s->gate);
+	fprintf(fp, "# max. block temperature spread %.2f K at %g s\n",
+			s->max_spread, s->max_spread_time);
+	fprintf(fp, "unit\tmin\tmax\tmean\tsd\tabove\tmax_dwell\tmax_rate\tcycles\tmax_range");
+	for(i=0; i < STATS_BINS-1; i++)
+		fprintf(fp, "\tr<%g", bin_edges[i]);
+	fprintf(fp, "\tr>=%g\n", bin_edges[STATS_BINS-2]);
+
+	for(i=0; i < s->n_blocks; i++) {
+		fprintf(fp, "%s", s->names[i]);
+		write_unit(fp, u++);
+	}
+	fprintf(fp, "peak");
+	write_unit(fp, u++);
+	for(k=0; k < s->n_layers; k++)
+		for(r=0; r < s->rows; r++)
+			for(c=0; c < s->cols; c++) {
+				fprintf(fp, "cell_%d_%d_%d", s->layers[k], r, c);
+				write_unit(fp, u++);
+			}
+
+	if (fp != stdout)
+		fclose(fp);
+}
@@ -0,0 +1,76 @@
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include "util.h"
+
+/*
+ * streaming statistics of a transient simulation, as an alternative
+ * to writing (and post-processing) the full temperature traces. the
+ * temperatures of every interval are condensed on the fly, per block
+ * and optionally per grid cell, into the min, max, mean, standard
+ * deviation, time above the thermal threshold, longest dwell above
+ * it, max. rate of change and the thermal cycles found by rainflow
+ * counting. the chip's peak temperature is tracked as one more unit
+ * and the largest spread among the blocks is reported as well
+ */
+
+/* upper ends (in K) of the bins of the rainflow cycle ranges	*/
+#define STATS_BINS		7
+#define STATS_BIN_EDGES	{1, 2, 5, 10, 20, 50}
+
+/* one block, cell or the peak	*/
+typedef struct stats_unit_t_st
+{
+	/* time weighted running mean and variance (West), extremes	*/
+	double time, mean, m2, min, max;
+	/* temperature at the end of the previous interval	*/
+	double last;
+	/* time above the threshold, the current and the longest dwell	*/
+	double above, dwell, max_dwell;
+	/* max. absolute rate of change (K/s)	*/
+	double max_rate;
+	/* stack of the reversals not yet paired into cycles	*/
+	double *rev;
+	int n_rev, cap;
+	/* direction of the current excursion (0 before the first) and its extreme	*/
+	int dir;
+	double ext;
+	/* cycles found (half cycles count half), their max. range and histogram	*/
+	double cycles, max_range, hist[STATS_BINS];
+}stats_unit_t;
+
+typedef struct stats_t_st
+{
+	/* thermal threshold and the min. swing of a reversal (K)	*/
+	double threshold, gate;
+	/* block names (not owned) and grid size (0 cells if none)	*/
+	char **names;
+	int n_blocks, n_layers, rows, cols;
+	/* index of each cell layer in the grid model	*/
+	int *layers;
+	/* blocks, then the peak, then the cells layer by layer	*/
+	stats_unit_t *units;
+	int n_units;
+	/* no. of block rows added and their total time	*/
+	long intervals;
+	double time;
+	/* largest block temperature spread and when it happened	*/
+	double max_spread, max_spread_time;
+}stats_t;
+
+/*
+ * statistics of 'n_blocks' blocks named 'names' plus the cells of
+ * 'n_layers' grid layers (indices in 'layers') of 'rows' x 'cols'.
+ * cycles with a range below 'gate' are filtered out
+ */
+stats_t *alloc_stats(char **names, int n_blocks, int n_layers, int *layers,
+					 int rows, int cols, double threshold, double gate);
+void free_stats(stats_t *s);
+/* add the block temperatures at the end of an interval of 'dt' seconds	*/
+void stats_add_blocks(stats_t *s, double *temp, double dt);
+/* add the temperatures of the k-th cell layer (rows x cols, row-major)	*/
+void stats_add_cells(stats_t *s, int k, double *temp, double dt);
+/* close the open excursions and write the summary to 'file'	*/
+void stats_write(stats_t *s, char *file);
+
+#endif
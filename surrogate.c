@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "surrogate.h"
+#include "flp.h"
+#include "temperature.h"
+#include "temperature_grid.h"
+#include "util.h"
+
+/*
+ * in-place radix-2 complex FFT of the 'n' elements of (re, im).
+ * 'n' should be a power of two. (w_re, w_im) holds the n/2
+ * twiddle factors exp(-2*pi*i*k/n). the inverse transform is
+ * not scaled by 1/n
+ */
+static void fft_1d(double *re, double *im, int n, double *w_re, double *w_im,
+				   int inverse)
+{
+	int i, j, k, len, step, bit;
+	double t_re, t_im, c, s, tmp;
+
+	/* bit reversal permutation	*/
+	for(i=1, j=0; i < n; i++) {
+		for(bit = n >> 1; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+			tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+		}
+	}
+
+	/* butterflies	*/
+	for(len=2, step=n/2; len <= n; len <<= 1, step >>= 1)
+		for(i=0; i < n; i += len)
+			for(k=0; k < len/2; k++) {
+				int a = i + k, b = i + k + len/2;
+				c = w_re[k*step];
+				s = inverse ? -w_im[k*step] : w_im[k*step];
+				t_re = re[b] * c - im[b] * s;
+				t_im = re[b] * s + im[b] * c;
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] += t_re;
+				im[a] += t_im;
+			}
+}
+
+/*
+ * 2-d FFT of an n x n row-major array whose non-zero input
+ * (forward) or required output (inverse) lies only in the
+ * first 'rows' rows. columns are copied to a contiguous
+ * buffer for locality
+ */
+static void fft_2d(surrogate_t *s, double *re, double *im, int rows, int inverse)
+{
+	int i, j, n = s->n;
+
+	if (!inverse)
+		for(i=0; i < rows; i++)
+			fft_1d(&re[i*n], &im[i*n], n, s->w_re, s->w_im, FALSE);
+	for(j=0; j < n; j++) {
+		for(i=0; i < n; i++) {
+			s->col_re[i] = re[i*n+j];
+			s->col_im[i] = im[i*n+j];
+		}
+		fft_1d(s->col_re, s->col_im, n, s->w_re, s->w_im, inverse);
+		for(i=0; i < n; i++) {
+			re[i*n+j] = s->col_re[i];
+			im[i*n+j] = s->col_im[i];
+		}
+	}
+	if (inverse)
+		for(i=0; i < rows; i++)
+			fft_1d(&re[i*n], &im[i*n], n, s->w_re, s->w_im, TRUE);
+}
+
+/*
+ * floorplan of a square of side 'side' divided into 5 blocks:
+ * the centre cell of a 'grid' x 'grid' partition (block 0)
+ * and four fillers around it
+ */
+static flp_t *kernel_flp(double side, int grid)
+{
+	int i, c = grid / 2;
+	double d = side / grid;
+	flp_t *flp = (flp_t *) calloc (1, sizeof(flp_t));
+	if (!flp)
+		fatal("memory allocation error\n");
+	flp->n_units = 5;
+	flp->units = (unit_t *) calloc (flp->n_units, sizeof(unit_t));
+	flp->wire_density = (double **) calloc(flp->n_units, sizeof(double *));
+	if (!flp->units || !flp->wire_density)
+		fatal("memory allocation error\n");
+	for (i=0; i < flp->n_units; i++) {
+		flp->wire_density[i] = (double *) calloc(flp->n_units, sizeof(double));
+		if (!flp->wire_density[i])
+			fatal("memory allocation error\n");
+	}
+
+	/* source	*/
+	strcpy(flp->units[0].name, "source");
+	flp->units[0].leftx = c * d;
+	flp->units[0].bottomy = c * d;
+	flp->units[0].width = flp->units[0].height = d;
+	/* left and right fillers span the entire height	*/
+	strcpy(flp->units[1].name, "left");
+	flp->units[1].width = c * d;
+	flp->units[1].height = side;
+	strcpy(flp->units[2].name, "right");
+	flp->units[2].leftx = (c + 1) * d;
+	flp->units[2].width = side - (c + 1) * d;
+	flp->units[2].height = side;
+	/* bottom and top fillers	*/
+	strcpy(flp->units[3].name, "bottom");
+	flp->units[3].leftx = c * d;
+	flp->units[3].width = d;
+	flp->units[3].height = c * d;
+	strcpy(flp->units[4].name, "top");
+	flp->units[4].leftx = c * d;
+	flp->units[4].bottomy = (c + 1) * d;
+	flp->units[4].width = d;
+	flp->units[4].height = side - (c + 1) * d;
+
+	return flp;
+}
+
+surrogate_t *alloc_surrogate(thermal_config_t *config, double side, int grid)
+{
+	int i, j, n, di, dj, ki, kj, c = grid / 2;
+	double extent;
+	thermal_config_t kconfig = *config;
+	flp_t *flp;
+	RC_model_t *model;
+	double *power, *temp, **silicon;
+	surrogate_t *s;
+
+	if (grid < 2 || (grid & (grid-1)))
+		fatal("surrogate grid size should be a power of two\n");
+
+	s = (surrogate_t *) calloc (1, sizeof(surrogate_t));
+	if (!s)
+		fatal("memory allocation error\n");
+	s->ambient = config->ambient;
+
+	/*
+	 * the kernel is computed on a square chip twice as wide
+	 * as the largest floorplan so that the response is known
+	 * for all possible distances. it cannot be larger than
+	 * the spreader though. responses beyond its extent are
+	 * approximated with the values at its edge
+	 */
+	extent = MIN(2 * side, config->s_spreader);
+	s->dx = s->dy = extent / grid;
+	for(n=grid; n < 2 * ceil(side / s->dx); n <<= 1);
+	s->n = n;
+
+	/* grid model solve for unit power in the centre cell	*/
+	strcpy(kconfig.model_type, GRID_MODEL_STR);
+	strcpy(kconfig.grid_layer_file, NULLFILE);
+	strcpy(kconfig.grid_map_mode, GRID_CENTER_STR);
+	kconfig.grid_rows = kconfig.grid_cols = grid;
+	kconfig.model_secondary = FALSE;
+	kconfig.leakage_used = FALSE;
+	flp = kernel_flp(extent, grid);
+	model = alloc_RC_model(&kconfig, flp, NULL, NULL, 0, 0);
+	power = hotspot_vector(model);
+	temp = hotspot_vector(model);
+	power[0] = 1.0;
+	populate_R_model(model, flp);
+	steady_state_temp(model, power, temp);
+	silicon = model->grid->last_steady->cuboid[LAYER_SI];
+
+	/* temperature rise at offset (di, dj), stored circularly	*/
+	s->k_re = dvector(n * n);
+	s->k_im = dvector(n * n);
+	s->re = dvector(n * n);
+	s->im = dvector(n * n);
+	s->col_re = dvector(n);
+	s->col_im = dvector(n);
+	s->w_re = dvector(n/2);
+	s->w_im = dvector(n/2);
+	for(i=0; i < n/2; i++) {
+		s->w_re[i] = cos(2 * M_PI * i / n);
+		s->w_im[i] = -sin(2 * M_PI * i / n);
+	}
+	for(di=-n/2; di < n/2; di++)
+		for(dj=-n/2; dj < n/2; dj++) {
+			i = MAX(0, MIN(grid-1, c + di));
+			j = MAX(0, MIN(grid-1, c + dj));
+			ki = (di + n) % n;
+			kj = (dj + n) % n;
+			s->k_re[ki*n+kj] = silicon[i][j] - s->ambient;
+		}
+	fft_2d(s, s->k_re, s->k_im, n, FALSE);
+
+	#if VERBOSE > 0
+	fprintf(stdout, "surrogate kernel: %d x %d grid over %gm, peak rise %g K/W\n",
+			grid, grid, extent, silicon[c][c] - s->ambient);
+	#endif
+
+	free_dvector(power);
+	free_dvector(temp);
+	delete_RC_model(model);
+	free_flp(flp, 0, TRUE);
+
+	return s;
+}
+
+void delete_surrogate(surrogate_t *s)
+{
+	if (!s->shared) {
+		free_dvector(s->k_re);
+		free_dvector(s->k_im);
+		free_dvector(s->w_re);
+		free_dvector(s->w_im);
+	}
+	free_dvector(s->re);
+	free_dvector(s->im);
+	free_dvector(s->col_re);
+	free_dvector(s->col_im);
+	free(s);
+}
+
+surrogate_t *dup_surrogate(surrogate_t *s)
+{
+	surrogate_t *copy = (surrogate_t *) calloc (1, sizeof(surrogate_t));
+	if (!copy)
+		fatal("memory allocation error\n");
+	*copy = *s;
+	copy->shared = TRUE;
+	copy->re = dvector(s->n * s->n);
+	copy->im = dvector(s->n * s->n);
+	copy->col_re = dvector(s->n);
+	copy->col_im = dvector(s->n);
+	return copy;
+}
+
+/* overlap of [a1, a2) and [b1, b2)	*/
+static double overlap(double a1, double a2, double b1, double b2)
+{
+	return MAX(0.0, MIN(a2, b2) - MAX(a1, b1));
+}
+
+/*
+ * area of overlap between cell (i, j) and 'unit'. cells
+ * are indexed relative to (minx, miny)
+ */
+static double cell_overlap(surrogate_t *s, unit_t *unit, double minx,
+						   double miny, int i, int j)
+{
+	return overlap(i * s->dy, (i+1) * s->dy, unit->bottomy - miny,
+				   unit->bottomy + unit->height - miny) *
+		   overlap(j * s->dx, (j+1) * s->dx, unit->leftx - minx,
+				   unit->leftx + unit->width - minx);
+}
+
+/* range of cells covered by 'unit'	*/
+static void cell_range(surrogate_t *s, unit_t *unit, double minx, double miny,
+					   int *i1, int *i2, int *j1, int *j2)
+{
+	*i1 = MAX(0, (int) floor((unit->bottomy - miny) / s->dy));
+	*i2 = MIN(s->n-1, (int) ceil((unit->bottomy + unit->height - miny) / s->dy) - 1);
+	*j1 = MAX(0, (int) floor((unit->leftx - minx) / s->dx));
+	*j2 = MIN(s->n-1, (int) ceil((unit->leftx + unit->width - minx) / s->dx) - 1);
+}
+
+double surrogate_max_temp(surrogate_t *s, flp_t *flp, double *power)
+{
+	int i, j, u, i1, i2, j1, j2, n = s->n;
+	double minx = get_minx(flp), miny = get_miny(flp);
+	double area, cell, sum, tmax = 0.0;
+	unit_t *unit;
+
+	/* the linear convolution must not wrap around	*/
+	if (get_total_width(flp) > (n/2) * s->dx ||
+		get_total_height(flp) > (n/2) * s->dy)
+		return -1.0;
+
+	/* power map	*/
+	zero_dvector(s->re, n * n);
+	zero_dvector(s->im, n * n);
+	for(u=0; u < flp->n_units; u++) {
+		unit = &flp->units[u];
+		cell = unit->width * unit->height;
+		if (cell <= 0 || power[u] == 0)
+			continue;
+		cell_range(s, unit, minx, miny, &i1, &i2, &j1, &j2);
+		for(i=i1; i <= i2; i++)
+			for(j=j1; j <= j2; j++) {
+				area = cell_overlap(s, unit, minx, miny, i, j);
+				s->re[i*n+j] += power[u] * area / cell;
+			}
+	}
+
+	/* convolve with the kernel	*/
+	fft_2d(s, s->re, s->im, n/2, FALSE);
+	for(i=0; i < n * n; i++) {
+		double re = s->re[i] * s->k_re[i] - s->im[i] * s->k_im[i];
+		double im = s->re[i] * s->k_im[i] + s->im[i] * s->k_re[i];
+		s->re[i] = re;
+		s->im[i] = im;
+	}
+	fft_2d(s, s->re, s->im, n/2, TRUE);
+
+	/* peak of the block averages (inverse FFT is unscaled)	*/
+	for(u=0; u < flp->n_units; u++) {
+		unit = &flp->units[u];
+		cell = unit->width * unit->height;
+		if (cell <= 0)
+			continue;
+		sum = 0.0;
+		cell_range(s, unit, minx, miny, &i1, &i2, &j1, &j2);
+		for(i=i1; i <= i2; i++)
+			for(j=j1; j <= j2; j++) {
+				area = cell_overlap(s, unit, minx, miny, i, j);
+				sum += s->re[i*n+j] * area;
+			}
+		tmax = MAX(tmax, sum / cell / (n * n));
+	}
+
+	return s->ambient + tmax;
+}
@@ -0,0 +1,61 @@
+#ifndef __SURROGATE_H_
+#define __SURROGATE_H_
+
+#include "flp.h"
+#include "temperature.h"
+
+/*
+ * largest floorplan side handled by the surrogate during
+ * annealing, relative to that of a square of the same area
+ */
+#define SURROGATE_SLACK		1.5
+
+/*
+ * Green's function surrogate of the thermal model for
+ * floorplanning. the temperature rise of the silicon due to
+ * a unit power dissipated in one cell of a uniform grid is
+ * computed once with the grid model. assuming that this
+ * response is translation invariant, the temperature of any
+ * floorplan is then estimated as the convolution of its power
+ * density map with that response (done using FFTs).
+ */
+typedef struct surrogate_t_st
+{
+	/* FFT size (power of two) along each dimension	*/
+	int n;
+	/* dimensions of a grid cell	*/
+	double dx, dy;
+	double ambient;
+	/* FFT of the response kernel	*/
+	double *k_re, *k_im;
+	/* kernel owned by another instance?	*/
+	int shared;
+	/* scratch pad for the power/temperature maps	*/
+	double *re, *im;
+	/* scratch pad for a column and the twiddle factors	*/
+	double *col_re, *col_im;
+	double *w_re, *w_im;
+}surrogate_t;
+
+/*
+ * constructor/destructor. 'side' is the largest chip dimension
+ * expected. 'grid' is the resolution (a power of two) of the
+ * grid model solve that computes the kernel.
+ */
+surrogate_t *alloc_surrogate(thermal_config_t *config, double side, int grid);
+void delete_surrogate(surrogate_t *s);
+/*
+ * a copy of 's' that shares its kernel but has scratch
+ * pads of its own, so that both can be used concurrently.
+ * it should be deleted before 's'
+ */
+surrogate_t *dup_surrogate(surrogate_t *s);
+
+/*
+ * estimate of the peak block temperature of 'flp' for the
+ * block power numbers in 'power'. returns a negative value
+ * if 'flp' is too large for the kernel.
+ */
+double surrogate_max_temp(surrogate_t *s, flp_t *flp, double *power);
+
+#endif
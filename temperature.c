@@ -14,6 +14,18 @@
 #include "temperature_grid.h"
 #include "flp.h"
 #include "util.h"
+#include "profile.h"
+
+char *solver_names[N_SOLVERS] = {"rk4", "rk4_warm", "rk4_fixed", "euler", "auto"};
+
+int solver_index(char *name)
+{
+	int i;
+	for(i=0; i < N_SOLVERS; i++)
+		if (!strcasecmp(name, solver_names[i]))
+			return i;
+	return -1;
+}
 
 /* default thermal configuration parameters	*/
 thermal_config_t default_thermal_config(void)
@@ -74,6 +86,15 @@ thermal_config_t default_thermal_config(void)
   strcpy(config.grid_transient_file, NULLFILE);
  	/* 3.33 us sampling interval = 10K cycles at 3GHz	*/
 	config.sampling_intvl = 3.333e-6;
+	config.rk4_tolerance = 0.01;
+	/* the integrator each build has always used	*/
+#if SUPERLU > 0
+	strcpy(config.transient_solver, solver_names[SOLVER_EULER]);
+#else
+	strcpy(config.transient_solver, solver_names[SOLVER_RK4]);
+#endif
+	strcpy(config.solver_cache, NULLFILE);
+	config.quiet_tolerance = 0;
 	config.base_proc_freq = 3e9;		/* base processor frequency in Hz	*/
 	config.dtm_used = FALSE;			/* set accordingly	*/
 
@@ -228,6 +249,18 @@ void thermal_config_add_from_strs(thermal_config_t *config, materials_list_t *ma
 	if ((idx = get_str_index(table, size, "sampling_intvl")) >= 0)
 		if(sscanf(table[idx].value, "%lf", &config->sampling_intvl) != 1)
 			fatal("invalid format for configuration  parameter sampling_intvl\n");
+	if ((idx = get_str_index(table, size, "rk4_tolerance")) >= 0)
+		if(sscanf(table[idx].value, "%lf", &config->rk4_tolerance) != 1)
+			fatal("invalid format for configuration  parameter rk4_tolerance\n");
+	if ((idx = get_str_index(table, size, "transient_solver")) >= 0)
+		if(sscanf(table[idx].value, "%s", config->transient_solver) != 1)
+			fatal("invalid format for configuration  parameter transient_solver\n");
+	if ((idx = get_str_index(table, size, "solver_cache")) >= 0)
+		if(sscanf(table[idx].value, "%s", config->solver_cache) != 1)
+			fatal("invalid format for configuration  parameter solver_cache\n");
+	if ((idx = get_str_index(table, size, "quiet_tolerance")) >= 0)
+		if(sscanf(table[idx].value, "%lf", &config->quiet_tolerance) != 1)
+			fatal("invalid format for configuration  parameter quiet_tolerance\n");
 	if ((idx = get_str_index(table, size, "base_proc_freq")) >= 0)
 		if(sscanf(table[idx].value, "%lf", &config->base_proc_freq) != 1)
 			fatal("invalid format for configuration  parameter base_proc_freq\n");
@@ -285,7 +318,8 @@ void thermal_config_add_from_strs(thermal_config_t *config, materials_list_t *ma
 		fatal("secondary heat tranfer path is supported only in the grid mode\n");
 	if ((config->thermal_threshold < 0) || (config->c_convec < 0) ||
 		(config->r_convec < 0) || (config->ambient < 0) ||
-		(config->base_proc_freq <= 0) || (config->sampling_intvl <= 0))
+		(config->base_proc_freq <= 0) || (config->sampling_intvl <= 0) ||
+		(config->rk4_tolerance <= 0) || (config->quiet_tolerance < 0))
 		fatal("invalid thermal simulation parameters\n");
 	if (strcasecmp(config->model_type, BLOCK_MODEL_STR) &&
 		strcasecmp(config->model_type, GRID_MODEL_STR))
@@ -297,6 +331,12 @@ void thermal_config_add_from_strs(thermal_config_t *config, materials_list_t *ma
 		strcasecmp(config->grid_map_mode, GRID_MAX_STR) &&
 		strcasecmp(config->grid_map_mode, GRID_CENTER_STR))
 		fatal("invalid mapping mode. use 'avg', 'min', 'max' or 'center'\n");
+	if (solver_index(config->transient_solver) < 0)
+		fatal("invalid transient solver. use 'rk4', 'rk4_warm', 'rk4_fixed', 'euler' or 'auto'\n");
+#if SUPERLU < 1
+	if (solver_index(config->transient_solver) == SOLVER_EULER)
+		fatal("the euler transient solver needs SuperLU (build with SUPERLU=1)\n");
+#endif
 
   if ((idx = get_str_index(table, size, "material_chip")) >= 0) {
     char material_name[STR_SIZE];
@@ -345,7 +385,7 @@ void thermal_config_add_from_strs(thermal_config_t *config, materials_list_t *ma
  */
 int thermal_config_to_strs(thermal_config_t *config, str_pair *table, int max_entries)
 {
-	if (max_entries < 51)
+	if (max_entries < 55)
 		fatal("not enough entries in table\n");
 
 	sprintf(table[0].name, "t_chip");
@@ -399,7 +439,10 @@ int thermal_config_to_strs(thermal_config_t *config, str_pair *table, int max_en
 	sprintf(table[48].name, "grid_map_mode");
     sprintf(table[49].name, "grid_transient_file");
     sprintf(table[50].name, "detailed_3D_used");
-	//sprintf(table[51].name, "all_transient_file");
+	sprintf(table[51].name, "rk4_tolerance");
+	sprintf(table[52].name, "transient_solver");
+	sprintf(table[53].name, "solver_cache");
+	sprintf(table[54].name, "quiet_tolerance");
 
 	sprintf(table[0].value, "%lg", config->t_chip);
 	sprintf(table[1].value, "%lg", config->k_chip);
@@ -452,9 +495,12 @@ int thermal_config_to_strs(thermal_config_t *config, str_pair *table, int max_en
 	sprintf(table[48].value, "%s", config->grid_map_mode);
 	sprintf(table[49].value, "%s", config->grid_transient_file);
 	sprintf(table[50].value, "%d", config->detailed_3D_used);
-	//sprintf(table[51].value, "%s", config->all_transient_file);
+	sprintf(table[51].value, "%lg", config->rk4_tolerance);
+	sprintf(table[52].value, "%s", config->transient_solver);
+	sprintf(table[53].value, "%s", config->solver_cache);
+	sprintf(table[54].value, "%lg", config->quiet_tolerance);
 
-	return 51;
+	return 55;
 }
 
 /* package parameter routines	*/
@@ -619,6 +665,8 @@ void debug_print_package_RC(package_RC_t *p)
 RC_model_t *alloc_RC_model(thermal_config_t *config, flp_t *placeholder, microchannel_config_t *microchannel_config, materials_list_t *materials_list,
 	                         int do_detailed_3D, int use_microchannels) //BU_3D: do_detailed_3D option added.
 {
+	double start = prof_begin();
+	mem_tag_t tag = mem_set_tag(MEM_MODEL);
 	RC_model_t *model= (RC_model_t *) calloc (1, sizeof(RC_model_t));
 	if (!model)
 		fatal("memory allocation error\n");
@@ -632,94 +680,168 @@ RC_model_t *alloc_RC_model(thermal_config_t *config, flp_t *placeholder, microch
 		model->config = &model->grid->config;
 	} else
 		fatal("unknown model type\n");
+	mem_set_tag(tag);
+	prof_end(PROF_ALLOC, start);
 	return model;
 }
 
+double estimate_RC_model_memory(thermal_config_t *config, flp_t *placeholder,
+								int do_transient, double *bytes)
+{
+	int i;
+	double total = 0;
+
+	for(i=0; i < MEM_N_TAGS; i++)
+		bytes[i] = 0;
+	if(!(strcasecmp(config->model_type, BLOCK_MODEL_STR)))
+		estimate_memory_block(placeholder->n_units, do_transient, bytes);
+	else if(!(strcasecmp(config->model_type, GRID_MODEL_STR)))
+		estimate_memory_grid(config, do_transient, bytes);
+	else
+		fatal("unknown model type\n");
+	for(i=0; i < MEM_N_TAGS; i++)
+		total += bytes[i];
+	return total;
+}
+
 /* populate the thermal restistance values */
 void populate_R_model(RC_model_t *model, flp_t *flp)
 {
+	double start = prof_begin();
+	mem_tag_t tag = mem_set_tag(MEM_MODEL);
 	if (model->type == BLOCK_MODEL)
 		populate_R_model_block(model->block, flp);
 	else if (model->type == GRID_MODEL)
 		populate_R_model_grid(model->grid, flp);
 	else fatal("unknown model type\n");
+	mem_set_tag(tag);
+	prof_end(PROF_POPULATE_R, start);
 }
 
 /* populate the thermal capacitance values */
 void populate_C_model(RC_model_t *model, flp_t *flp)
 {
+	double start = prof_begin();
+	mem_tag_t tag = mem_set_tag(MEM_MODEL);
 	if (model->type == BLOCK_MODEL)
 		populate_C_model_block(model->block, flp);
 	else if (model->type == GRID_MODEL)
 		populate_C_model_grid(model->grid, flp);
 	else fatal("unknown model type\n");
+	mem_set_tag(tag);
+	prof_end(PROF_POPULATE_C, start);
 }
 
-// /* steady state temperature	*/
-// void steady_state_temp(RC_model_t *model, double *power, double *temp)
-// {
-// 	int leak_convg_true = 0;
-// 	int leak_iter = 0;
-// 	int n, base=0;
-// 	//int idx=0;
-// 	double blk_height, blk_width;
-// 	int i, j, k;
-
-// 	double *d_temp = NULL;
-// 	double *temp_old = NULL;
-// 	double *power_new = NULL;
-// 	double d_max=0.0;
-
-// 	if (model->type == BLOCK_MODEL) {
-// 		fatal("HotSpot was run with block model. Incompatible with ThermSniper toolchain.");
-// 	}
-// 	else if (model->type == GRID_MODEL)	{
-// 		if (model->config->leakage_used) { // if considering leakage-temperature loop
-// 			d_temp = hotspot_vector(model);
-// 			temp_old = hotspot_vector(model);
-// 			power_new = hotspot_vector(model);
-// 			for (leak_iter=0;(!leak_convg_true)&&(leak_iter<=LEAKAGE_MAX_ITER);leak_iter++){
-// 				for(k=0, base=0; k < model->grid->n_layers; k++) {
-// 					printf("steady_state_temp(): LAYER %d:\n", k);
-// 					if(model->grid->layers[k].has_power)
-// 						for(j=0; j < model->grid->layers[k].flp->n_units; j++) {
-// 							//printf("floorplan element name: %s\n", model->grid->layers[k].flp->units[j].name);
-// 							blk_height = model->grid->layers[k].flp->units[j].height;
-// 							blk_width  = model->grid->layers[k].flp->units[j].width;
-// 							power_new[base+j] = power[base+j] + get_leakage(model->grid->layers[k].flp->units[j].name, model->config->leakage_mode, blk_height, blk_width, temp[base+j]);
-// 							temp_old[base+j] = temp[base+j]; //copy temp before update
-// 						}
-// 					base += model->grid->layers[k].flp->n_units;
-// 				}
-// 				steady_state_temp_grid(model->grid, power_new, temp);
-// 				d_max = 0.0;
-// 				for(k=0, base=0; k < model->grid->n_layers; k++) {
-// 					if(model->grid->layers[k].has_power)
-// 						for(j=0; j < model->grid->layers[k].flp->n_units; j++) {
-// 							d_temp[base+j] = temp[base+j] - temp_old[base+j]; //temperature increase due to leakage
-// 							if (d_temp[base+j]>d_max)
-// 								d_max = d_temp[base+j];
-// 						}
-// 					base += model->grid->layers[k].flp->n_units;
-// 				}
-// 				if (d_max < LEAK_TOL) {// check convergence
-// 					leak_convg_true = 1;
-// 				}
-// 				if (d_max > TEMP_HIGH && leak_iter > 0) {// check to make sure d_max is not "nan" (esp. in natural convection)
-// 					fatal("temperature is too high, possible thermal runaway. Double-check power inputs and package settings.\n");
-// 				}
-// 			}
-// 			free(d_temp);
-// 			free(temp_old);
-// 			free(power_new);
-// 			/* if no convergence after max number of iterations, thermal runaway */
-// 			if (!leak_convg_true)
-// 				fatal("too many iterations before temperature-leakage convergence -- possible thermal runaway\n");
-// 		} else // if leakage-temperature loop is not considered
-// 			steady_state_temp_grid(model->grid, power, temp);
-// 	}
-// 	else fatal("unknown model type\n");
-// }
+/* steady state temperature	*/
+void steady_state_temp(RC_model_t *model, double *power, double *temp)
+{
+	int leak_convg_true = 0;
+	int leak_iter = 0;
+	int base=0;
+	//int idx=0;
+	double blk_height, blk_width;
+	int j, k;
+
+	double *d_temp = NULL;
+	double *temp_old = NULL;
+	double *power_new = NULL;
+	double d_max=0.0;
+	double start;
+
+	/* block model is only used by HotFloorplan. no leakage loop there	*/
+	if (model->type == BLOCK_MODEL)
+		steady_state_temp_block(model->block, power, temp);
+	else if (model->type == GRID_MODEL)	{
+		if (model->config->leakage_used) { // if considering leakage-temperature loop
+			d_temp = hotspot_vector(model);
+			temp_old = hotspot_vector(model);
+			power_new = hotspot_vector(model);
+			for (leak_iter=0;(!leak_convg_true)&&(leak_iter<=LEAKAGE_MAX_ITER);leak_iter++){
+				start = prof_begin();
+				for(k=0, base=0; k < model->grid->n_layers; k++) {
+					if(model->grid->layers[k].has_power)
+						for(j=0; j < model->grid->layers[k].flp->n_units; j++) {
+							//printf("floorplan element name: %s\n", model->grid->layers[k].flp->units[j].name);
+							blk_height = model->grid->layers[k].flp->units[j].height;
+							blk_width  = model->grid->layers[k].flp->units[j].width;
+							power_new[base+j] = power[base+j] + get_leakage(model->grid->layers[k].flp->units[j].name, model->config->leakage_mode, blk_height, blk_width, temp[base+j]);
+							temp_old[base+j] = temp[base+j]; //copy temp before update
+						}
+					base += model->grid->layers[k].flp->n_units;
+				}
+				prof_end(PROF_LEAKAGE, start);
+				PROF_COUNT(leakage_iters, 1);
+				steady_state_temp_grid(model->grid, power_new, temp);
+				d_max = 0.0;
+				for(k=0, base=0; k < model->grid->n_layers; k++) {
+					if(model->grid->layers[k].has_power)
+						for(j=0; j < model->grid->layers[k].flp->n_units; j++) {
+							d_temp[base+j] = temp[base+j] - temp_old[base+j]; //temperature increase due to leakage
+							if (d_temp[base+j]>d_max)
+								d_max = d_temp[base+j];
+						}
+					base += model->grid->layers[k].flp->n_units;
+				}
+				if (d_max < LEAK_TOL) {// check convergence
+					leak_convg_true = 1;
+				}
+				if (d_max > TEMP_HIGH && leak_iter > 0) {// check to make sure d_max is not "nan" (esp. in natural convection)
+					fatal("temperature is too high, possible thermal runaway. Double-check power inputs and package settings.\n");
+				}
+			}
+			free_dvector(d_temp);
+			free_dvector(temp_old);
+			free_dvector(power_new);
+			/* if no convergence after max number of iterations, thermal runaway */
+			if (!leak_convg_true)
+				fatal("too many iterations before temperature-leakage convergence -- possible thermal runaway\n");
+		} else // if leakage-temperature loop is not considered
+			steady_state_temp_grid(model->grid, power, temp);
+	}
+	else fatal("unknown model type\n");
+}
+
+/*
+ * steady state temperature, using the contents of 'temp' (or the
+ * model's previous solution) as the initial guess. useful when
+ * the floorplan or the power changes only slightly between
+ * calls, as in the annealing loop of HotFloorplan. the
+ * temperature-leakage loop is not considered here.
+ */
+void steady_state_temp_warm(RC_model_t *model, double *power, double *temp)
+{
+	if (model->type == BLOCK_MODEL)
+		steady_state_temp_warm_block(model->block, power, temp);
+	else if (model->type == GRID_MODEL)
+		steady_state_temp_warm_grid(model->grid, power, temp);
+	else fatal("unknown model type\n");
+}
+
+/*
+ * steady state temperatures of 'n' independent power maps.
+ * 'power' and 'temp' are arrays of 'n' hotspot vectors. the
+ * factorization of the conductance matrix (block model and
+ * grid model with SuperLU) is shared by all the maps. with
+ * the temperature-leakage loop, the problem is no longer
+ * linear and the maps are solved one at a time
+ */
+void steady_state_temp_batch(RC_model_t *model, double **power, double **temp, int n)
+{
+	int k;
+
+	if (model->type == BLOCK_MODEL)
+		/* the LUP decomposition is computed once and cached	*/
+		for(k=0; k < n; k++)
+			steady_state_temp_block(model->block, power[k], temp[k]);
+	else if (model->type == GRID_MODEL) {
+		if (model->config->leakage_used)
+			for(k=0; k < n; k++)
+				steady_state_temp(model, power[k], temp[k]);
+		else
+			steady_state_temp_batch_grid(model->grid, power, temp, n);
+	}
+	else fatal("unknown model type\n");
+}
 
 /* transient (instantaneous) temperature	*/
 void compute_temp(RC_model_t *model, double *power, int first_invocation, double *tot_power_dump, double time_elapsed)
@@ -733,6 +855,7 @@ void compute_temp(RC_model_t *model, double *power, int first_invocation, double
 		int j, k;
 		double *power_new = hotspot_vector(model);
 		double blk_height, blk_width;
+		double start = prof_begin();
 
 		for(k=0, base=0; k < model->grid->n_layers; k++) 
 		{				
@@ -756,6 +879,7 @@ void compute_temp(RC_model_t *model, double *power, int first_invocation, double
 				}
 			base += model->grid->layers[k].flp->n_units;					
 		}
+		prof_end(PROF_LEAKAGE, start);
 		
 		if (model->config->leakage_used) 
 		{
@@ -770,7 +894,7 @@ void compute_temp(RC_model_t *model, double *power, int first_invocation, double
 			compute_temp_grid(model->grid, power, first_invocation, time_elapsed);	
 		}
 
-		free(power_new);
+		free_dvector(power_new);
 	}
 	else fatal("unknown model type\n");
 }
@@ -982,12 +1106,17 @@ double calc_leakage_TxRx(double h, double w, double temp)
 /* leakage model must be adjusted to simulated target technology 
     h,w: height,width in meters, temp: temperature in K */
 double get_ONoC_tuning_pwr(double temp)
+{
+	return get_ONoC_tuning_pwr_pv(temp, pvmod_ONoC_MRR);
+}
+
+double get_ONoC_tuning_pwr_pv(double temp, double pvmod)
 {	
 	double therm_mod_ONoC_MRR = fmod(alpha_ONoC_MRR * (temp-Tref_ONoC_MRR), S_ONoC_MRR);
 
 	if (therm_mod_ONoC_MRR < 0) therm_mod_ONoC_MRR += S_ONoC_MRR;  // ensure positive modulo (in case delta T negative)
 
-	double offset = fmod(pvmod_ONoC_MRR + therm_mod_ONoC_MRR, S_ONoC_MRR);
+	double offset = fmod(pvmod + therm_mod_ONoC_MRR, S_ONoC_MRR);
 
 	double delta_lambda_heat = fmod(S_ONoC_MRR - offset, S_ONoC_MRR);
 
@@ -25,6 +25,17 @@
 #define	GRID_MAX_STR	"max"
 #define	GRID_CENTER_STR	"center"
 
+/* transient integrators	*/
+#define	SOLVER_RK4			0	/* adaptive RK4, restarted at MIN_STEP every interval	*/
+#define	SOLVER_RK4_WARM		1	/* adaptive RK4, starting from the last interval's step	*/
+#define	SOLVER_RK4_FIXED	2	/* RK4 at a fixed step derived from the spectral radius	*/
+#define	SOLVER_EULER		3	/* backward Euler, one step per interval (SuperLU only)	*/
+#define	SOLVER_AUTO			4	/* the fastest of the above (see compute_temp_grid)	*/
+#define	N_SOLVERS			5
+extern char *solver_names[N_SOLVERS];
+/* index of a solver name, -1 if unknown	*/
+int solver_index(char *name);
+
 /* temperature-leakage loop constants */
 #define LEAKAGE_MAX_ITER 100 /* max thermal-leakage iteration number, if exceeded, report thermal runaway*/
 #define LEAK_TOL	0.01 /* thermal-leakage temperature convergence criterion */
@@ -189,6 +200,16 @@ typedef struct thermal_config_t_st
 	/* steady state temperatures to file	*/
 	char steady_file[STR_SIZE];
 	double sampling_intvl;	/* interval per call to compute_temp	*/
+	double rk4_tolerance;	/* max. error (in K) per step of the RK4 solver	*/
+	char transient_solver[STR_SIZE];	/* one of solver_names	*/
+	/*
+	 * skip the integration of an interval whose power is unchanged when
+	 * all the temperatures are within this (in K) of the steady state for
+	 * that power. 0 to always integrate
+	 */
+	double quiet_tolerance;
+	/* decisions of the 'auto' solver, by model hash	*/
+	char solver_cache[STR_SIZE];
 	double base_proc_freq;	/* in Hz	*/
 	int dtm_used;			/* flag to guide the scaling of init Ts	*/
 	/* model type - block or grid */
@@ -363,6 +384,12 @@ typedef struct RC_model_t_st
 RC_model_t *alloc_RC_model(thermal_config_t *config, flp_t *placeholder, microchannel_config_t *microchannel_config, materials_list_t *materials_list,
 	                         int do_detailed_3D, int use_microchannels);
 void delete_RC_model(RC_model_t *model);
+/*
+ * memory the model will need, in bytes per tag (see mem_tag_t),
+ * to be checked before allocating. returns the total
+ */
+double estimate_RC_model_memory(thermal_config_t *config, flp_t *placeholder,
+								int do_transient, double *bytes);
 
 /* initialization	*/
 void populate_R_model(RC_model_t *model, flp_t *flp);
@@ -370,6 +397,10 @@ void populate_C_model(RC_model_t *model, flp_t *flp);
 
 /* hotspot main interfaces - temperature.c	*/
 void steady_state_temp(RC_model_t *model, double *power, double *temp);
+/* same as above, warm-started from the previous solution	*/
+void steady_state_temp_warm(RC_model_t *model, double *power, double *temp);
+/* steady state temperatures of 'n' power maps with one factorization	*/
+void steady_state_temp_batch(RC_model_t *model, double **power, double **temp, int n);
 void compute_temp(RC_model_t *model, double *power, int first_invocation, double *tot_power_dump, double time_elapsed);
 /* differs from 'dvector()' in that memory for internal nodes is also allocated	*/
 double *hotspot_vector(RC_model_t *model);
@@ -405,7 +436,10 @@ double getcap(double sp_heat, double thickness, double area);
 void lusolve(double **a, int n, int *p, double *b, double *x, int spd);
 
 /* 4th order Runge Kutta solver with adaptive step sizing */
-double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slope_fn_ptr f);
+double rk4(void *model, double *y, void *p, int n, double *h, double *yout, slope_fn_ptr f,
+		   double precision);
+/* a single RK4 step of size 'h' from 'y' with slope 'k1' at 'y'	*/
+void rk4_core(void *model, double *y, double *k1, void *p, int n, double h, double *yout, slope_fn_ptr f);
 
 #if SUPERLU > 0
 /* Backward Euler solver with adaptive step sizing */
@@ -434,6 +468,8 @@ void scaleadd_dvector (double *dst, double *src1, double *src2, int n, double sc
 
 /* temperature-aware MRR tuning power calculation*/
 double get_ONoC_tuning_pwr(double temp);
+/* same as above for a process variation offset other than TxRx_pvmod	*/
+double get_ONoC_tuning_pwr_pv(double temp, double pvmod);
 
 /* temperature-aware leakage calculation depending on component type */
 double get_leakage(const char* component_name, int mode, double h, double w, double temp); 
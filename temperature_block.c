@@ -56,6 +56,17 @@ block_model_t *alloc_block_model(thermal_config_t *config, flp_t *placeholder)
 	return model;
 }
 
+/* the matrices above and the vectors of the RK4 solver	*/
+void estimate_memory_block(int n_units, int do_transient, double *bytes)
+{
+	double n = n_units, m = NL*n_units+EXTRA;
+
+	bytes[MEM_MODEL] += (n*n + 4*m*m + 9*n + 4*m + EXTRA) * sizeof(double) +
+						(4*n + m) * sizeof(int);
+	if (do_transient)
+		bytes[MEM_SOLVER] += 8*m * sizeof(double);
+}
+
 /* creates matrices  B and invB: BT = Power in the steady state.
  * NOTE: EXTRA nodes: 4 heat spreader peripheral nodes, 4 heat
  * sink inner peripheral nodes, 4 heat sink outer peripheral
@@ -70,9 +81,8 @@ void populate_R_model_block(block_model_t *model, flp_t *flp)
 	double *gx_sp = model->gx_sp, *gy_sp = model->gy_sp;
 	double *gx_hs = model->gx_hs, *gy_hs = model->gy_hs;
 	double *g_amb = model->g_amb;
-	double **len = model->len, **g = model->g, **lu = model->lu;
+	double **len = model->len, **g = model->g;
 	int **border = model->border;
-	int *p = model->p;
 	double t_chip = model->config.t_chip;
 	double r_convec = model->config.r_convec;
 	double s_sink = model->config.s_sink;
@@ -273,8 +283,23 @@ void populate_R_model_block(block_model_t *model, flp_t *flp)
 				b[i][i] -= b[i][j];
 	}
 
-	/* compute the LUP decomposition of B and store it too	*/
-	copy_dmatrix(lu, b, NL*n+EXTRA, NL*n+EXTRA);
+	/*
+	 * the LUP decomposition of B is computed lazily on the
+	 * first direct solve. the iterative solver does not
+	 * need it at all, which saves an O(n^3) step per
+	 * floorplan evaluation
+	 */
+	model->lu_ready = FALSE;
+
+	/* done	*/
+	model->flp = flp;
+	model->r_ready = TRUE;
+}
+
+/* compute the LUP decomposition of B and store it too	*/
+static void factorize_R_model_block(block_model_t *model)
+{
+	copy_dmatrix(model->lu, model->b, model->n_nodes, model->n_nodes);
 	/*
 	 * B is a symmetric positive definite matrix. It is
 	 * symmetric because if a node A is connected to B,
@@ -287,11 +312,8 @@ void populate_R_model_block(block_model_t *model, flp_t *flp)
 	 * = total power dissipated in the resistors > 0
 	 * for x != 0.
 	 */
-	lupdcmp(lu, NL*n+EXTRA, p, 1);
-
-	/* done	*/
-	model->flp = flp;
-	model->r_ready = TRUE;
+	lupdcmp(model->lu, model->n_nodes, model->p, 1);
+	model->lu_ready = TRUE;
 }
 
 /* creates 2 matrices: invA, C: dT + A^-1*BT = A^-1*Power,
@@ -400,16 +422,238 @@ void steady_state_temp_block(block_model_t *model, double *power, double *temp)
 	if (!model->r_ready)
 		fatal("R model not ready\n");
 
+	if (!model->lu_ready)
+		factorize_R_model_block(model);
+
 	/* set power numbers for the virtual nodes */
 	set_internal_power_block(model, power);
 
 	/*
 	 * find temperatures (spd flag is set to 1 by the same argument
-	 * as mentioned in the populate_R_model_block function)
+	 * as mentioned in the factorize_R_model_block function)
 	 */
 	lusolve(model->lu, model->n_nodes, model->p, power, temp, 1);
 }
 
+/*
+ * data for the conjugate gradient solver below. b is stored
+ * in the compressed sparse row format since only adjacent
+ * blocks are connected laterally. the preconditioner is the
+ * sum of two parts. the vertical conductances between the
+ * layers of a block are much higher than the lateral ones
+ * within the chip. on the other hand, the spreader and the
+ * sink are laterally so well-connected that their average
+ * temperatures converge very slowly. hence,
+ * z = M^-1 * r + Z * E^-1 * Z^T * r. M is the block diagonal
+ * of b with one NL x NL block for each vertical column of
+ * nodes (the diagonal for the package nodes). Z has one column
+ * per layer (ones on the nodes of that layer) and one per
+ * package node. E = Z^T * b * Z is the coarse matrix
+ */
+#define COARSE_GROUP(k, n)	(((k) < NL*(n)) ? ((k) / (n)) : (NL + (k) - NL*(n)))
+#define N_COARSE			(NL + EXTRA)
+
+typedef struct pcg_block_t_st
+{
+	/* b in compressed sparse row format	*/
+	int *row_ptr;
+	int *col_idx;
+	double *val;
+	/* inverses of the column blocks, one row per block	*/
+	double **minv;
+	/* LUP decomposition of the coarse matrix	*/
+	double **e;
+	int *ep;
+}pcg_block_t;
+
+static void setup_pcg_block(block_model_t *model, pcg_block_t *pc)
+{
+	int i, j, l, k, nnz, n = model->n_units, m = model->n_nodes;
+	double **b = model->b;
+	double **col = dmatrix(NL, NL);
+	int *cp = ivector(NL);
+	double unit[NL], x[NL];
+
+	pc->minv = dmatrix(n, NL*NL);
+	pc->e = dmatrix(N_COARSE, N_COARSE);
+	pc->ep = ivector(N_COARSE);
+
+	/* sparse b and the coarse matrix	*/
+	nnz = 0;
+	for(i=0; i < m; i++)
+		for(j=0; j < m; j++)
+			if (b[i][j] != 0.0)
+				nnz++;
+	pc->row_ptr = ivector(m+1);
+	pc->col_idx = ivector(nnz);
+	pc->val = dvector(nnz);
+	nnz = 0;
+	for(i=0; i < m; i++) {
+		pc->row_ptr[i] = nnz;
+		for(j=0; j < m; j++)
+			if (b[i][j] != 0.0) {
+				pc->col_idx[nnz] = j;
+				pc->val[nnz++] = b[i][j];
+				pc->e[COARSE_GROUP(i, n)][COARSE_GROUP(j, n)] += b[i][j];
+			}
+	}
+	pc->row_ptr[m] = nnz;
+	lupdcmp(pc->e, N_COARSE, pc->ep, 1);
+
+	/* column blocks	*/
+	for(i=0; i < n; i++) {
+		for(l=0; l < NL; l++)
+			for(k=0; k < NL; k++)
+				col[l][k] = b[l*n+i][k*n+i];
+		lupdcmp(col, NL, cp, 1);
+		for(k=0; k < NL; k++) {
+			for(l=0; l < NL; l++)
+				unit[l] = (l == k);
+			lusolve(col, NL, cp, unit, x, 1);
+			for(l=0; l < NL; l++)
+				pc->minv[i][l*NL+k] = x[l];
+		}
+	}
+
+	free_dmatrix(col);
+	free_ivector(cp);
+}
+
+static void free_pcg_block(pcg_block_t *pc)
+{
+	free_ivector(pc->row_ptr);
+	free_ivector(pc->col_idx);
+	free_dvector(pc->val);
+	free_dmatrix(pc->minv);
+	free_dmatrix(pc->e);
+	free_ivector(pc->ep);
+}
+
+/* vout = b * vin using the sparse copy of b	*/
+static void matvectmult_pcg_block(pcg_block_t *pc, double *vout, double *vin, int n)
+{
+	int i, k;
+	for(i=0; i < n; i++) {
+		vout[i] = 0.0;
+		for(k=pc->row_ptr[i]; k < pc->row_ptr[i+1]; k++)
+			vout[i] += pc->val[k] * vin[pc->col_idx[k]];
+	}
+}
+
+static void apply_precond_block(block_model_t *model, pcg_block_t *pc,
+								double *r, double *z)
+{
+	int i, l, k, n = model->n_units, m = model->n_nodes;
+	double rc[N_COARSE], yc[N_COARSE];
+
+	/* z = M^-1 * r	*/
+	for(i=0; i < n; i++)
+		for(l=0; l < NL; l++) {
+			z[l*n+i] = 0.0;
+			for(k=0; k < NL; k++)
+				z[l*n+i] += pc->minv[i][l*NL+k] * r[k*n+i];
+		}
+	for(i=NL*n; i < m; i++)
+		z[i] = r[i] / model->b[i][i];
+
+	/* z += Z * E^-1 * Z^T * r	*/
+	for(i=0; i < N_COARSE; i++)
+		rc[i] = 0.0;
+	for(i=0; i < m; i++)
+		rc[COARSE_GROUP(i, n)] += r[i];
+	lusolve(pc->e, N_COARSE, pc->ep, rc, yc, 1);
+	for(i=0; i < m; i++)
+		z[i] += yc[COARSE_GROUP(i, n)];
+}
+
+/*
+ * solve b * temp = power iteratively using the preconditioned
+ * conjugate gradient method (b is symmetric positive definite).
+ * 'temp' is used as the initial guess. when it is close to the
+ * solution (e.g., the temperatures of a slightly different
+ * floorplan), few iterations are needed. each iteration costs
+ * a sparse matrix-vector product, as opposed to the O(n^3) LUP
+ * decomposition of the direct solver. if the method does not
+ * converge within n_nodes iterations, falls back to the direct
+ * solver. returns the no. of iterations.
+ */
+int steady_state_temp_warm_block(block_model_t *model, double *power, double *temp)
+{
+	int i, k, n = model->n_nodes;
+	double *r, *z, *d, *q;
+	double rz, rz_old, rr, pp, alpha, dq;
+	pcg_block_t pc;
+
+	if (!model->r_ready)
+		fatal("R model not ready\n");
+
+	/* set power numbers for the virtual nodes */
+	set_internal_power_block(model, power);
+
+	r = dvector(n);
+	z = dvector(n);
+	d = dvector(n);
+	q = dvector(n);
+	setup_pcg_block(model, &pc);
+
+	/* r = power - b * temp	*/
+	matvectmult_pcg_block(&pc, r, temp, n);
+	pp = 0.0;
+	for(i=0; i < n; i++) {
+		r[i] = power[i] - r[i];
+		pp += power[i] * power[i];
+	}
+	apply_precond_block(model, &pc, r, z);
+	rz = 0.0;
+	for(i=0; i < n; i++) {
+		d[i] = z[i];
+		rz += r[i] * z[i];
+	}
+
+	for(k=0; k < n; k++) {
+		rr = 0.0;
+		for(i=0; i < n; i++)
+			rr += r[i] * r[i];
+		if (rr <= WARM_TOL * WARM_TOL * pp)
+			break;
+
+		/* q = b * d	*/
+		matvectmult_pcg_block(&pc, q, d, n);
+		dq = 0.0;
+		for(i=0; i < n; i++)
+			dq += d[i] * q[i];
+		alpha = rz / dq;
+
+		for(i=0; i < n; i++) {
+			temp[i] += alpha * d[i];
+			r[i] -= alpha * q[i];
+		}
+		apply_precond_block(model, &pc, r, z);
+		rz_old = rz;
+		rz = 0.0;
+		for(i=0; i < n; i++)
+			rz += r[i] * z[i];
+		for(i=0; i < n; i++)
+			d[i] = z[i] + (rz / rz_old) * d[i];
+	}
+
+	free_dvector(r);
+	free_dvector(z);
+	free_dvector(d);
+	free_dvector(q);
+	free_pcg_block(&pc);
+
+	/* no convergence - solve directly	*/
+	if (k >= n) {
+		#if VERBOSE > 1
+		fprintf(stdout, "warm-started steady state solver did not converge\n");
+		#endif
+		steady_state_temp_block(model, power, temp);
+	}
+
+	return k;
+}
+
 /* compute the slope vector dy for the transient equation
  * dy + cy = p. useful in the transient solver
  */
@@ -474,7 +718,7 @@ void compute_temp_block(block_model_t *model, double *power, double *temp, doubl
 		h = new_h;
 		new_h = rk4(model, temp, model->t_vector, model->n_nodes, &h,
 		/* the slope function callback is typecast accordingly */
-					temp, (slope_fn_ptr) slope_fn_block);
+					temp, (slope_fn_ptr) slope_fn_block, model->config.rk4_tolerance);
 		new_h = MIN(new_h, time_elapsed-t-h);
 		#if VERBOSE > 1
 		i++;
@@ -519,6 +763,7 @@ void resize_thermal_model_block(block_model_t *model, int n_units)
 	resize_dmatrix(model->b, model->n_nodes, model->n_nodes);
 	resize_dmatrix(model->c, model->n_nodes, model->n_nodes);
 	resize_dmatrix(model->lu, model->n_nodes, model->n_nodes);
+	model->lu_ready = FALSE;
 }
 
 /* sets the temperature of a vector 'temp' allocated using 'hotspot_vector'	*/
@@ -866,6 +1111,7 @@ void debug_print_block(block_model_t *model)
 	fprintf(stdout, "base_n_units: %d\n", model->base_n_units);
 	fprintf(stdout, "r_ready: %d\n", model->r_ready);
 	fprintf(stdout, "c_ready: %d\n", model->c_ready);
+	fprintf(stdout, "lu_ready: %d\n", model->lu_ready);
 
 	debug_print_package_RC(&model->pack);
 
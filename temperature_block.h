@@ -14,6 +14,10 @@
 /* heat sink */
 #define HSINK 3
 
+/* warm-started steady state solver (conjugate gradient)	*/
+/* convergence criterion on the relative residual norm	*/
+#define WARM_TOL		1.0e-6
+
 /* block thermal model	*/
 typedef struct block_model_t_st
 {
@@ -59,12 +63,15 @@ typedef struct block_model_t_st
 	/* flags	*/
 	int r_ready;	/* are the R's initialized?	*/
 	int c_ready;	/* are the C's initialized?	*/
+	int lu_ready;	/* is the LUP decomposition of b up-to-date?	*/
 }block_model_t;
 
 /* constructor/destructor	*/
 /* placeholder is an empty floorplan frame with only the names of the functional units	*/
 block_model_t *alloc_block_model(thermal_config_t *config, flp_t *placeholder);
 void delete_block_model(block_model_t *model);
+/* add the memory needed by a model of 'n_units' blocks to 'bytes' (per tag)	*/
+void estimate_memory_block(int n_units, int do_transient, double *bytes);
 
 /* initialization	*/
 void populate_R_model_block(block_model_t *model, flp_t *flp);
@@ -72,6 +79,10 @@ void populate_C_model_block(block_model_t *model, flp_t *flp);
 
 /* hotspot main interfaces - temperature.c	*/
 void steady_state_temp_block(block_model_t *model, double *power, double *temp);
+/* same as above, but iterates starting from the guess in 'temp'.
+ * returns the no. of iterations taken
+ */
+int steady_state_temp_warm_block(block_model_t *model, double *power, double *temp);
 void compute_temp_block(block_model_t *model, double *power, double *temp, double time_elapsed);
 /* differs from 'dvector()' in that memory for internal nodes is also allocated	*/
 double *hotspot_vector_block(block_model_t *model);
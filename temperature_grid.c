@@ -6,13 +6,16 @@
 #define strncasecmp   _strnicmp
 #else
 #include <strings.h>
+#include <unistd.h>
 #endif
 #include <math.h>
 
 #include "temperature_grid.h"
 #include "flp.h"
 #include "util.h"
+#include "profile.h"
 #include "microchannel.h"
+#include "snapshot.h"
 
 // export some of the matrices into CSV files
 // WARNING : only use for small designs, as the files get prohibitively large easily
@@ -192,9 +195,7 @@ double find_cap_3D(int n, int i, int j, grid_model_t *model)
  * - If occupancy is > OCCUPANCY_THRESHOLD% then use the values obtained from the resistivity & capacitance of the occupying unit */
 blist_t *new_blist(int idx, double occupancy, double res, double specificHeat,int first,int do_detailed_3D, double cw, double ch, double thickness)
 {
-  blist_t *ptr = (blist_t *) calloc (1, sizeof(blist_t));
-  if (!ptr)
-    fatal("memory allocation error\n");
+  blist_t *ptr = (blist_t *) tcalloc (1, sizeof(blist_t));
   ptr->idx = idx;
   ptr->occupancy = occupancy;
   ptr->next = NULL;
@@ -227,15 +228,15 @@ blist_t ***new_b2gmap(int rows, int cols)
 {
   int i;
   blist_t ***b2gmap;
+  mem_tag_t tag = mem_set_tag(MEM_MAP);
 
-  b2gmap = (blist_t ***) calloc (rows, sizeof(blist_t **));
-  b2gmap[0] = (blist_t **) calloc (rows * cols, sizeof(blist_t *));
-  if (!b2gmap || !b2gmap[0])
-    fatal("memory allocation error\n");
+  b2gmap = (blist_t ***) tcalloc (rows, sizeof(blist_t **));
+  b2gmap[0] = (blist_t **) tcalloc (rows * cols, sizeof(blist_t *));
 
   for(i=1; i < rows; i++)
     b2gmap[i] = b2gmap[0] + cols * i;
 
+  mem_set_tag(tag);
   return b2gmap;
 }
 
@@ -252,14 +253,14 @@ void delete_b2gmap(blist_t ***b2gmap, int rows, int cols)
         ptr = b2gmap[i][j];
         while(ptr) {
             temp = ptr->next;
-            free(ptr);
+            tfree(ptr);
             ptr = temp;
         }
     }
 
   /* free the array space	*/
-  free(b2gmap[0]);
-  free(b2gmap);
+  tfree(b2gmap[0]);
+  tfree(b2gmap);
 }
 
 /* re-initialize */
@@ -274,7 +275,7 @@ void reset_b2gmap(grid_model_t *model, layer_t *layer)
         ptr = layer->b2gmap[i][j];
         while(ptr) {
             temp = ptr->next;
-            free(ptr);
+            tfree(ptr);
             ptr = temp;
         }
         layer->b2gmap[i][j] = NULL;
@@ -372,6 +373,7 @@ void set_bgmap(grid_model_t *model, layer_t *layer)
   double ch = model->height / model->rows;
   /* shortcut for unit resistivity & specific heat*/
   double sh,res;
+  mem_tag_t tag = mem_set_tag(MEM_MAP);
   /* initialize	*/
   reset_b2gmap(model, layer);
 
@@ -549,6 +551,7 @@ void set_bgmap(grid_model_t *model, layer_t *layer)
           }
       }
   }
+  mem_set_tag(tag);
 }
 
 /* populate default set of layers	*/
@@ -824,18 +827,30 @@ void parse_layer_file(grid_model_t *model, FILE *fp, materials_list_t *materials
           else if(strstr(ptr, NETWORK_EXTENSION) && !model->use_microchannels) {
             fatal("Floorplan file has microchannel extension but use_microchannels = 0\n");
           }
+          /* 
+           * no floorplan - a uniform layer or one whose
+           * floorplan is set later by the floorplanner
+           */
+          else if(!strcmp(ptr, NULLFILE)) {
+            model->layers[i].flp = (flp_t *) calloc(1, sizeof(flp_t));
+            if (!model->layers[i].flp)
+              fatal("memory allocation error\n");
+            model->layers[i].is_microchannel = FALSE;
+          }
           else {
             model->layers[i].flp = read_flp(ptr, FALSE, FALSE);
             model->layers[i].is_microchannel = FALSE;
           }
 
-          /* first layer	*/
-          if (count < LCF_NPARAMS) {
-              model->width = get_total_width(model->layers[i].flp);
-              model->height = get_total_height(model->layers[i].flp);
-          } else if(!eq(model->width, get_total_width(model->layers[i].flp)) ||
-                    !eq(model->height, get_total_height(model->layers[i].flp)))
-            fatal("width and height differ across layers\n");
+          /* the first layer with a floorplan sets the outline	*/
+          if (model->layers[i].flp->n_units) {
+              if (!model->width) {
+                  model->width = get_total_width(model->layers[i].flp);
+                  model->height = get_total_height(model->layers[i].flp);
+              } else if(!eq(model->width, get_total_width(model->layers[i].flp)) ||
+                        !eq(model->height, get_total_height(model->layers[i].flp)))
+                fatal("width and height differ across layers\n");
+          }
           field = LCF_SNO;
           break;
         default:
@@ -848,7 +863,8 @@ void parse_layer_file(grid_model_t *model, FILE *fp, materials_list_t *materials
   /* allocate the block-grid maps */
   for(i=base; i < (base+inner_layers); i++) {
       model->layers[i].b2gmap = new_b2gmap(model->rows, model->cols);
-      model->layers[i].g2bmap = (glist_t *) calloc(model->layers[i].flp->n_units,
+      model->layers[i].g2bmap_size = MAX(model->layers[i].flp->n_units, 1);
+      model->layers[i].g2bmap = (glist_t *) calloc(model->layers[i].g2bmap_size,
                                                    sizeof(glist_t));
       if (!model->layers[i].g2bmap)
         fatal("memory allocation error\n");
@@ -1020,6 +1036,8 @@ grid_model_t *alloc_grid_model(thermal_config_t *config, flp_t *flp_default, mic
     model->map_mode = GRID_CENTER;
   else
     fatal("unknown mapping mode\n");
+  if ((model->solver = solver_index(model->config.transient_solver)) < 0)
+    fatal("unknown transient solver\n");
 
   /* layer configuration file specified?	*/
   if(strcmp(model->config.grid_layer_file, NULLFILE))
@@ -1043,13 +1061,71 @@ grid_model_t *alloc_grid_model(thermal_config_t *config, flp_t *flp_default, mic
   return model;
 }
 
+/*
+ * estimate of the memory the grid model will need, before anything
+ * is allocated. the block-grid maps are assumed to have one list
+ * node per cell (there are more where blocks meet). the microchannel
+ * pressure matrices are dense and are sized from the network files.
+ * the SuperLU factors are not included
+ */
+void estimate_memory_grid(thermal_config_t *config, int do_transient, double *bytes)
+{
+  char line[LINE_SIZE], str[STR_SIZE+32], *ptr;
+  int nr = config->grid_rows, nc = config->grid_cols;
+  int chip, nl, nf, extra;
+  double cells = (double) nr * nc, nodes, vec, steady, trans;
+  FILE *fp = NULL;
+
+  extra = EXTRA + (config->model_secondary ? EXTRA_SEC : 0);
+  chip = DEFAULT_CHIP_LAYERS + (config->model_secondary ? SEC_CHIP_LAYERS : 0);
+  /* an lcf from stdin cannot be read twice. assume the default layers	*/
+  if (strcmp(config->grid_layer_file, NULLFILE) &&
+      strcasecmp(config->grid_layer_file, "stdin")) {
+      if (!(fp = fopen(config->grid_layer_file, "r"))) {
+          sprintf(str, "Unable to open file %s\n", config->grid_layer_file);
+          fatal(str);
+      }
+      chip = count_num_layers(fp);
+  }
+  nl = chip + DEFAULT_PACK_LAYERS + (config->model_secondary ? SEC_PACK_LAYERS : 0);
+  nodes = nl * cells + extra;
+  /* one grid_model_vector_t	*/
+  vec = nodes * sizeof(double) + nl * (nr + 1) * sizeof(double *);
+
+  /* last_steady and last_trans	*/
+  bytes[MEM_MODEL] += 2 * vec;
+  /* every lcf layer has a map. else only the silicon	*/
+  bytes[MEM_MAP] += (fp ? chip : 1) * (cells * (sizeof(blist_t *) + sizeof(blist_t)) +
+                                      nr * sizeof(blist_t **));
+  /* the power vector plus the eight vectors of RK4 or the
+   * coarser grids of the multigrid solver (a third each)
+   */
+  steady = vec + 2 * vec / 3 + cells * sizeof(double);
+  trans = vec + 8 * nodes * sizeof(double);
+  bytes[MEM_SOLVER] += do_transient ? MAX(steady, trans) : steady;
+
+  /* microchannel layers have network files in place of floorplans	*/
+  if (fp) {
+      fseek(fp, 0, SEEK_SET);
+      while (fgets(line, LINE_SIZE, fp)) {
+          ptr = strtok(line, " \r\t\n");
+          if (!ptr || ptr[0] == '#' || !strstr(ptr, NETWORK_EXTENSION))
+            continue;
+          nf = count_fluid_cells(ptr) + EXTRA_PRESSURE_NODES;
+          /* A and b, the cell types and the mapping	*/
+          bytes[MEM_UCHAN] += (double) nf * (nf + 1) * sizeof(double) + nf * sizeof(double *) +
+                              2 * (cells * sizeof(int) + nr * sizeof(int *));
+      }
+      fclose(fp);
+  }
+}
+
 void populate_R_model_grid(grid_model_t *model, flp_t *flp)
 {
   int i, base;
-  double cw, ch;
 
   int inner_layers;
-  int silidx, hsidx;
+  int silidx;
   int model_secondary = model->config.model_secondary;
   int nl = model->n_layers;
 
@@ -1071,11 +1147,19 @@ void populate_R_model_grid(grid_model_t *model, flp_t *flp)
       silidx = LAYER_SI;
   }
 
-  /* setup the block-grid maps; flp parameter is ignored */
-  if(model->has_lcf)
-    for(i=base; i < (base+inner_layers); i++){
-        set_bgmap(model, &model->layers[i]);
-    }
+  /* setup the block-grid maps; flp parameter is ignored. when
+   * the floorplanner sets the outline, only the layers it
+   * changed are remapped
+   */
+  if(model->has_lcf) {
+    if (model->width <= 0 || model->height <= 0)
+      fatal("chip outline unknown. no floorplans in the lcf file?\n");
+    for(i=base; i < (base+inner_layers); i++)
+      if (!model->fixed_outline || model->layers[i].stale) {
+          set_bgmap(model, &model->layers[i]);
+          model->layers[i].stale = FALSE;
+      }
+  }
   /* only the silicon layer has allocated space for the maps.
    * all the rest just point to it. so it is sufficient to
    * setup the block-grid map for the silicon layer alone.
@@ -1127,15 +1211,34 @@ void populate_R_model_grid(grid_model_t *model, flp_t *flp)
       fatal("inordinate floorplan size!\n");
   }
 
-  /* shortcuts for cell width(cw) and cell height(ch)	*/
-  cw = model->width / model->cols;
-  ch = model->height / model->rows;
-
   /* package R's	*/
   populate_package_R(&model->pack, &model->config, model->width, model->height);
 
-  hsidx = nl - DEFAULT_PACK_LAYERS + LAYER_SINK;
   /* layer specific resistances	*/
+  populate_layer_R_grid(model);
+
+  /* done	*/
+  model->r_ready = TRUE;
+}
+
+/*
+ * layer specific resistances from the conductivities and
+ * thicknesses of the layers. the block-grid maps are left
+ * alone. so, this is all that needs to be redone when only
+ * the material properties change
+ */
+void populate_layer_R_grid(grid_model_t *model)
+{
+  int i, hsidx;
+
+  /* the steady state of the quiescence detection is out of date	*/
+  model->quiet_valid = FALSE;
+
+  /* shortcuts for cell width(cw) and cell height(ch)	*/
+  double cw = model->width / model->cols;
+  double ch = model->height / model->rows;
+
+  hsidx = model->n_layers - DEFAULT_PACK_LAYERS + LAYER_SINK;
   for(i=0; i < model->n_layers; i++){
       if (model->layers[i].has_lateral) {
           model->layers[i].rx =  getr(model->layers[i].k, cw, ch * model->layers[i].thickness);
@@ -1153,9 +1256,6 @@ void populate_R_model_grid(grid_model_t *model, flp_t *flp)
             (model->config.s_sink * model->config.s_sink) / (cw * ch);
       }
   }
-
-  /* done	*/
-  model->r_ready = TRUE;
 }
 
 void populate_C_model_grid(grid_model_t *model, flp_t *flp)
@@ -1209,6 +1309,61 @@ void populate_C_model_grid(grid_model_t *model, flp_t *flp)
   model->c_ready = TRUE;
 }
 
+/* chip outline of a 3-d stack being floorplanned	*/
+void set_outline_grid(grid_model_t *model, double width, double height)
+{
+  int i;
+
+  if (!model->has_lcf)
+    fatal("chip outline can be set only with an lcf file\n");
+
+  /* the grid cells change. so, all the layers need remapping	*/
+  if (!model->fixed_outline || width != model->width || height != model->height)
+    for(i=0; i < model->n_layers; i++)
+      model->layers[i].stale = TRUE;
+  model->width = width;
+  model->height = height;
+  model->fixed_outline = TRUE;
+}
+
+/* 
+ * make 'flp' (owned by the caller) the floorplan of layer 'n'.
+ * to be called again whenever the blocks of 'flp' change
+ * (including their number)
+ */
+void set_layer_flp_grid(grid_model_t *model, int n, flp_t *flp)
+{
+  int i;
+  layer_t *layer = &model->layers[n];
+  flp_t *old_flp = layer->flp;
+
+  if (!model->has_lcf)
+    fatal("layer floorplans can be set only with an lcf file\n");
+
+  if (flp != old_flp && !layer->flp_external)
+    free_flp(old_flp, FALSE, FALSE);
+  layer->flp = flp;
+  layer->flp_external = TRUE;
+  if (flp->n_units > layer->g2bmap_size) {
+      layer->g2bmap_size = flp->n_units;
+      layer->g2bmap = (glist_t *) realloc(layer->g2bmap,
+                                          layer->g2bmap_size * sizeof(glist_t));
+      if (!layer->g2bmap)
+        fatal("memory allocation error\n");
+  }
+  /* the package layers share the last chip layer's floorplan	*/
+  for(i=0; i < model->n_layers; i++)
+    if (i != n && model->layers[i].flp == old_flp) {
+        model->layers[i].flp = flp;
+        model->layers[i].g2bmap = layer->g2bmap;
+    }
+  layer->stale = TRUE;
+
+  model->total_n_blocks = 0;
+  for(i=0; i < model->n_layers; i++)
+    model->total_n_blocks += model->layers[i].flp->n_units;
+}
+
 /* destructor	*/
 void delete_grid_model(grid_model_t *model)
 {
@@ -1240,7 +1395,8 @@ void delete_grid_model(grid_model_t *model)
     for(i=base; i < (base+inner_layers); i++){
         delete_b2gmap(model->layers[i].b2gmap, model->rows, model->cols);
         free(model->layers[i].g2bmap);
-        free_flp(model->layers[i].flp, FALSE, FALSE);
+        if (!model->layers[i].flp_external)
+          free_flp(model->layers[i].flp, FALSE, FALSE);
     }
   /* only the silicon layer has allocated space for the maps.
    * all the rest just point to it. also, its floorplan was
@@ -1269,7 +1425,12 @@ void delete_grid_model(grid_model_t *model)
   }
 
   free_grid_model_vector(model->last_steady);
-  if(trace_num<1) free_grid_model_vector(model->last_trans);
+  if (model->last_trans)
+    free_grid_model_vector(model->last_trans);
+  if (model->quiet_power)
+    free_dvector(model->quiet_power);
+  if (model->quiet_steady)
+    free_grid_model_vector(model->quiet_steady);
   free(model->layers);
   free(model);
 }
@@ -1985,6 +2146,7 @@ void xlate_vector_b2g(grid_model_t *model, double *b, grid_model_vector_t *g, in
 {
   int i, j, n, base = 0;
   double area;
+  double start = prof_begin();
 
   int extra_nodes;
   if (model->config.model_secondary)
@@ -2035,6 +2197,7 @@ void xlate_vector_b2g(grid_model_t *model, double *b, grid_model_vector_t *g, in
   /* extra spreader and sink nodes	*/
   for(i=0; i < extra_nodes; i++)
     g->extra[i] = b[base+i];
+  prof_end(PROF_B2G, start);
 }
 
 /* translate temperature between grid and block vectors	*/
@@ -2043,6 +2206,7 @@ void xlate_temp_g2b(grid_model_t *model, double *b, grid_model_vector_t *g)
   int i, j, n, u, base = 0, count;
   int i1, j1, i2, j2, ci1, cj1, ci2, cj2;
   double min, max, avg;
+  double start = prof_begin();
 
   int extra_nodes;
   if (model->config.model_secondary)
@@ -2121,6 +2285,7 @@ void xlate_temp_g2b(grid_model_t *model, double *b, grid_model_vector_t *g)
   /* extra spreader and sink nodes	*/
   for(i=0; i < extra_nodes; i++)
     b[base+i] = g->extra[i];
+  prof_end(PROF_G2B, start);
 }
 
 /* setting package nodes' power numbers	*/
@@ -2712,6 +2877,7 @@ double single_iteration_steady_grid(grid_model_t *model, grid_model_vector_t *po
           }
       }
   }
+  PROF_COUNT(solver_iters, 1);
   /* package part of the iteration	*/
   return (MAX(max, single_iteration_steady_pack(model, power, temp)));
 }
@@ -2905,59 +3071,146 @@ void recursive_multigrid(grid_model_t *model, grid_model_vector_t *power,
 #endif
 }
 
-// void steady_state_temp_grid(grid_model_t *model, double *power, double *temp)
-// {
-//   grid_model_vector_t *p;
-//   double delta;
-
-// #if VERBOSE > 1
-//   int num_iterations = 0;
-// #endif
-
-//   if (!model->r_ready)
-//     fatal("R model not ready\n");
-
-//   p = new_grid_model_vector(model);
-
-//   /* package nodes' power numbers	*/
-//   set_internal_power_grid(model, power);
-
-//   /* map the block power numbers to the grid	*/
-//   xlate_vector_b2g(model, power, p, V_POWER);
-
-// #if SUPERLU > 0
-//   /* solve with SuperLU. use grid model's internal
-//    * state vector to store the grid temperatures
-//    */
-//   direct_SLU(model, p, model->last_steady);
-// #else
-//   /* solve recursively. use grid model's internal
-//    * state vector to store the grid temperatures
-//    */
-//   if(model->config.detailed_3D_used){
-//       // For detailed 3D, we do not use multi_grid
-//       set_heuristic_temp(model, p, model->last_steady);
-//       do {
-//           delta = single_iteration_steady_grid(model, p, model->last_steady);
-// #if VERBOSE > 1
-//           num_iterations++;
-// #endif
-//       } while (!eq(delta, 0));
-// #if VERBOSE > 1
-//       fprintf(stdout, "no. of iterations for steady state convergence (%d x %d grid): %d\n",
-//               model->rows, model->cols, num_iterations);
-// #endif
-//   }
-//   else{
-//       recursive_multigrid(model, p, model->last_steady);
-//   }
-// #endif
-
-//   /* map the temperature numbers back	*/
-//   xlate_temp_g2b(model, temp, model->last_steady);
-
-//   free_grid_model_vector(p);
-// }
+void steady_state_temp_grid(grid_model_t *model, double *power, double *temp)
+{
+  grid_model_vector_t *p;
+  double delta, start;
+  mem_tag_t tag = mem_set_tag(MEM_SOLVER);
+
+#if VERBOSE > 1
+  int num_iterations = 0;
+#endif
+
+  if (!model->r_ready)
+    fatal("R model not ready\n");
+
+  p = new_grid_model_vector(model);
+
+  /* package nodes' power numbers	*/
+  set_internal_power_grid(model, power);
+
+  /* map the block power numbers to the grid	*/
+  xlate_vector_b2g(model, power, p, V_POWER);
+
+  start = prof_begin();
+#if SUPERLU > 0
+  /* solve with SuperLU. use grid model's internal
+   * state vector to store the grid temperatures
+   */
+  direct_SLU(model, p, model->last_steady);
+#else
+  /* solve recursively. use grid model's internal
+   * state vector to store the grid temperatures
+   */
+  if(model->config.detailed_3D_used){
+      // For detailed 3D, we do not use multi_grid
+      set_heuristic_temp(model, p, model->last_steady);
+      do {
+          delta = single_iteration_steady_grid(model, p, model->last_steady);
+#if VERBOSE > 1
+          num_iterations++;
+#endif
+      } while (!eq(delta, 0));
+#if VERBOSE > 1
+      fprintf(stdout, "no. of iterations for steady state convergence (%d x %d grid): %d\n",
+              model->rows, model->cols, num_iterations);
+#endif
+  }
+  else{
+      recursive_multigrid(model, p, model->last_steady);
+  }
+#endif
+  prof_end(PROF_SOLVE, start);
+  PROF_COUNT(solver_calls, 1);
+
+  /* map the temperature numbers back	*/
+  xlate_temp_g2b(model, temp, model->last_steady);
+
+  free_grid_model_vector(p);
+  mem_set_tag(tag);
+}
+
+/*
+ * steady state temperatures of 'n' power maps at once. with
+ * SuperLU, the matrix is built and factorized only once and
+ * the maps are solved together as the columns of the right
+ * hand side. the iterative solvers have nothing worth sharing
+ * between different maps, so they are just run once per map
+ */
+void steady_state_temp_batch_grid(grid_model_t *model, double **power,
+                                  double **temp, int n)
+{
+#if SUPERLU > 0
+  double start;
+
+  if (!model->r_ready)
+    fatal("R model not ready\n");
+
+  start = prof_begin();
+  direct_SLU_batch(model, power, temp, n);
+  prof_end(PROF_SOLVE, start);
+  PROF_COUNT(solver_calls, n);
+#else
+  int k;
+
+  for(k=0; k < n; k++)
+    steady_state_temp_grid(model, power[k], temp[k]);
+#endif
+}
+
+/*
+ * same as above, but starts from the grid temperatures of
+ * the previous steady state solve instead of a heuristic
+ * estimate. when the power map (or the floorplan) changes
+ * only slightly between calls, the Gauss-Seidel iterations
+ * converge much faster from there
+ */
+void steady_state_temp_warm_grid(grid_model_t *model, double *power, double *temp)
+{
+#if SUPERLU > 0
+  /* the direct solver gains nothing from a good initial guess	*/
+  steady_state_temp_grid(model, power, temp);
+#else
+  grid_model_vector_t *p;
+  double delta, start;
+  mem_tag_t tag = mem_set_tag(MEM_SOLVER);
+
+#if VERBOSE > 1
+  int num_iterations = 0;
+#endif
+
+  if (!model->r_ready)
+    fatal("R model not ready\n");
+
+  p = new_grid_model_vector(model);
+
+  /* package nodes' power numbers	*/
+  set_internal_power_grid(model, power);
+
+  /* map the block power numbers to the grid	*/
+  xlate_vector_b2g(model, power, p, V_POWER);
+
+  start = prof_begin();
+  do {
+      delta = single_iteration_steady_grid(model, p, model->last_steady);
+#if VERBOSE > 1
+      num_iterations++;
+#endif
+  } while (!eq(delta, 0));
+#if VERBOSE > 1
+  fprintf(stdout, "no. of iterations for warm-started steady state convergence (%d x %d grid): %d\n",
+          model->rows, model->cols, num_iterations);
+#endif
+  prof_end(PROF_SOLVE, start);
+  PROF_COUNT(solver_calls, 1);
+
+  /* map the temperature numbers back	*/
+  xlate_temp_g2b(model, temp, model->last_steady);
+
+  free_grid_model_vector(p);
+  mem_set_tag(tag);
+#endif
+}
 
 /* function to access a 1-d array as a 3-d matrix	*/
 #define A3D(array,n,i,j,nl,nr,nc)		(array[(n)*(nr)*(nc) + (i)*(nc) + (j)])
@@ -3710,106 +3963,418 @@ void slope_fn_grid(grid_model_t *model, double *v, grid_model_vector_t *p, doubl
 }
 
 
-void compute_temp_grid(grid_model_t *model, double *power, int first_invocation, double time_elapsed)
+/*
+ * largest magnitude of the eigenvalues of the transient equation
+ * dT/dt = C^-1 (P - G T), i.e., 1 / the smallest RC time constant.
+ * found by power iteration on the slope function, which is affine
+ * in the temperatures: J v = slope(amb + v) - slope(amb). the
+ * eigenvalues are real, so the norm ratio converges to it
+ */
+double spectral_radius_grid(grid_model_t *model)
 {
-  double t, h, new_h;
-  int extra_nodes;
+  int i, k, n;
+  double *y, *v, *f0, *f, norm, rho = 0, prev = 0;
   grid_model_vector_t *p;
 
+  n = model->rows * model->cols * model->n_layers + EXTRA;
   if (model->config.model_secondary)
-    extra_nodes = EXTRA + EXTRA_SEC;
-  else
-    extra_nodes = EXTRA;
-
-  if (!model->r_ready || !model->c_ready)
-    fatal("grid model not ready\n");
+    n += EXTRA_SEC;
 
   p = new_grid_model_vector(model);
+  y = dvector(n);
+  v = dvector(n);
+  f0 = dvector(n);
+  f = dvector(n);
+
+  for(i=0; i < n; i++)
+    y[i] = model->config.ambient;
+  slope_fn_grid(model, y, p, f0);
+
+  /* a checkerboard start is close to the fastest mode	*/
+  for(i=0; i < n; i++)
+    v[i] = (i & 1) ? 1.0 : -1.0;
+
+  for(k=0; k < SPECTRAL_ITERS; k++) {
+      for(i=0; i < n; i++)
+        y[i] = model->config.ambient + v[i];
+      slope_fn_grid(model, y, p, f);
+      norm = 0;
+      for(i=0; i < n; i++) {
+          f[i] -= f0[i];
+          norm = MAX(norm, fabs(f[i]));
+      }
+      if (norm == 0)
+        break;
+      /* v is normalized to a max. of 1 from the second iteration on	*/
+      rho = norm;
+      for(i=0; i < n; i++)
+        v[i] = f[i] / norm;
+      if (k && fabs(rho - prev) <= SPECTRAL_TOL * rho)
+        break;
+      prev = rho;
+  }
 
-  /* package nodes' power numbers	*/
-  set_internal_power_grid(model, power);
-
-  /* map the block power/temp numbers to the grid	*/
-  xlate_vector_b2g(model, power, p, V_POWER);
+  free_dvector(y);
+  free_dvector(v);
+  free_dvector(f0);
+  free_dvector(f);
+  free_grid_model_vector(p);
+  return rho;
+}
 
-  /* if temp is NULL, re-use the temperature from the
-   * last call. otherwise, translate afresh and remember
-   * the grid and block temperature arrays for future use
-   */
-  if (first_invocation) {
-      xlate_vector_b2g(model, model->last_temp, model->last_trans, V_TEMP);
+unsigned long long hash_grid_model(grid_model_t *model, double time_elapsed)
+{
+  int i, j;
+  unsigned long long h = HASH_INIT;
+  layer_t *l;
+  unit_t *u;
+
+  h = hash_bytes(h, &model->rows, sizeof(int));
+  h = hash_bytes(h, &model->cols, sizeof(int));
+  h = hash_bytes(h, &model->n_layers, sizeof(int));
+  h = hash_bytes(h, &model->width, sizeof(double));
+  h = hash_bytes(h, &model->height, sizeof(double));
+  h = hash_bytes(h, &model->pack, sizeof(package_RC_t));
+  h = hash_bytes(h, &model->config.ambient, sizeof(double));
+  h = hash_bytes(h, &model->config.rk4_tolerance, sizeof(double));
+  h = hash_bytes(h, &model->config.model_secondary, sizeof(int));
+  h = hash_bytes(h, &model->config.detailed_3D_used, sizeof(int));
+  h = hash_bytes(h, &model->use_microchannels, sizeof(int));
+  h = hash_bytes(h, &time_elapsed, sizeof(double));
+  for(i=0; i < model->n_layers; i++) {
+      l = &model->layers[i];
+      h = hash_bytes(h, &l->has_lateral, sizeof(int));
+      h = hash_bytes(h, &l->has_power, sizeof(int));
+      h = hash_bytes(h, &l->is_microchannel, sizeof(int));
+      h = hash_bytes(h, &l->rx, sizeof(double));
+      h = hash_bytes(h, &l->ry, sizeof(double));
+      h = hash_bytes(h, &l->rz, sizeof(double));
+      h = hash_bytes(h, &l->c, sizeof(double));
+      for(j=0; j < l->flp->n_units; j++) {
+          u = &l->flp->units[j];
+          h = hash_bytes(h, u->name, strlen(u->name));
+          h = hash_bytes(h, &u->width, sizeof(double));
+          h = hash_bytes(h, &u->height, sizeof(double));
+          h = hash_bytes(h, &u->leftx, sizeof(double));
+          h = hash_bytes(h, &u->bottomy, sizeof(double));
+      }
   }
+  return h;
+}
 
-#if SUPERLU > 0
-  int nl = model->n_layers;
-  int nr = model->rows;
-  int nc = model->cols;
-  h = time_elapsed;
+/* advance the grid temperatures by 'time_elapsed' with integrator 'solver'	*/
+static void integrate_grid(grid_model_t *model, grid_model_vector_t *p, int solver, double time_elapsed)
+{
+  double t, h, new_h, max_h = 0;
+  double *y = model->last_trans->cuboid[0][0], *k1, *ytemp;
+  int i, n, steps;
 
-  SuperMatrix *G;
-  diagonal_matrix_t *C;
-  double *T, *P;
+  n = model->rows * model->cols * model->n_layers + EXTRA;
+  if (model->config.model_secondary)
+    n += EXTRA_SEC;
 
-  // We only need to compute G and C in the first call
-  static int first_call = TRUE;
-  if(first_call) {
-    model->G = build_transient_grid_matrix(model);
-    model->C = build_diagonal_matrix(model);
-    first_call = FALSE;
-  }
+#if SUPERLU > 0
+  if (solver == SOLVER_EULER) {
+      int nl = model->n_layers;
+      int nr = model->rows;
+      int nc = model->cols;
+      h = time_elapsed;
+
+      SuperMatrix *G;
+      diagonal_matrix_t *C;
+      double *T, *P;
+
+      // We only need to compute G and C in the first call
+      static int first_call = TRUE;
+      if(first_call) {
+        model->G = build_transient_grid_matrix(model);
+        model->C = build_diagonal_matrix(model);
+        first_call = FALSE;
+      }
 
-  G = &(model->G);
-  C = model->C;
-  T = model->last_trans->cuboid[0][0];
-  P = build_transient_power_vector(model, p);
+      G = &(model->G);
+      C = model->C;
+      T = y;
+      P = build_transient_power_vector(model, p);
 
-  if(MAKE_CSVS) {
-    vectorTocsv("P.csv", nl*nr*nc + EXTRA, P);
-    vectorTocsv("T.csv", nl*nr*nc + EXTRA, T);
-  }
+      if(MAKE_CSVS) {
+        vectorTocsv("P.csv", nl*nr*nc + EXTRA, P);
+        vectorTocsv("T.csv", nl*nr*nc + EXTRA, T);
+      }
 
-  backward_euler(G, C, T, P, &h, T);
+      backward_euler(G, C, T, P, &h, T);
+      prof_step(h);
+      return;
+  }
+#endif
 
-#else
+  /* fixed steps no longer than 'fixed_h', without error control	*/
+  if (solver == SOLVER_RK4_FIXED) {
+      steps = (int) ceil(time_elapsed / model->fixed_h);
+      h = time_elapsed / steps;
+      k1 = dvector(n);
+      ytemp = dvector(n);
+      for(i=0; i < steps; i++) {
+          slope_fn_grid(model, y, p, k1);
+          PROF_COUNT(slope_evals, 1);
+          rk4_core(model, y, k1, p, n, h, ytemp, (slope_fn_ptr) slope_fn_grid);
+          copy_dvector(y, ytemp, n);
+          prof_step(h);
+      }
+      free_dvector(k1);
+      free_dvector(ytemp);
+      return;
+  }
 
   /* Obtain temp at time (t+time_elapsed).
    * Instead of getting the temperature at t+time_elapsed directly, we
    * do it in multiple steps with the correct step size at each time
-   * provided by rk4.
+   * provided by rk4. rk4_warm starts from the largest step of the
+   * previous interval instead of MIN_STEP
    */
 
    #if VERBOSE > 1
     int rk4_calls = 0;
    #endif
 
-  for (t = 0, new_h = MIN_STEP; t < time_elapsed && new_h >= MIN_STEP*DELTA; t+=h) {
+  new_h = (solver == SOLVER_RK4_WARM && model->last_h > 0) ? model->last_h : MIN_STEP;
+  for (t = 0; t < time_elapsed && new_h >= MIN_STEP*DELTA; t+=h) {
       h = new_h;
       /* pass the entire grid and the tail of package nodes
        * as a 1-d array
        */
-      new_h = rk4(model, model->last_trans->cuboid[0][0],  p,
+      new_h = rk4(model, y, p,
                   /* array size = grid size + EXTRA	*/
-                  model->rows * model->cols * model->n_layers + extra_nodes, &h,
-                  model->last_trans->cuboid[0][0],
+                  n, &h, y,
                   /* the slope function callback is typecast accordingly */
-                  (slope_fn_ptr) slope_fn_grid);
+                  (slope_fn_ptr) slope_fn_grid, model->config.rk4_tolerance);
+      max_h = MAX(max_h, h);
       new_h = MIN(new_h, time_elapsed-t-h);
 
 #if VERBOSE > 1
       rk4_calls++;
 #endif
   }
+  if (solver == SOLVER_RK4_WARM)
+    model->last_h = max_h;
 
   #if VERBOSE > 1
     fprintf(stdout, "no. of rk4 calls during compute_temp: %d\n", rk4_calls+1);
   #endif
+}
 
+/*
+ * pick the fastest transient integrator for this model and interval
+ * length whose error after SOLVER_TRIALS intervals is no worse than
+ * that of rk4 at the configured tolerance (or than the tolerance
+ * itself). the errors are measured against rk4 at a tighter
+ * tolerance. the trials start from the current temperatures with
+ * the power 'p' and are undone afterwards. decisions are looked up
+ * in and saved to the solver cache by model hash
+ */
+static void select_solver_grid(grid_model_t *model, grid_model_vector_t *p, double time_elapsed)
+{
+  int i, k, s, n, size = 0, enabled, best = SOLVER_RK4;
+  double *y = model->last_trans->cuboid[0][0], *saved, *ref;
+  double rho, tol, start, bound, secs[N_SOLVERS], err[N_SOLVERS];
+  char key[STR_SIZE];
+  str_pair table[MAX_ENTRIES];
+  int has_cache = strcmp(model->config.solver_cache, NULLFILE);
+
+  n = model->rows * model->cols * model->n_layers + EXTRA;
+  if (model->config.model_secondary)
+    n += EXTRA_SEC;
+
+  /* stiffness: how many explicit steps an interval needs at least	*/
+  rho = spectral_radius_grid(model);
+  model->fixed_h = MIN(time_elapsed, RK4_FIXED_Z / rho);
+  fprintf(stdout, "transient solver: %d nodes, spectral radius %.3g 1/s (smallest RC %.3g s), "
+          "%.0f explicit steps per %.3g s interval at least\n", n, rho, 1.0 / rho,
+          ceil(time_elapsed * rho / RK4_STABILITY), time_elapsed);
+
+  sprintf(key, "%016llx", hash_grid_model(model, time_elapsed));
+  if (has_cache && !access(model->config.solver_cache, F_OK)) {
+      size = read_str_pairs(table, MAX_ENTRIES, model->config.solver_cache);
+      if ((i = get_str_index(table, size, key)) >= 0) {
+          s = solver_index(table[i].value);
+          if (s >= 0 && s != SOLVER_AUTO
+#if SUPERLU < 1
+              && s != SOLVER_EULER
 #endif
+              ) {
+              model->solver = s;
+              fprintf(stdout, "transient solver: %s (cached for model %s)\n", solver_names[s], key);
+              return;
+          }
+      }
+  }
+
+  /* the trials are not part of the simulation's profile	*/
+  enabled = profile.enabled;
+  profile.enabled = FALSE;
+  saved = dvector(n);
+  ref = dvector(n);
+  copy_dvector(saved, y, n);
+
+  tol = model->config.rk4_tolerance;
+  model->config.rk4_tolerance = tol * SOLVER_REF_SCALE;
+  for(k=0; k < SOLVER_TRIALS; k++)
+    integrate_grid(model, p, SOLVER_RK4, time_elapsed);
+  model->config.rk4_tolerance = tol;
+  copy_dvector(ref, y, n);
+
+  for(s=0; s < SOLVER_AUTO; s++) {
+      secs[s] = err[s] = LARGENUM;
+#if SUPERLU < 1
+      if (s == SOLVER_EULER)
+        continue;
+#endif
+      copy_dvector(y, saved, n);
+      model->last_h = 0;
+      start = prof_now();
+      for(k=0; k < SOLVER_TRIALS; k++)
+        integrate_grid(model, p, s, time_elapsed);
+      secs[s] = prof_now() - start;
+      err[s] = 0;
+      for(i=0; i < n; i++)
+        err[s] = MAX(err[s], fabs(y[i] - ref[i]));
+  }
+
+  bound = MAX(tol, err[SOLVER_RK4]);
+  for(s=0; s < SOLVER_AUTO; s++) {
+      if (secs[s] == LARGENUM)
+        continue;
+      if (err[s] <= bound && secs[s] < secs[best])
+        best = s;
+      fprintf(stdout, "  %-9s %.3g s per interval, max. error %.3g K%s\n", solver_names[s],
+              secs[s] / SOLVER_TRIALS, err[s], (err[s] <= bound) ? "" : " (rejected)");
+  }
+
+  copy_dvector(y, saved, n);
+  model->last_h = 0;
+  model->solver = best;
+  free_dvector(saved);
+  free_dvector(ref);
+  profile.enabled = enabled;
+  fprintf(stdout, "transient solver: %s (model %s)\n", solver_names[best], key);
+
+  if (has_cache) {
+      if ((i = get_str_index(table, size, key)) < 0) {
+          if (size >= MAX_ENTRIES)
+            fatal("solver cache is full\n");
+          i = size++;
+          strcpy(table[i].name, key);
+      }
+      strcpy(table[i].value, solver_names[best]);
+      dump_str_pairs(table, size, model->config.solver_cache, "-");
+  }
+}
+
+/*
+ * quiescence detection: can the interval with block 'power' be
+ * answered by the steady state temperatures for that power? this
+ * is the case when the power has not changed for QUIET_MIN_INTERVALS
+ * intervals and every grid temperature is within quiet_tolerance of
+ * that steady state, which is then copied into last_trans. the error
+ * is bounded by the tolerance (plus the steady solver's): C^-1 G has
+ * non-positive off-diagonal entries and non-negative row sums, so the
+ * max. norm distance between two solutions of the transient equation
+ * never grows. the skipped run thus stays within the tolerance of the
+ * integrated one, also after the power changes again. the advection
+ * of the microchannel model is not covered by this argument
+ */
+static int quiet_interval_grid(grid_model_t *model, double *power)
+{
+  int i, nodes, n = model->total_n_blocks;
+  double *v, *s, *temp;
+
+  if (model->config.quiet_tolerance <= 0 || model->use_microchannels)
+    return FALSE;
+
+  if (!model->quiet_power)
+    model->quiet_power = dvector(n);
+  else if (!memcmp(model->quiet_power, power, n * sizeof(double)))
+    model->quiet_count++;
+  else
+    model->quiet_count = 0;
+  if (!model->quiet_count) {
+      copy_dvector(model->quiet_power, power, n);
+      model->quiet_valid = FALSE;
+  }
+  if (model->quiet_count < QUIET_MIN_INTERVALS)
+    return FALSE;
+
+  nodes = model->rows * model->cols * model->n_layers + EXTRA;
+  if (model->config.model_secondary)
+    nodes += EXTRA_SEC;
+
+  /* once per phase of constant power	*/
+  if (!model->quiet_valid) {
+      if (!model->quiet_steady)
+        model->quiet_steady = new_grid_model_vector(model);
+      temp = hotspot_vector_grid(model);
+      steady_state_temp_grid(model, power, temp);
+      free_dvector(temp);
+      copy_dvector(model->quiet_steady->cuboid[0][0], model->last_steady->cuboid[0][0], nodes);
+      model->quiet_valid = TRUE;
+  }
+
+  v = model->last_trans->cuboid[0][0];
+  s = model->quiet_steady->cuboid[0][0];
+  for(i=0; i < nodes; i++)
+    if (fabs(v[i] - s[i]) > model->config.quiet_tolerance)
+      return FALSE;
+  copy_dvector(v, s, nodes);
+  PROF_COUNT(intervals_skipped, 1);
+  return TRUE;
+}
+
+void compute_temp_grid(grid_model_t *model, double *power, int first_invocation, double time_elapsed)
+{
+  double start;
+  grid_model_vector_t *p;
+  mem_tag_t tag;
+
+  if (!model->r_ready || !model->c_ready)
+    fatal("grid model not ready\n");
+
+  tag = mem_set_tag(MEM_SOLVER);
+  p = new_grid_model_vector(model);
+
+  /* package nodes' power numbers	*/
+  set_internal_power_grid(model, power);
+
+  /* map the block power/temp numbers to the grid	*/
+  xlate_vector_b2g(model, power, p, V_POWER);
+
+  /* if temp is NULL, re-use the temperature from the
+   * last call. otherwise, translate afresh and remember
+   * the grid and block temperature arrays for future use
+   */
+  if (first_invocation) {
+      xlate_vector_b2g(model, model->last_temp, model->last_trans, V_TEMP);
+  }
+
+  /* nothing to integrate at the steady state	*/
+  if (!quiet_interval_grid(model, power)) {
+      if (model->solver == SOLVER_AUTO)
+        select_solver_grid(model, p, time_elapsed);
+      else if (model->solver == SOLVER_RK4_FIXED && model->fixed_h <= 0)
+        model->fixed_h = MIN(time_elapsed, RK4_FIXED_Z / spectral_radius_grid(model));
+
+      start = prof_begin();
+      integrate_grid(model, p, model->solver, time_elapsed);
+      prof_end(PROF_INTEGRATE, start);
+  }
 
   /* map the temperature numbers back	*/
-  xlate_temp_g2b(model, model->last_temp, model->last_trans);
+  if (!model->skip_g2b)
+    xlate_temp_g2b(model, model->last_temp, model->last_trans);
+  if (model->snapshot)
+    publish_snapshot(model->snapshot, time_elapsed, model->last_temp, model->last_trans->cuboid[0][0]);
 
   free_grid_model_vector(p);
+  mem_set_tag(tag);
 }
 
 /* debug print	*/
@@ -5302,6 +5867,82 @@ void direct_SLU(grid_model_t *model, grid_model_vector_t *power, grid_model_vect
   StatFree(&stat);
 }
 
+/*
+ * same as above for 'n' block power vectors at once. each
+ * map becomes one column of a dense right hand side so that
+ * a single call to dgssv factorizes the matrix and does the
+ * triangular solves for all of them. the block temperatures
+ * are written to 'temp' and the grid temperatures of the
+ * last map are left in last_steady
+ */
+void direct_SLU_batch(grid_model_t *model, double **power, double **temp, int n)
+{
+  SuperMatrix A, L, U, B;
+  double   *P, *rhs;
+  int      *perm_r; /* row permutations from partial pivoting */
+  int      *perm_c; /* column permutation vector */
+  int      info;
+  superlu_options_t options;
+  SuperLUStat_t stat;
+  grid_model_vector_t *p;
+
+  int          i, k, dim;
+  DNformat     *Bstore;
+  double       *dp;
+
+  /* shortcuts	*/
+  int nr = model->rows;
+  int nc = model->cols;
+  int nl = model->n_layers;
+
+  if (model->config.model_secondary)
+    dim = nl*nr*nc + EXTRA + EXTRA_SEC;
+  else
+    dim = nl*nr*nc + EXTRA;
+
+  A = build_transient_grid_matrix(model);
+
+  /* one column per power map	*/
+  if ( !(rhs = doubleMalloc((size_t) dim * n)) ) fatal("Malloc fails for rhs[].\n");
+  p = new_grid_model_vector(model);
+  for(k=0; k < n; k++) {
+      set_internal_power_grid(model, power[k]);
+      xlate_vector_b2g(model, power[k], p, V_POWER);
+      P = build_transient_power_vector(model, p);
+      memcpy(&rhs[(size_t) k * dim], P, dim * sizeof(double));
+      SUPERLU_FREE (P);
+  }
+  free_grid_model_vector(p);
+
+  dCreate_Dense_Matrix(&B, dim, n, rhs, dim, SLU_DN, SLU_D, SLU_GE);
+  if ( !(perm_r = intMalloc(dim)) ) fatal("Malloc fails for perm_r[].\n");
+  if ( !(perm_c = intMalloc(dim)) ) fatal("Malloc fails for perm_c[].\n");
+
+  set_default_options(&options);
+  StatInit(&stat);
+
+  /* factorize once, solve for all the columns	*/
+  dgssv(&options, &A, perm_c, perm_r, &L, &U, &B, &stat, &info);
+  if (info)
+    fatal("SuperLU failed to solve the batch of power maps\n");
+  Bstore = (DNformat *) B.Store;
+  dp = (double *) Bstore->nzval;
+  for(k=0; k < n; k++) {
+      for(i=0; i < dim; ++i)
+        model->last_steady->cuboid[0][0][i] = dp[(size_t) k * Bstore->lda + i];
+      xlate_temp_g2b(model, temp[k], model->last_steady);
+  }
+
+  SUPERLU_FREE (rhs);
+  SUPERLU_FREE (perm_r);
+  SUPERLU_FREE (perm_c);
+  Destroy_CompCol_Matrix(&A);
+  Destroy_SuperMatrix_Store(&B);
+  Destroy_SuperNode_Matrix(&L);
+  Destroy_CompCol_Matrix(&U);
+  StatFree(&stat);
+}
+
 SuperMatrix build_transient_grid_matrix(grid_model_t *model)
 {
   SuperMatrix A;
@@ -57,6 +57,21 @@
    Effective only when the detailed 3D modeling is turned on. */
 #define OCCUPANCY_THRESHOLD 0.95
 
+/* transient solver selection: no. of trial intervals, tolerance of
+ * the reference run relative to rk4_tolerance, step of rk4_fixed in
+ * units of the smallest RC, stability limit of RK4 on the negative
+ * real axis and the power iterations for the spectral radius
+ */
+#define SOLVER_TRIALS		3
+#define SOLVER_REF_SCALE	0.1
+#define RK4_FIXED_Z			1.0
+#define RK4_STABILITY		2.785
+#define SPECTRAL_ITERS		200
+#define SPECTRAL_TOL		1e-3
+
+/* intervals of unchanged power before the steady state is solved for	*/
+#define QUIET_MIN_INTERVALS	3
+
 /* block list: block to grid mapping data structure.
  * list of blocks mapped to a grid cell
  */
@@ -123,6 +138,13 @@ typedef struct layer_t_st
   blist_t ***b2gmap;
   /* grid-block map - a 1-d array of grid lists	*/
   glist_t *g2bmap;
+  /* no. of entries allocated in g2bmap	*/
+  int g2bmap_size;
+
+  /* floorplan owned by the floorplanner (see set_layer_flp_grid)	*/
+  int flp_external;
+  /* block-grid map out of date?	*/
+  int stale;
 }layer_t;
 
 /* grid model's internal vector datatype	*/
@@ -163,6 +185,10 @@ typedef struct grid_model_t_st
   int r_ready;	/* are the R's initialized?	*/
   int c_ready;	/* are the C's initialized?	*/
   int has_lcf;	/* LCF file specified?		*/
+  /* chip outline set by the floorplanner? the block-grid
+   * maps of the LCF layers are then rebuilt only when stale
+   */
+  int fixed_outline;
 
   /* internal state - most recently computed
    * steady state temperatures
@@ -175,10 +201,32 @@ typedef struct grid_model_t_st
   grid_model_vector_t *last_trans;
   /* block temperatures	*/
   double *last_temp;
+  /* leave last_temp as it is after each interval, when only the
+   * grid temperatures are read (e.g. by virtual sensors)
+   */
+  int skip_g2b;
+  /* lock-free snapshot published after each interval, if any (see snapshot.h)	*/
+  struct snapshot_t_st *snapshot;
 
   /* to allow for resizing	*/
   int base_n_units;
 
+  /* transient integrator (SOLVER_*)	*/
+  int solver;
+  /* largest step of the last interval (rk4_warm)	*/
+  double last_h;
+  /* step size of rk4_fixed	*/
+  double fixed_h;
+
+  /* quiescence detection (see compute_temp_grid): the power of
+   * the last interval, the no. of intervals since it changed and
+   * the steady state grid temperatures for it, if valid
+   */
+  double *quiet_power;
+  int quiet_count;
+  int quiet_valid;
+  grid_model_vector_t *quiet_steady;
+
   /* default microchannel config */
   int use_microchannels;
   microchannel_config_t *default_microchannel_config;
@@ -197,14 +245,44 @@ double find_cap_3D(int n, int i, int j, grid_model_t *model);
 grid_model_t *alloc_grid_model(thermal_config_t *config, flp_t *flp_default, microchannel_config_t *microchannel_config,
   materials_list_t *materials_list, int do_detailed_3D, int use_microchannels);//BU_3D: added do_detailed_3D
 void delete_grid_model(grid_model_t *model);
+/* add the memory needed by a grid model with 'config' to 'bytes' (per tag)	*/
+void estimate_memory_grid(thermal_config_t *config, int do_transient, double *bytes);
 
 /* initialization	*/
 void populate_R_model_grid(grid_model_t *model, flp_t *flp);
 void populate_C_model_grid(grid_model_t *model, flp_t *flp);
+/* recompute the layer resistances after a change in material properties	*/
+void populate_layer_R_grid(grid_model_t *model);
+/* (re)build the block-grid map of a layer. reset_b2gmap frees it	*/
+void set_bgmap(grid_model_t *model, layer_t *layer);
+void reset_b2gmap(grid_model_t *model, layer_t *layer);
+
+/* floorplanning of 3-d stacks. the floorplans of the LCF layers
+ * (given as (null) in the LCF file) are set by the floorplanner.
+ * changing a layer's floorplan only marks its block-grid map for
+ * rebuilding. changing the outline marks all of them
+ */
+void set_outline_grid(grid_model_t *model, double width, double height);
+void set_layer_flp_grid(grid_model_t *model, int n, flp_t *flp);
 
 /* hotspot main interfaces - temperature.c	*/
 void steady_state_temp_grid(grid_model_t *model, double *power, double *temp);
+/* same as above but reuses the previous solution as the initial guess	*/
+void steady_state_temp_warm_grid(grid_model_t *model, double *power, double *temp);
+/* steady state temperatures of 'n' power maps at once	*/
+void steady_state_temp_batch_grid(grid_model_t *model, double **power,
+                                  double **temp, int n);
 void compute_temp_grid(grid_model_t *model, double *power, int first_invocation, double time_elapsed);
+/* slope of the transient equation at grid temperatures 'v' (incl. package nodes)	*/
+void slope_fn_grid(grid_model_t *model, double *v, grid_model_vector_t *p, double *dv);
+/* same as above for the package nodes only	*/
+void slope_fn_pack(grid_model_t *model, double *v, grid_model_vector_t *p, double *dv);
+/* zero the power numbers of the package nodes	*/
+void set_internal_power_grid(grid_model_t *model, double *power);
+/* largest eigenvalue magnitude of the transient equation (in 1/s)	*/
+double spectral_radius_grid(grid_model_t *model);
+/* hash of everything the transient behaviour of the model depends on	*/
+unsigned long long hash_grid_model(grid_model_t *model, double time_elapsed);
 
 /* differs from 'dvector()' in that memory for internal nodes is also allocated	*/
 double *hotspot_vector_grid(grid_model_t *model);
@@ -243,6 +321,8 @@ void debug_print_grid(grid_model_t *model);
 #if SUPERLU > 0
 /* steady-state solver */
 void direct_SLU(grid_model_t *model, grid_model_vector_t *power, grid_model_vector_t *temp);
+/* same as above for a batch of block power vectors sharing one factorization	*/
+void direct_SLU_batch(grid_model_t *model, double **power, double **temp, int n);
 
 /* build steady-state matrices */
 SuperMatrix build_steady_grid_matrix(grid_model_t *model);
@@ -0,0 +1,291 @@
+/*
+ * reading and writing of the power and temperature traces:
+ * a line of unit names followed by one line of values per
+ * sampling interval
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "flp.h"
+#include "util.h"
+#include "trace.h"
+
+/*
+ * read a single line of trace file containing names
+ * of functional blocks
+ */
+int read_names(FILE *fp, char **names)
+{
+  char line[LINE_SIZE], temp[LINE_SIZE], *src;
+  int i;
+
+  /* skip empty lines	*/
+  do {
+      /* read the entire line	*/
+      fgets(line, LINE_SIZE, fp);
+      if (feof(fp))
+        fatal("not enough names in trace file\n");
+      strcpy(temp, line);
+      src = strtok(temp, " \r\t\n");
+  } while (!src);
+
+  /* new line not read yet	*/
+  if(line[strlen(line)-1] != '\n')
+    fatal("line too long\n");
+
+  /* chop the names from the line read	*/
+  for(i=0,src=line; *src && i < MAX_UNITS; i++) {
+      if(!sscanf(src, "%s", names[i]))
+        fatal("invalid format of names\n");
+      src += strlen(names[i]);
+      while (isspace((int)*src))
+        src++;
+  }
+  if(*src && i == MAX_UNITS)
+    fatal("no. of units exceeded limit\n");
+
+  return i;
+}
+
+/* read a single line of power trace numbers	*/
+int read_vals(FILE *fp, double *vals)
+{
+  char line[LINE_SIZE], temp[LINE_SIZE], *src;
+  int i;
+
+  /* skip empty lines	*/
+  do {
+      /* read the entire line	*/
+      fgets(line, LINE_SIZE, fp);
+      if (feof(fp))
+        return 0;
+      strcpy(temp, line);
+      src = strtok(temp, " \r\t\n");
+  } while (!src);
+
+  /* new line not read yet	*/
+  if(line[strlen(line)-1] != '\n')
+    fatal("line too long\n");
+
+  /* chop the power values from the line read	*/
+  for(i=0,src=line; *src && i < MAX_UNITS; i++) {
+      if(!sscanf(src, "%s", temp) || !sscanf(src, "%lf", &vals[i]))
+        fatal("invalid format of values\n");
+      src += strlen(temp);
+      while (isspace((int)*src))
+        src++;
+  }
+  if(*src && i == MAX_UNITS)
+    fatal("no. of entries exceeded limit\n");
+
+  return i;
+}
+
+/* write a single line of functional unit names	*/
+void write_names(FILE *fp, char **names, int size)
+{
+  int i;
+  for(i=0; i < size-1; i++)
+    fprintf(fp, "%s\t", names[i]);
+  fprintf(fp, "%s\n", names[i]);
+}
+
+/* write a single line of temperature trace	*/
+void write_vals(FILE *fp, double *vals, int size)
+{
+  int i;
+  for(i=0; i < size-1; i++)
+    fprintf(fp, "%.2f\t", vals[i]);
+  fprintf(fp, "%.2f\n", vals[i]);
+}
+
+/* write a single line of power trace (in W)	*/
+void write_vals_power(FILE *fp, double *vals, int size)
+{
+  int i;
+  for(i=0; i < size-1; i++)
+    fprintf(fp, "%.2f\t", vals[i]);
+  fprintf(fp, "%.2f\n", vals[i]);
+}
+
+char **alloc_names(int nr, int nc)
+{
+  int i;
+  char **m;
+  mem_tag_t tag = mem_set_tag(MEM_TRACE);
+
+  m = (char **) tcalloc (nr, sizeof(char *));
+  m[0] = (char *) tcalloc (nr * nc, sizeof(char));
+
+  for (i = 1; i < nr; i++)
+    m[i] =  m[0] + nc * i;
+
+  mem_set_tag(tag);
+  return m;
+}
+
+void free_names(char **m)
+{
+  tfree(m[0]);
+  tfree(m);
+}
+
+static void queue_push(trace_pipe_t *p, row_queue_t *q, trace_row_t *row)
+{
+  pthread_mutex_lock(&p->lock);
+  /* a queue never holds more than the pool and the stop marker	*/
+  q->rows[(q->head + q->count) % (p->slots + 1)] = row;
+  q->count++;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static trace_row_t *queue_pop(trace_pipe_t *p, row_queue_t *q)
+{
+  trace_row_t *row;
+
+  pthread_mutex_lock(&p->lock);
+  while (!q->count)
+    pthread_cond_wait(&p->cond, &p->lock);
+  row = q->rows[q->head];
+  q->head = (q->head + 1) % (p->slots + 1);
+  q->count--;
+  pthread_mutex_unlock(&p->lock);
+  return row;
+}
+
+static void read_row(trace_pipe_t *p, trace_row_t *row)
+{
+  row->num = read_vals(p->in, row->vals);
+  if (row->num == p->n)
+    p->permute(p->arg, row->vals, row->power);
+}
+
+static void write_row(trace_pipe_t *p, trace_row_t *row)
+{
+  if (!row->write)
+    return;
+  write_vals(p->out, row->vals, p->n);
+  if (p->out2)
+    write_vals_power(p->out2, row->vals2, p->n);
+}
+
+static void *reader_thread(void *arg)
+{
+  trace_pipe_t *p = (trace_pipe_t *) arg;
+  trace_row_t *row;
+
+  do {
+      row = queue_pop(p, &p->free_q);
+      read_row(p, row);
+      queue_push(p, &p->solve_q, row);
+  } while (row->num == p->n);
+  return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+  trace_pipe_t *p = (trace_pipe_t *) arg;
+  trace_row_t *row;
+
+  /* NULL marks the end	*/
+  while ((row = queue_pop(p, &p->write_q))) {
+      write_row(p, row);
+      queue_push(p, &p->free_q, row);
+  }
+  return NULL;
+}
+
+trace_pipe_t *trace_pipe_start(FILE *in, FILE *out, FILE *out2, int n, int power_size,
+                               int depth, int hold, permute_fn_ptr permute, void *arg)
+{
+  int i;
+  trace_pipe_t *p;
+  row_queue_t *q[3];
+  mem_tag_t tag = mem_set_tag(MEM_TRACE);
+
+  p = (trace_pipe_t *) tcalloc(1, sizeof(trace_pipe_t));
+  p->in = in;
+  p->out = out;
+  p->out2 = out2;
+  p->n = n;
+  p->depth = depth;
+  p->permute = permute;
+  p->arg = arg;
+
+  /* enough for the reader to be 'depth' rows ahead of the solver
+   * while the latter holds 'hold' rows
+   */
+  p->slots = MAX(depth, 1) + hold - 1;
+  p->pool = (trace_row_t *) tcalloc(p->slots, sizeof(trace_row_t));
+  for(i=0; i < p->slots; i++) {
+      p->pool[i].vals = dvector(MAX_UNITS);
+      p->pool[i].vals2 = dvector(MAX_UNITS);
+      p->pool[i].power = dvector(power_size);
+  }
+
+  q[0] = &p->free_q;
+  q[1] = &p->solve_q;
+  q[2] = &p->write_q;
+  for(i=0; i < 3; i++)
+    q[i]->rows = (trace_row_t **) tcalloc(p->slots + 1, sizeof(trace_row_t *));
+  for(i=0; i < p->slots; i++)
+    p->free_q.rows[i] = &p->pool[i];
+  p->free_q.count = p->slots;
+  mem_set_tag(tag);
+
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  if (depth && (pthread_create(&p->reader, NULL, reader_thread, p) ||
+                pthread_create(&p->writer, NULL, writer_thread, p)))
+    fatal("unable to create the trace pipeline threads\n");
+  return p;
+}
+
+trace_row_t *trace_pipe_next(trace_pipe_t *p)
+{
+  trace_row_t *row;
+
+  if (p->depth)
+    return queue_pop(p, &p->solve_q);
+  row = queue_pop(p, &p->free_q);
+  read_row(p, row);
+  return row;
+}
+
+void trace_pipe_done(trace_pipe_t *p, trace_row_t *row)
+{
+  if (p->depth)
+    queue_push(p, &p->write_q, row);
+  else {
+      write_row(p, row);
+      queue_push(p, &p->free_q, row);
+  }
+}
+
+void trace_pipe_stop(trace_pipe_t *p)
+{
+  int i;
+
+  if (p->depth) {
+      queue_push(p, &p->write_q, NULL);
+      pthread_join(p->writer, NULL);
+      /* the reader has stopped at the row that ended the run	*/
+      pthread_join(p->reader, NULL);
+  }
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->cond);
+  tfree(p->free_q.rows);
+  tfree(p->solve_q.rows);
+  tfree(p->write_q.rows);
+  for(i=0; i < p->slots; i++) {
+      free_dvector(p->pool[i].vals);
+      free_dvector(p->pool[i].vals2);
+      free_dvector(p->pool[i].power);
+  }
+  tfree(p->pool);
+  tfree(p);
+}
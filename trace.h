@@ -0,0 +1,96 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * read a line of unit names into 'names' (from alloc_names).
+ * returns the no. of names read
+ */
+int read_names(FILE *fp, char **names);
+/* read a line of values. returns their no., 0 at the end of the file	*/
+int read_vals(FILE *fp, double *vals);
+/* write a line of unit names	*/
+void write_names(FILE *fp, char **names, int size);
+/* write a line of temperatures	*/
+void write_vals(FILE *fp, double *vals, int size);
+/* write a line of power values (in W)	*/
+void write_vals_power(FILE *fp, double *vals, int size);
+
+/* 'nr' strings of 'nc' characters in one contiguous block	*/
+char **alloc_names(int nr, int nc);
+void free_names(char **m);
+
+/*
+ * pipelined processing of a power trace: a reader thread parses
+ * rows (and permutes them through a callback) ahead of the solver
+ * and a writer thread writes the results, so that neither is on
+ * the solver's critical path. the reader works up to 'depth' rows
+ * ahead. with a depth of 0, everything happens in the caller's
+ * thread, one row at a time. the solver may hold up to 'hold' rows
+ * before handing them over (e.g. to merge them into one interval)
+ */
+#define PIPELINE_DEPTH	4
+
+/* one row of the trace on its way through the stages	*/
+typedef struct trace_row_t_st
+{
+  /* values read, in the trace file order. the solver
+   * replaces them by the temperatures to be written
+   */
+  double *vals;
+  /* second output row (total power with leakage)	*/
+  double *vals2;
+  /* power numbers in the model's order (see 'permute')	*/
+  double *power;
+  /* no. of values read. 0 at the end of the file	*/
+  int num;
+  /* to be written by the writer?	*/
+  int write;
+}trace_row_t;
+
+/* permutes 'vals' into 'power'	*/
+typedef void (*permute_fn_ptr)(void *arg, double *vals, double *power);
+
+/* bounded FIFO of rows between two stages	*/
+typedef struct row_queue_t_st
+{
+  trace_row_t **rows;
+  int head;
+  int count;
+}row_queue_t;
+
+typedef struct trace_pipe_t_st
+{
+  /* trace files. 'out2' gets vals2 if not NULL	*/
+  FILE *in, *out, *out2;
+  /* values per row	*/
+  int n;
+  int depth;
+  /* rows in circulation	*/
+  int slots;
+  permute_fn_ptr permute;
+  void *arg;
+  /* slots and the queues in front of the reader, solver and writer	*/
+  trace_row_t *pool;
+  row_queue_t free_q, solve_q, write_q;
+  pthread_t reader, writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+}trace_pipe_t;
+
+/* 'power_size' is the length of the permuted vectors	*/
+trace_pipe_t *trace_pipe_start(FILE *in, FILE *out, FILE *out2, int n, int power_size,
+                               int depth, int hold, permute_fn_ptr permute, void *arg);
+/*
+ * next row for the solver. its 'num' differs from 'n' at the end of
+ * the file (0) or on a malformed row, after which the reader stops
+ */
+trace_row_t *trace_pipe_next(trace_pipe_t *p);
+/* hand a solved row over to the writer	*/
+void trace_pipe_done(trace_pipe_t *p, trace_row_t *row);
+/* wait for the writer to finish and free the pipe. to be called after the last row	*/
+void trace_pipe_stop(trace_pipe_t *p);
+
+#endif
@@ -9,8 +9,11 @@
 #include <strings.h>
 #endif
 #include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "util.h"
+#include "profile.h"
 
 #define SWAP(a,b) {temp=(a); (a)=(b); (b)=temp;}
 
@@ -19,7 +22,7 @@ unsigned int volt[128];
 
 double alpha_ONoC_MRR, beta_ONoC_MRR, Tref_ONoC_MRR, S_ONoC_MRR, pvmod_ONoC_MRR;
 
-unsigned int trace_num;
+int trace_num;
 
 int eq(double x, double y)
 {
@@ -83,19 +86,149 @@ int tolerant_floor(double val)
 		return ((int) floor(val));
 }
 
-double *dvector(int n)
+/*
+ * memory accounting. when enabled, the size and tag of every live
+ * allocation is kept in an open addressing hash table keyed by its
+ * address (linear probing, backward shift deletion). such blocks
+ * must be released with tfree (or free_dvector etc.)
+ */
+char *mem_tag_names[MEM_N_TAGS] = {"misc", "model", "map", "solver", "uchan", "trace", "stats"};
+
+typedef struct mem_entry_t_st
+{
+	void *p;
+	size_t size;
+	mem_tag_t tag;
+}mem_entry_t;
+
+static struct
+{
+	int enabled;
+	mem_entry_t *table;
+	/* capacity (a power of two) and no. of entries	*/
+	size_t cap, n;
+	/* per tag and (at MEM_N_TAGS) in total	*/
+	long long cur[MEM_N_TAGS+1], peak[MEM_N_TAGS+1];
+	pthread_mutex_t lock;
+} mem = {FALSE, NULL, 0, 0, {0}, {0}, PTHREAD_MUTEX_INITIALIZER};
+
+/* per thread, as workers (e.g. -mc_threads) set it concurrently	*/
+static __thread mem_tag_t mem_tag = MEM_MISC;
+
+static size_t mem_slot(void *p)
+{
+	return (size_t) ((((uintptr_t) p >> 4) * 0x9E3779B97F4A7C15ULL) >> 16) & (mem.cap - 1);
+}
+
+static void mem_charge(mem_tag_t tag, long long bytes)
+{
+	mem.cur[tag] += bytes;
+	mem.cur[MEM_N_TAGS] += bytes;
+	mem.peak[tag] = MAX(mem.peak[tag], mem.cur[tag]);
+	mem.peak[MEM_N_TAGS] = MAX(mem.peak[MEM_N_TAGS], mem.cur[MEM_N_TAGS]);
+}
+
+static void mem_remove(void *p)
+{
+	size_t i, j, k;
+
+	if (!mem.cap)
+		return;
+	for(i = mem_slot(p); mem.table[i].p != p; i = (i + 1) & (mem.cap - 1))
+		if (!mem.table[i].p)
+			return;
+	mem_charge(mem.table[i].tag, -(long long) mem.table[i].size);
+	mem.n--;
+	/* move up the entries that probed past the hole	*/
+	for(j = (i + 1) & (mem.cap - 1); mem.table[j].p; j = (j + 1) & (mem.cap - 1)) {
+		k = mem_slot(mem.table[j].p);
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			mem.table[i] = mem.table[j];
+			i = j;
+		}
+	}
+	mem.table[i].p = NULL;
+}
+
+static void mem_insert(void *p, size_t size, mem_tag_t tag)
 {
-	double *v;
+	size_t i, old_cap = mem.cap;
+	mem_entry_t *old = mem.table;
+
+	/* stale entry of a block released with free()	*/
+	mem_remove(p);
+	if (2 * (mem.n + 1) > mem.cap) {
+		mem.cap = MAX(1024, 2 * old_cap);
+		if (!(mem.table = (mem_entry_t *) calloc(mem.cap, sizeof(mem_entry_t))))
+			fatal("allocation failure in memory accounting\n");
+		for(i=0; i < old_cap; i++)
+			if (old[i].p) {
+				size_t j = mem_slot(old[i].p);
+				while (mem.table[j].p)
+					j = (j + 1) & (mem.cap - 1);
+				mem.table[j] = old[i];
+			}
+		free(old);
+	}
+	for(i = mem_slot(p); mem.table[i].p; i = (i + 1) & (mem.cap - 1));
+	mem.table[i].p = p;
+	mem.table[i].size = size;
+	mem.table[i].tag = tag;
+	mem.n++;
+	mem_charge(tag, size);
+}
 
-	v=(double *)calloc(n, sizeof(double));
-	if (!v) fatal("allocation failure in dvector()\n");
+void mem_track(int enable)
+{
+	mem.enabled = enable;
+}
 
-	return v;
+mem_tag_t mem_set_tag(mem_tag_t tag)
+{
+	mem_tag_t old = mem_tag;
+	mem_tag = tag;
+	return old;
+}
+
+void *tcalloc(size_t n, size_t size)
+{
+	void *p = calloc(n, size);
+	if (!p && n && size)
+		fatal("memory allocation error\n");
+	PROF_COUNT(allocs, 1);
+	PROF_COUNT(alloc_bytes, (long long) n * size);
+	if (mem.enabled && p) {
+		pthread_mutex_lock(&mem.lock);
+		mem_insert(p, n * size, mem_tag);
+		pthread_mutex_unlock(&mem.lock);
+	}
+	return p;
+}
+
+void tfree(void *p)
+{
+	if (mem.enabled && p) {
+		pthread_mutex_lock(&mem.lock);
+		mem_remove(p);
+		pthread_mutex_unlock(&mem.lock);
+	}
+	free(p);
+}
+
+void mem_usage(mem_tag_t tag, long long *current, long long *peak)
+{
+	*current = mem.cur[tag];
+	*peak = mem.peak[tag];
+}
+
+double *dvector(int n)
+{
+	return (double *) tcalloc(n, sizeof(double));
 }
 
 void free_dvector(double *v)
 {
-	free(v);
+	tfree(v);
 }
 
 void dump_dvector (double *v, int n)
@@ -128,17 +261,12 @@ double sum_dvector (double *v, int n)
 
 int *ivector(int n)
 {
-	int *v;
-
-	v = (int *)calloc(n, sizeof(int));
-	if (!v) fatal("allocation failure in ivector()\n");
-
-	return v;
+	return (int *) tcalloc(n, sizeof(int));
 }
 
 void free_ivector(int *v)
 {
-	free(v);
+	tfree(v);
 }
 
 void dump_ivector (int *v, int n)
@@ -168,10 +296,8 @@ double **dmatrix(int nr, int nc)
 	int i;
 	double **m;
 
-	m = (double **) calloc (nr, sizeof(double *));
-	assert(m != NULL);
-	m[0] = (double *) calloc (nr * nc, sizeof(double));
-	assert(m[0] != NULL);
+	m = (double **) tcalloc (nr, sizeof(double *));
+	m[0] = (double *) tcalloc ((size_t) nr * nc, sizeof(double));
 
 	for (i = 1; i < nr; i++)
     	m[i] =  m[0] + nc * i;
@@ -181,8 +307,8 @@ double **dmatrix(int nr, int nc)
 
 void free_dmatrix(double **m)
 {
-	free(m[0]);
-	free(m);
+	tfree(m[0]);
+	tfree(m);
 }
 
 int **imatrix(int nr, int nc)
@@ -190,10 +316,8 @@ int **imatrix(int nr, int nc)
 	int i;
 	int **m;
 
-	m = (int **) calloc (nr, sizeof(int *));
-	assert(m != NULL);
-	m[0] = (int *) calloc (nr * nc, sizeof(int));
-	assert(m[0] != NULL);
+	m = (int **) tcalloc (nr, sizeof(int *));
+	m[0] = (int *) tcalloc ((size_t) nr * nc, sizeof(int));
 
 	for (i = 1; i < nr; i++)
 		m[i] = m[0] + nc * i;
@@ -203,8 +327,8 @@ int **imatrix(int nr, int nc)
 
 void free_imatrix(int **m)
 {
-	free(m[0]);
-	free(m);
+	tfree(m[0]);
+	tfree(m);
 }
 
 void dump_dmatrix (double **m, int nr, int nc)
@@ -241,14 +365,11 @@ double ***dcuboid_tail(int nr, int nc, int nl, int xtra)
 	double ***m;
 
 	/* 1-d array of pointers to the rows of the 2-d array below	*/
-	m = (double ***) calloc (nl, sizeof(double **));
-	assert(m != NULL);
+	m = (double ***) tcalloc (nl, sizeof(double **));
 	/* 2-d array of pointers denoting (layer, row)	*/
-	m[0] = (double **) calloc (nl * nr, sizeof(double *));
-	assert(m[0] != NULL);
+	m[0] = (double **) tcalloc (nl * nr, sizeof(double *));
 	/* the actual 3-d data array	*/
-	m[0][0] = (double *) calloc (nl * nr * nc + xtra, sizeof(double));
-	assert(m[0][0] != NULL);
+	m[0][0] = (double *) tcalloc ((size_t) nl * nr * nc + xtra, sizeof(double));
 
 	/* remaining pointers of the 1-d pointer array	*/
 	for (i = 1; i < nl; i++)
@@ -269,9 +390,9 @@ double ***dcuboid_tail(int nr, int nc, int nl, int xtra)
 
 void free_dcuboid(double ***m)
 {
-	free(m[0][0]);
-	free(m[0]);
-	free(m);
+	tfree(m[0][0]);
+	tfree(m[0]);
+	tfree(m);
 }
 
 /* mirror the lower triangle to make 'm' fully symmetric	*/
@@ -321,6 +442,44 @@ double rand_fraction(void)
 	return ((double) rand() / (RAND_MAX+1.0));
 }
 
+/* re-entrant random number generation (splitmix64)	*/
+void init_rand_r(rand_state_t *state, unsigned long long seed)
+{
+	state->s = seed;
+}
+
+static unsigned long long next_rand_r(rand_state_t *state)
+{
+	unsigned long long z = (state->s += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* random number in the range [0, 1) - 53 random bits	*/
+double rand_fraction_r(rand_state_t *state)
+{
+	return (next_rand_r(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* random number within the range [0, max-1]	*/
+int rand_upto_r(rand_state_t *state, int max)
+{
+	return (int) (max * rand_fraction_r(state));
+}
+
+unsigned long long hash_bytes(unsigned long long h, const void *data, size_t size)
+{
+	const unsigned char *c = data;
+	size_t i;
+
+	for(i=0; i < size; i++) {
+		h ^= c[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
 /*
  * reads tab-separated name-value pairs from file into
  * a table of size max_entries and returns the number
@@ -44,6 +44,35 @@ void swap_dval (double *a, double *b);
 int tolerant_ceil(double val);
 int tolerant_floor(double val);
 
+/*
+ * memory accounting. the vector and matrix allocators below and
+ * tcalloc charge their blocks to the current tag. the accounting
+ * is off by default and costs nothing then (see mem_track). the
+ * current tag is global. with worker threads, it is approximate
+ */
+typedef enum mem_tag_t_en
+{
+	MEM_MISC,		/* anything else	*/
+	MEM_MODEL,		/* thermal model state (block matrices, grid cuboids)	*/
+	MEM_MAP,		/* block-grid maps of the grid model	*/
+	MEM_SOLVER,		/* workspace of the transient and steady state solvers	*/
+	MEM_UCHAN,		/* microchannel networks and pressure matrices	*/
+	MEM_TRACE,		/* unit names of the traces	*/
+	MEM_STATS,		/* streaming statistics of the temperatures	*/
+	MEM_N_TAGS
+}mem_tag_t;
+extern char *mem_tag_names[MEM_N_TAGS];
+
+/* enable/disable the accounting of current and peak bytes per tag	*/
+void mem_track(int enable);
+/* set the current tag of the calling thread. returns the previous one	*/
+mem_tag_t mem_set_tag(mem_tag_t tag);
+/* calloc charged to the current tag. fatal on failure	*/
+void *tcalloc(size_t n, size_t size);
+void tfree(void *p);
+/* current and peak bytes of 'tag', of all tags for MEM_N_TAGS	*/
+void mem_usage(mem_tag_t tag, long long *current, long long *peak);
+
 /* vector routines	*/
 double 	*dvector(int n);
 void free_dvector(double *v);
@@ -93,6 +122,22 @@ int rand_upto(int max);
 /* random number in the range [0, 1)	*/
 double rand_fraction(void);
 
+/*
+ * re-entrant versions of the above with explicit state
+ * (splitmix64), one per thread or annealing chain
+ */
+typedef struct rand_state_t_st
+{
+	unsigned long long s;
+}rand_state_t;
+void init_rand_r(rand_state_t *state, unsigned long long seed);
+int rand_upto_r(rand_state_t *state, int max);
+double rand_fraction_r(rand_state_t *state);
+
+/* 64-bit FNV-1a hash of 'size' bytes, continued from 'h'	*/
+#define HASH_INIT		14695981039346656037ULL
+unsigned long long hash_bytes(unsigned long long h, const void *data, size_t size);
+
 /* a table of name value pairs	*/
 typedef struct str_pair_st
 {
@@ -198,5 +243,5 @@ extern unsigned int volt[128];
 // Pre-computed parameters for ONoC-TxRx tuning power
 extern double alpha_ONoC_MRR, beta_ONoC_MRR, Tref_ONoC_MRR, S_ONoC_MRR, pvmod_ONoC_MRR;
 
-extern unsigned int trace_num; 
+extern int trace_num; 
 #endif
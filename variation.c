@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "variation.h"
+#include "temperature.h"
+#include "temperature_grid.h"
+#include "util.h"
+
+/* percentiles reported	*/
+#define N_QUANTILES		3
+static const double quantiles[N_QUANTILES] = {0.50, 0.95, 0.99};
+
+/* smallest multiplier of a nominal value (truncates the normal)	*/
+#define MIN_FACTOR		0.1
+
+/* running mean, variance (Welford) and extremes	*/
+typedef struct moments_t_st
+{
+	int n;
+	double mean, m2, min, max;
+}moments_t;
+
+/*
+ * P-square estimate of a quantile from a stream of values
+ * (Jain and Chlamtac, 1985). five markers track the minimum,
+ * the p/2, p and (1+p)/2 quantiles and the maximum, and are
+ * moved by piecewise-parabolic interpolation
+ */
+typedef struct p2_t_st
+{
+	double p;
+	int count;
+	/* marker heights, positions and desired positions	*/
+	double q[5], n[5], np[5], dn[5];
+}p2_t;
+
+/* statistics of one block (or of the chip peak)	*/
+typedef struct unit_stats_t_st
+{
+	moments_t m;
+	p2_t q[N_QUANTILES];
+}unit_stats_t;
+
+/* state shared by the worker threads	*/
+typedef struct study_t_st
+{
+	variation_config_t *vconfig;
+	double *power;
+	/* nominal TxRx_pvmod	*/
+	double pvmod;
+	/* next sample to be run	*/
+	int next;
+	int unconverged;
+	/* per-block statistics and those of the peak	*/
+	int n_units;
+	unit_stats_t *units, peak;
+	pthread_mutex_t lock;
+}study_t;
+
+/* one worker thread and its private model	*/
+typedef struct worker_t_st
+{
+	study_t *study;
+	RC_model_t *model;
+	/* nominal layer conductivities and thicknesses	*/
+	double *k, *thickness;
+	pthread_t thread;
+}worker_t;
+
+static void moments_add(moments_t *m, double x)
+{
+	double d = x - m->mean;
+	if (!m->n)
+		m->min = m->max = x;
+	m->n++;
+	m->mean += d / m->n;
+	m->m2 += d * (x - m->mean);
+	m->min = MIN(m->min, x);
+	m->max = MAX(m->max, x);
+}
+
+static double moments_sd(moments_t *m)
+{
+	return (m->n > 1) ? sqrt(m->m2 / (m->n - 1)) : 0.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void p2_init(p2_t *e, double p)
+{
+	memset(e, 0, sizeof(p2_t));
+	e->p = p;
+	e->dn[1] = p / 2.0;
+	e->dn[2] = p;
+	e->dn[3] = (1.0 + p) / 2.0;
+	e->dn[4] = 1.0;
+}
+
+static void p2_add(p2_t *e, double x)
+{
+	int i, k;
+	double d, s, qp;
+
+	/* the first five values are the initial markers	*/
+	if (e->count < 5) {
+		e->q[e->count++] = x;
+		if (e->count == 5) {
+			qsort(e->q, 5, sizeof(double), cmp_double);
+			for(i=0; i < 5; i++)
+				e->n[i] = i;
+			e->np[0] = 0;
+			e->np[1] = 2 * e->p;
+			e->np[2] = 4 * e->p;
+			e->np[3] = 2 + 2 * e->p;
+			e->np[4] = 4;
+		}
+		return;
+	}
+
+	/* cell of the new value	*/
+	if (x < e->q[0]) {
+		e->q[0] = x;
+		k = 0;
+	} else if (x >= e->q[4]) {
+		e->q[4] = x;
+		k = 3;
+	} else
+		for(k=0; k < 3 && x >= e->q[k+1]; k++);
+	for(i=k+1; i < 5; i++)
+		e->n[i]++;
+	for(i=0; i < 5; i++)
+		e->np[i] += e->dn[i];
+	e->count++;
+
+	/* adjust the middle markers	*/
+	for(i=1; i < 4; i++) {
+		d = e->np[i] - e->n[i];
+		if ((d >= 1 && e->n[i+1] - e->n[i] > 1) ||
+			(d <= -1 && e->n[i-1] - e->n[i] < -1)) {
+			s = (d > 0) ? 1.0 : -1.0;
+			qp = e->q[i] + s / (e->n[i+1] - e->n[i-1]) *
+				 ((e->n[i] - e->n[i-1] + s) * (e->q[i+1] - e->q[i]) / (e->n[i+1] - e->n[i]) +
+				  (e->n[i+1] - e->n[i] - s) * (e->q[i] - e->q[i-1]) / (e->n[i] - e->n[i-1]));
+			/* fall back to linear if the parabola overshoots	*/
+			if (e->q[i-1] < qp && qp < e->q[i+1])
+				e->q[i] = qp;
+			else
+				e->q[i] += s * (e->q[i+(int)s] - e->q[i]) / (e->n[i+(int)s] - e->n[i]);
+			e->n[i] += s;
+		}
+	}
+}
+
+static double p2_get(p2_t *e)
+{
+	double sorted[5];
+
+	if (e->count >= 5)
+		return e->q[2];
+	if (!e->count)
+		return 0.0;
+	/* too few values: exact	*/
+	memcpy(sorted, e->q, e->count * sizeof(double));
+	qsort(sorted, e->count, sizeof(double), cmp_double);
+	return sorted[(int) floor(e->p * (e->count - 1) + 0.5)];
+}
+
+static void stats_init(unit_stats_t *u)
+{
+	int i;
+	memset(&u->m, 0, sizeof(moments_t));
+	for(i=0; i < N_QUANTILES; i++)
+		p2_init(&u->q[i], quantiles[i]);
+}
+
+static void stats_add(unit_stats_t *u, double x)
+{
+	int i;
+	moments_add(&u->m, x);
+	for(i=0; i < N_QUANTILES; i++)
+		p2_add(&u->q[i], x);
+}
+
+static void stats_print(FILE *fp, char *name, unit_stats_t *u)
+{
+	int i;
+	fprintf(fp, "%s\t%.2f\t%.3f\t%.2f", name, u->m.mean, moments_sd(&u->m), u->m.min);
+	for(i=0; i < N_QUANTILES; i++)
+		fprintf(fp, "\t%.2f", p2_get(&u->q[i]));
+	fprintf(fp, "\t%.2f\n", u->m.max);
+}
+
+/* standard normal variate (Box-Muller)	*/
+static double gauss_r(rand_state_t *state)
+{
+	double u1 = 1.0 - rand_fraction_r(state);
+	double u2 = rand_fraction_r(state);
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* multiplier for a relative standard deviation 'sd'	*/
+static double factor_r(rand_state_t *state, double sd)
+{
+	return MAX(MIN_FACTOR, 1.0 + sd * gauss_r(state));
+}
+
+variation_config_t default_variation_config(void)
+{
+	variation_config_t config;
+
+	config.mc_samples = 0;
+	config.mc_threads = 1;
+	config.mc_seed = RAND_SEED;
+	config.mc_k_chip_sd = 0.0;
+	config.mc_t_interface_sd = 0.0;
+	config.mc_pvmod_sd = 0.0;
+	strcpy(config.mc_file, NULLFILE);
+
+	return config;
+}
+
+void variation_config_add_from_strs(variation_config_t *config, str_pair *table, int size)
+{
+	int idx;
+
+	if ((idx = get_str_index(table, size, "mc_samples")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->mc_samples) != 1)
+			fatal("invalid format for configuration  parameter mc_samples\n");
+	if ((idx = get_str_index(table, size, "mc_threads")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->mc_threads) != 1)
+			fatal("invalid format for configuration  parameter mc_threads\n");
+	if ((idx = get_str_index(table, size, "mc_seed")) >= 0)
+		if(sscanf(table[idx].value, "%d", &config->mc_seed) != 1)
+			fatal("invalid format for configuration  parameter mc_seed\n");
+	if ((idx = get_str_index(table, size, "mc_k_chip_sd")) >= 0)
+		if(sscanf(table[idx].value, "%lf", &config->mc_k_chip_sd) != 1)
+			fatal("invalid format for configuration  parameter mc_k_chip_sd\n");
+	if ((idx = get_str_index(table, size, "mc_t_interface_sd")) >= 0)
+		if(sscanf(table[idx].value, "%lf", &config->mc_t_interface_sd) != 1)
+			fatal("invalid format for configuration  parameter mc_t_interface_sd\n");
+	if ((idx = get_str_index(table, size, "mc_pvmod_sd")) >= 0)
+		if(sscanf(table[idx].value, "%lf", &config->mc_pvmod_sd) != 1)
+			fatal("invalid format for configuration  parameter mc_pvmod_sd\n");
+	if ((idx = get_str_index(table, size, "mc_file")) >= 0)
+		if(sscanf(table[idx].value, "%s", config->mc_file) != 1)
+			fatal("invalid format for configuration  parameter mc_file\n");
+
+	if (config->mc_samples < 0)
+		fatal("mc_samples should be non-negative\n");
+	if (config->mc_threads < 1)
+		fatal("mc_threads should be at least 1\n");
+	if (config->mc_k_chip_sd < 0 || config->mc_t_interface_sd < 0 ||
+		config->mc_pvmod_sd < 0)
+		fatal("standard deviations of the variation study should be non-negative\n");
+}
+
+int variation_config_to_strs(variation_config_t *config, str_pair *table, int max_entries)
+{
+	if (max_entries < 7)
+		fatal("not enough entries in table\n");
+
+	sprintf(table[0].name, "mc_samples");
+	sprintf(table[1].name, "mc_threads");
+	sprintf(table[2].name, "mc_seed");
+	sprintf(table[3].name, "mc_k_chip_sd");
+	sprintf(table[4].name, "mc_t_interface_sd");
+	sprintf(table[5].name, "mc_pvmod_sd");
+	sprintf(table[6].name, "mc_file");
+
+	sprintf(table[0].value, "%d", config->mc_samples);
+	sprintf(table[1].value, "%d", config->mc_threads);
+	sprintf(table[2].value, "%d", config->mc_seed);
+	sprintf(table[3].value, "%lg", config->mc_k_chip_sd);
+	sprintf(table[4].value, "%lg", config->mc_t_interface_sd);
+	sprintf(table[5].value, "%lg", config->mc_pvmod_sd);
+	sprintf(table[6].value, "%s", config->mc_file);
+
+	return 7;
+}
+
+/*
+ * steady state temperatures of one sample. the tuning power
+ * of the TxRx units depends on their temperature (and on the
+ * sampled pvmod). so, like the leakage, it is iterated to a
+ * fixed point. returns FALSE if that does not converge
+ */
+static int solve_sample(RC_model_t *model, double *power, double *power_new,
+						double *temp, double *temp_old, double pvmod)
+{
+	grid_model_t *g = model->grid;
+	int i, j, k, base, has_txrx = FALSE;
+	double d_max;
+
+	set_temp(model, temp, model->config->init_temp);
+	for(i=0; i <= LEAKAGE_MAX_ITER; i++) {
+		copy_dvector(power_new, power, g->total_n_blocks);
+		for(k=0, base=0; k < g->n_layers; k++) {
+			if (g->layers[k].has_power)
+				for(j=0; j < g->layers[k].flp->n_units; j++)
+					if (!strncmp(g->layers[k].flp->units[j].name, "TxRx", 4)) {
+						power_new[base+j] += get_ONoC_tuning_pwr_pv(temp[base+j], pvmod);
+						has_txrx = TRUE;
+					}
+			base += g->layers[k].flp->n_units;
+		}
+		copy_dvector(temp_old, temp, g->total_n_blocks);
+		steady_state_temp(model, power_new, temp);
+		if (!has_txrx)
+			return TRUE;
+
+		d_max = 0.0;
+		for(j=0; j < g->total_n_blocks; j++)
+			d_max = MAX(d_max, fabs(temp[j] - temp_old[j]));
+		if (d_max < LEAK_TOL)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* add the block temperatures of a sample to the statistics	*/
+static void record_sample(study_t *st, grid_model_t *g, double *temp, int converged)
+{
+	int j, k, u, base;
+	double peak = 0.0;
+
+	for(k=0, base=0, u=0; k < g->n_layers; k++) {
+		if (g->layers[k].has_power)
+			for(j=0; j < g->layers[k].flp->n_units; j++, u++) {
+				stats_add(&st->units[u], temp[base+j]);
+				if (!u || temp[base+j] > peak)
+					peak = temp[base+j];
+			}
+		base += g->layers[k].flp->n_units;
+	}
+	stats_add(&st->peak, peak);
+	if (!converged)
+		st->unconverged++;
+}
+
+static void *variation_worker(void *arg)
+{
+	worker_t *w = (worker_t *) arg;
+	study_t *st = w->study;
+	variation_config_t *vc = st->vconfig;
+	RC_model_t *model = w->model;
+	grid_model_t *g = model->grid;
+	int i, l, converged;
+	int intidx = g->n_layers - DEFAULT_PACK_LAYERS - 1;
+	double fk, ft, pvmod;
+	double *temp, *temp_old, *power_new;
+	rand_state_t rs;
+
+	temp = hotspot_vector(model);
+	temp_old = hotspot_vector(model);
+	power_new = hotspot_vector(model);
+
+	for(;;) {
+		pthread_mutex_lock(&st->lock);
+		i = st->next++;
+		pthread_mutex_unlock(&st->lock);
+		if (i >= vc->mc_samples)
+			break;
+
+		/* the parameters of a sample depend only on its index	*/
+		init_rand_r(&rs, (unsigned long long) vc->mc_seed * 1000003ULL + i);
+		fk = factor_r(&rs, vc->mc_k_chip_sd);
+		ft = factor_r(&rs, vc->mc_t_interface_sd);
+		pvmod = st->pvmod + vc->mc_pvmod_sd * gauss_r(&rs);
+
+		for(l=0; l < g->n_layers; l++) {
+			g->layers[l].k = w->k[l] * (g->layers[l].has_power ? fk : 1.0);
+			g->layers[l].thickness = w->thickness[l] * ((l == intidx) ? ft : 1.0);
+		}
+		populate_layer_R_grid(g);
+
+		converged = solve_sample(model, st->power, power_new, temp, temp_old, pvmod);
+
+		pthread_mutex_lock(&st->lock);
+		record_sample(st, g, temp, converged);
+		pthread_mutex_unlock(&st->lock);
+	}
+
+	free_dvector(temp);
+	free_dvector(temp_old);
+	free_dvector(power_new);
+	return NULL;
+}
+
+void run_variation(variation_config_t *vconfig, thermal_config_t *config,
+				   flp_t *flp, microchannel_config_t *microchannel_config,
+				   materials_list_t *materials_list, int do_detailed_3D,
+				   int use_microchannels, double *power)
+{
+	int i, j, k, u, l, n_threads = MIN(vconfig->mc_threads, vconfig->mc_samples);
+	study_t st;
+	worker_t *workers;
+	grid_model_t *g;
+	FILE *fp = stdout;
+
+	if (strcmp(config->model_type, GRID_MODEL_STR))
+		fatal("the variation study requires the grid model\n");
+	if (do_detailed_3D)
+		fatal("the variation study does not support -detailed_3D\n");
+
+	memset(&st, 0, sizeof(study_t));
+	st.vconfig = vconfig;
+	st.power = power;
+	st.pvmod = pvmod_ONoC_MRR;
+	pthread_mutex_init(&st.lock, NULL);
+
+	/* one model per worker. the block-grid maps are built here once	*/
+	workers = (worker_t *) calloc(n_threads, sizeof(worker_t));
+	if (!workers)
+		fatal("memory allocation error\n");
+	for(i=0; i < n_threads; i++) {
+		workers[i].study = &st;
+		workers[i].model = alloc_RC_model(config, flp, microchannel_config, materials_list,
+										  do_detailed_3D, use_microchannels);
+		populate_R_model(workers[i].model, flp);
+		g = workers[i].model->grid;
+		workers[i].k = dvector(g->n_layers);
+		workers[i].thickness = dvector(g->n_layers);
+		for(l=0; l < g->n_layers; l++) {
+			workers[i].k[l] = g->layers[l].k;
+			workers[i].thickness[l] = g->layers[l].thickness;
+		}
+	}
+
+	/* statistics	*/
+	g = workers[0].model->grid;
+	for(k=0; k < g->n_layers; k++)
+		if (g->layers[k].has_power)
+			st.n_units += g->layers[k].flp->n_units;
+	st.units = (unit_stats_t *) calloc(st.n_units, sizeof(unit_stats_t));
+	if (!st.units)
+		fatal("memory allocation error\n");
+	for(u=0; u < st.n_units; u++)
+		stats_init(&st.units[u]);
+	stats_init(&st.peak);
+
+	printf("Running %d variation samples on %d thread(s)...\n", vconfig->mc_samples, n_threads);
+	for(i=1; i < n_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, variation_worker, &workers[i]))
+			fatal("unable to create worker thread\n");
+	variation_worker(&workers[0]);
+	for(i=1; i < n_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	/* summary	*/
+	if (strcmp(vconfig->mc_file, NULLFILE) && !(fp = fopen(vconfig->mc_file, "w")))
+		fatal("unable to open variation summary file for output\n");
+	fprintf(fp, "# %d samples: k_chip sd %g, t_interface sd %g, pvmod sd %g\n",
+			vconfig->mc_samples, vconfig->mc_k_chip_sd, vconfig->mc_t_interface_sd,
+			vconfig->mc_pvmod_sd);
+	if (st.unconverged)
+		fprintf(fp, "# %d samples did not converge\n", st.unconverged);
+	fprintf(fp, "unit\tmean\tsd\tmin");
+	for(i=0; i < N_QUANTILES; i++)
+		fprintf(fp, "\tp%g", quantiles[i] * 100);
+	fprintf(fp, "\tmax\n");
+	for(k=0, u=0; k < g->n_layers; k++)
+		if (g->layers[k].has_power)
+			for(j=0; j < g->layers[k].flp->n_units; j++, u++)
+				stats_print(fp, g->layers[k].flp->units[j].name, &st.units[u]);
+	stats_print(fp, "chip_peak", &st.peak);
+	if (fp != stdout)
+		fclose(fp);
+
+	for(i=0; i < n_threads; i++) {
+		free_dvector(workers[i].k);
+		free_dvector(workers[i].thickness);
+		delete_RC_model(workers[i].model);
+	}
+	free(workers);
+	free(st.units);
+	pthread_mutex_destroy(&st.lock);
+}
@@ -0,0 +1,68 @@
+#ifndef __VARIATION_H_
+#define __VARIATION_H_
+
+#include "flp.h"
+#include "temperature.h"
+#include "microchannel.h"
+#include "materials.h"
+#include "util.h"
+
+/*
+ * Monte Carlo study of the effect of material and process
+ * variation on the steady state temperatures. each sample draws
+ * the varied parameters from normal distributions around their
+ * nominal values and solves the steady state of the same power
+ * map. the samples are spread over worker threads, each with a
+ * grid model of its own that is built (including its block-grid
+ * maps) only once. per sample, only the layer resistances are
+ * recomputed. per-block temperatures are condensed on the fly
+ * into summary statistics instead of being stored.
+ */
+typedef struct variation_config_t_st
+{
+	/* no. of samples. the study is off when zero	*/
+	int mc_samples;
+	/* no. of worker threads	*/
+	int mc_threads;
+	/* seed of the random number generator	*/
+	int mc_seed;
+	/*
+	 * relative standard deviations of the conductivity of the
+	 * power dissipating layers and of the thickness of the
+	 * interface layer (the last layer above the spreader)
+	 */
+	double mc_k_chip_sd;
+	double mc_t_interface_sd;
+	/* absolute standard deviation of TxRx_pvmod	*/
+	double mc_pvmod_sd;
+	/* summary output file	*/
+	char mc_file[STR_SIZE];
+}variation_config_t;
+
+/* default study parameters (off)	*/
+variation_config_t default_variation_config(void);
+/*
+ * parse a table of name-value string pairs and add the configuration
+ * parameters to 'config'
+ */
+void variation_config_add_from_strs(variation_config_t *config, str_pair *table, int size);
+/*
+ * convert config into a table of name-value pairs. returns the no.
+ * of parameters converted
+ */
+int variation_config_to_strs(variation_config_t *config, str_pair *table, int max_entries);
+
+/*
+ * run the study for the block power numbers in 'power' (in the
+ * order of a grid model built from the same inputs) and write
+ * the mean, standard deviation, extremes and percentiles of
+ * every block's temperature and of the chip's peak temperature
+ * to the summary file. the remaining arguments are those of
+ * alloc_RC_model
+ */
+void run_variation(variation_config_t *vconfig, thermal_config_t *config,
+				   flp_t *flp, microchannel_config_t *microchannel_config,
+				   materials_list_t *materials_list, int do_detailed_3D,
+				   int use_microchannels, double *power);
+
+#endif